@@ -0,0 +1,135 @@
+#pragma once
+
+#include "Defines.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+/**
+* Axis aligned bounding box. A default constructed box is empty: it
+* contains no points and growing it by a point or box gives that point or
+* box.
+*/
+struct AABB
+{
+	AABB() : minimum(DBL_MAX), maximum(-DBL_MAX) {}
+
+	AABB(const dvec3 & minimum, const dvec3 & maximum) : minimum(minimum), maximum(maximum) {}
+
+	/**
+	* Returns true if the box contains no points.
+	*/
+	bool isEmpty() const
+	{
+		return minimum.x > maximum.x || minimum.y > maximum.y || minimum.z > maximum.z;
+	}
+
+	/**
+	* Grows the box to contain a point.
+	*/
+	void expand(const dvec3 & point)
+	{
+		minimum = glm::min(minimum, point);
+		maximum = glm::max(maximum, point);
+	}
+
+	/**
+	* Grows the box to contain another box.
+	*/
+	void expand(const AABB & box)
+	{
+		minimum = glm::min(minimum, box.minimum);
+		maximum = glm::max(maximum, box.maximum);
+	}
+
+	/**
+	* Returns the point halfway between the corners.
+	*/
+	dvec3 getCenter() const
+	{
+		return 0.5 * (minimum + maximum);
+	}
+
+	/**
+	* Returns the area of the six faces. Zero for an empty box.
+	*/
+	double getSurfaceArea() const
+	{
+		if (isEmpty()) {
+			return 0.0;
+		}
+
+		dvec3 size = maximum - minimum;
+
+		return 2.0 * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+
+	/**
+	* Returns the axis along which the box is longest. 0 for x, 1 for y,
+	* and 2 for z.
+	*/
+	int getLongestAxis() const
+	{
+		dvec3 size = maximum - minimum;
+
+		if (size.x >= size.y && size.x >= size.z) {
+			return 0;
+		}
+		return (size.y >= size.z) ? 1 : 2;
+	}
+
+	/**
+	* Checks a ray for intersection with the box using the slab method.
+	* @param origin - origin of the ray
+	* @param inverseDirection - one divided by each component of the
+	* direction of the ray
+	* @param maxDistance - intersections farther along the ray are ignored
+	* @param entryDistance - set to the parameter at which the ray enters
+	* the box, or zero if the origin is inside it
+	* @returns true if the ray passes through the box between zero and
+	* maxDistance
+	*/
+	bool intersect(const dvec3 & origin, const dvec3 & inverseDirection, double maxDistance,
+		double & entryDistance) const
+	{
+		double tEnter = 0.0;
+		double tExit = maxDistance;
+
+		for (int axis = 0; axis < 3; axis++) {
+
+			// A ray parallel to the slabs is inside them or misses the box.
+			// Checked separately since 0 * infinity is not a number.
+			if (std::isinf(inverseDirection[axis])) {
+
+				if (origin[axis] < minimum[axis] || origin[axis] > maximum[axis]) {
+					return false;
+				}
+				continue;
+			}
+
+			double t0 = (minimum[axis] - origin[axis]) * inverseDirection[axis];
+			double t1 = (maximum[axis] - origin[axis]) * inverseDirection[axis];
+
+			if (t0 > t1) {
+				std::swap(t0, t1);
+			}
+
+			tEnter = glm::max(tEnter, t0);
+			tExit = glm::min(tExit, t1);
+
+			if (tEnter > tExit) {
+				return false;
+			}
+		}
+
+		entryDistance = tEnter;
+		return true;
+	}
+
+	// Corner with the smallest coordinates
+	dvec3 minimum;
+
+	// Corner with the largest coordinates
+	dvec3 maximum;
+};
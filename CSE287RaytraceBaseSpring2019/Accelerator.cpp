@@ -0,0 +1,255 @@
+#include "Accelerator.h"
+#include "BoundingVolumeHierarchy.h"
+#include "GridAccelerator.h"
+#include "LinearAccelerator.h"
+#include "WideBoundingVolumeHierarchy.h"
+#include "QuantizedBoundingVolumeHierarchy.h"
+
+#include <chrono>
+
+const double Accelerator::TRAVERSAL_COST = 0.125;
+const double Accelerator::INTERSECTION_COST = 1.0;
+const double Accelerator::REBUILD_COST_RATIO = 1.5;
+
+std::shared_ptr<Accelerator> Accelerator::create(AcceleratorType type)
+{
+	switch (type) {
+	case AcceleratorType::LINEAR:
+		return std::make_shared<LinearAccelerator>();
+	case AcceleratorType::BINNED_BVH:
+		return std::make_shared<BoundingVolumeHierarchy>(BoundingVolumeHierarchy::BuildMethod::BINNED_SAH);
+	case AcceleratorType::MORTON_BVH:
+		return std::make_shared<BoundingVolumeHierarchy>(BoundingVolumeHierarchy::BuildMethod::MORTON);
+	case AcceleratorType::SPLIT_BVH:
+		return std::make_shared<BoundingVolumeHierarchy>(BoundingVolumeHierarchy::BuildMethod::SPATIAL_SPLITS);
+	case AcceleratorType::WIDE4_BVH:
+		return std::make_shared<WideBoundingVolumeHierarchy<4>>();
+	case AcceleratorType::WIDE8_BVH:
+		return std::make_shared<WideBoundingVolumeHierarchy<8>>();
+	case AcceleratorType::QUANTIZED_BVH:
+		return std::make_shared<QuantizedBoundingVolumeHierarchy>();
+	case AcceleratorType::GRID:
+		return std::make_shared<GridAccelerator>();
+	case AcceleratorType::TWO_LEVEL_GRID:
+		return std::make_shared<GridAccelerator>(true);
+	case AcceleratorType::BVH:
+	default:
+		return std::make_shared<BoundingVolumeHierarchy>(BoundingVolumeHierarchy::BuildMethod::SWEEP_SAH);
+	}
+
+} // end create
+
+
+void Accelerator::build(const SurfaceVector & surfaces, ThreadPool * threadPool)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	this->surfaces = surfaces;
+
+	std::vector<AABB> surfaceBounds;
+	classifySurfaces(surfaces, unboundedSurfaces, boundedSurfaces, surfaceBounds, bounds);
+
+	std::vector<Primitive> primitives;
+	primitives.reserve(boundedSurfaces.size());
+
+	for (int surface : boundedSurfaces) {
+		primitives.push_back({ surfaceBounds[surface], surfaceBounds[surface].getCenter(), surface });
+	}
+
+	buildStructure(primitives, threadPool);
+
+	buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	builtCost = getCost();
+	refitCount = 0;
+
+} // end build
+
+
+std::shared_ptr<Accelerator> Accelerator::refit(const SurfaceVector & surfaces, ThreadPool * threadPool) const
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	if (canRefit() == false || surfaces.size() != this->surfaces.size()) {
+		return nullptr;
+	}
+
+	std::vector<int> unbounded;
+	std::vector<int> bounded;
+	std::vector<AABB> surfaceBounds;
+	AABB allBounds;
+	classifySurfaces(surfaces, unbounded, bounded, surfaceBounds, allBounds);
+
+	// The structure holds the same surfaces only if none of them gained,
+	// lost, or was clipped out of its bounds
+	if (unbounded != unboundedSurfaces || bounded != boundedSurfaces) {
+		return nullptr;
+	}
+
+	std::shared_ptr<Accelerator> refitted = clone();
+	refitted->surfaces = surfaces;
+	refitted->bounds = allBounds;
+	refitted->refitStructure(surfaceBounds, threadPool);
+
+	refitted->buildSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+	refitted->refitCount = refitCount + 1;
+
+	return refitted;
+
+} // end refit
+
+
+size_t Accelerator::getMemoryBytes() const
+{
+	return sizeof(*this) + surfaces.capacity() * sizeof(std::shared_ptr<Surface>) +
+		(unboundedSurfaces.capacity() + boundedSurfaces.capacity()) * sizeof(int);
+
+} // end getMemoryBytes
+
+
+bool Accelerator::getBoundingBox(AABB & box) const
+{
+	if (unboundedSurfaces.empty() == false) {
+		return false;
+	}
+
+	box = bounds;
+
+	return true;
+
+} // end getBoundingBox
+
+
+void Accelerator::classifySurfaces(const SurfaceVector & surfaces, std::vector<int> & unbounded,
+	std::vector<int> & bounded, std::vector<AABB> & bounds, AABB & allBounds)
+{
+	unbounded.clear();
+	bounded.clear();
+	bounds.assign(surfaces.size(), AABB());
+	allBounds = AABB();
+
+	for (int i = 0; i < (int)surfaces.size(); i++) {
+
+		AABB box;
+
+		if (surfaces[i]->getBoundingBox(box) == false) {
+			unbounded.push_back(i);
+			continue;
+		}
+
+		// No ray can hit a surface that is clipped away entirely
+		if (box.isEmpty()) {
+			continue;
+		}
+
+		// Pad the box so that hits that round to just outside it, such as
+		// those on a polygon with no thickness, are not culled
+		box.minimum -= dvec3(EPSILON);
+		box.maximum += dvec3(EPSILON);
+
+		bounded.push_back(i);
+		bounds[i] = box;
+		allBounds.expand(box);
+	}
+
+} // end classifySurfaces
+
+
+HitRecord Accelerator::findClosestIntersection(const Ray & ray) const
+{
+	HitRecord closestHit;
+	int closestSurface = (int)surfaces.size();
+
+	for (int surface : unboundedSurfaces) {
+		testSurface(ray, surface, closestHit, closestSurface);
+	}
+
+	traverse(ray, closestHit, closestSurface);
+
+	return closestHit;
+
+} // end findClosestIntersection
+
+
+void Accelerator::findClosestIntersections(const RayPacket & packet, HitRecord hits[]) const
+{
+	int closestSurfaces[RayPacket::MAX_SIZE];
+
+	for (int lane = 0; lane < packet.size; lane++) {
+		hits[lane] = HitRecord();
+		closestSurfaces[lane] = (int)surfaces.size();
+	}
+
+	for (int surface : unboundedSurfaces) {
+		testSurfacePacket(packet, packet.getMask(), surface, hits, closestSurfaces);
+	}
+
+	traversePacket(packet, hits, closestSurfaces);
+
+} // end findClosestIntersections
+
+
+int Accelerator::findOccluder(const Ray & ray, double maxDistance) const
+{
+	for (int surface : unboundedSurfaces) {
+		if (surfaces[surface]->isOccluding(ray, maxDistance)) {
+			return surface;
+		}
+	}
+
+	return traverseOccluded(ray, maxDistance);
+
+} // end findOccluder
+
+
+bool Accelerator::isOccludedBy(const Ray & ray, int surface, double maxDistance) const
+{
+	if (surface < 0 || surface >= (int)surfaces.size()) {
+		return false;
+	}
+
+	return surfaces[surface]->isOccluding(ray, maxDistance);
+
+} // end isOccludedBy
+
+
+void Accelerator::testSurface(const Ray & ray, int surface, HitRecord & closestHit, int & closestSurface) const
+{
+	HitRecord hit = surfaces[surface]->findClosestIntersection(ray);
+
+	if (hit.t < closestHit.t || (hit.t == closestHit.t && hit.t < FLT_MAX && surface < closestSurface)) {
+		closestHit = hit;
+		closestSurface = surface;
+	}
+
+} // end testSurface
+
+
+void Accelerator::testSurfacePacket(const RayPacket & packet, int mask, int surface, HitRecord hits[],
+	int closestSurfaces[]) const
+{
+	double distances[RayPacket::MAX_SIZE];
+	surfaces[surface]->findDistances(packet, mask, distances);
+
+	for (int lane = 0; lane < packet.size; lane++) {
+
+		// A distance is never larger than the t of the hit, so a ray whose
+		// distance testSurface would reject can skip the test
+		double t = hits[lane].t;
+
+		if ((mask & (1 << lane)) && (distances[lane] < t ||
+			(distances[lane] == t && t < FLT_MAX && surface < closestSurfaces[lane]))) {
+
+			testSurface(packet.getRay(lane), surface, hits[lane], closestSurfaces[lane]);
+		}
+	}
+
+} // end testSurfacePacket
+
+
+void Accelerator::traversePacket(const RayPacket & packet, HitRecord hits[], int closestSurfaces[]) const
+{
+	for (int lane = 0; lane < packet.size; lane++) {
+		traverse(packet.getRay(lane), hits[lane], closestSurfaces[lane]);
+	}
+
+} // end traversePacket
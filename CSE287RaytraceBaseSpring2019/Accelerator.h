@@ -0,0 +1,294 @@
+#pragma once
+
+#include "Surface.h"
+#include "RayPacket.h"
+#include "ThreadPool.h"
+
+#include <string>
+
+/**
+* Kinds of Accelerator that a scene can be built with.
+*/
+enum class AcceleratorType
+{
+	LINEAR, // Tests every surface. Kept to validate the others.
+	BVH, // Bounding volume hierarchy built with a full sweep of the surface area heuristic
+	BINNED_BVH, // Bounding volume hierarchy built in parallel with a binned surface area heuristic
+	MORTON_BVH, // Bounding volume hierarchy built in parallel from surfaces sorted by Morton code
+	SPLIT_BVH, // Bounding volume hierarchy that may split surfaces between nodes
+	WIDE4_BVH, // Bounding volume hierarchy collapsed to four children per node
+	WIDE8_BVH, // Bounding volume hierarchy collapsed to eight children per node
+	QUANTIZED_BVH, // Eight children per node with boxes quantized to 8 bits
+	GRID, // Uniform grid walked cell by cell
+	TWO_LEVEL_GRID // Uniform grid whose crowded cells hold grids of their own
+};
+
+/**
+* Structure built over the surfaces of a scene that finds the closest
+* intersection of a ray without necessarily testing every surface.
+*
+* Whatever the structure, the result is the one a test of every surface
+* in list order gives: of several surfaces hit at the same distance, the
+* one that comes first in the surface list is returned. Images therefore
+* do not depend on the accelerator that rendered them.
+*
+* An accelerator is not changed once built, so any number of threads can
+* trace rays through it at the same time. When surfaces move, refit gives
+* a copy whose boxes follow them instead of building a new structure.
+*/
+class Accelerator
+{
+public:
+
+	virtual ~Accelerator() {}
+
+	/**
+	* Creates an accelerator of a given kind that has not been built.
+	*/
+	static std::shared_ptr<Accelerator> create(AcceleratorType type);
+
+	/**
+	* Builds the structure over a list of surfaces. The surfaces are shared,
+	* not copied, and must not change while the accelerator is in use.
+	* Surfaces without bounds are kept in a separate list that every ray is
+	* tested against, outside of the structure.
+	* @param surfaces - surfaces of the scene
+	* @param threadPool - pool that runs the parallel parts of the build, or
+	* nullptr to build on the calling thread
+	*/
+	void build(const SurfaceVector & surfaces, ThreadPool * threadPool = nullptr);
+
+	/**
+	* Creates a copy of the accelerator over a list of surfaces that differs
+	* from the one it was built over only by where the surfaces are. The copy
+	* keeps the structure and updates its boxes from the leaves up, which is
+	* much faster than a build but gives a worse structure the farther the
+	* surfaces move. Check needsRebuild on the copy.
+	* @param surfaces - surfaces of the scene after they moved
+	* @param threadPool - pool that runs the parallel parts of the refit, or
+	* nullptr to refit on the calling thread
+	* @returns the copy, or nullptr if the number of surfaces changed, a
+	* surface gained or lost its bounds, or the structure cannot be refit
+	*/
+	std::shared_ptr<Accelerator> refit(const SurfaceVector & surfaces, ThreadPool * threadPool = nullptr) const;
+
+	/**
+	* Returns true if refits have raised the cost predicted by the surface
+	* area heuristic far enough above the cost right after the last build
+	* that a new build would pay for itself.
+	*/
+	bool needsRebuild() const { return getCost() > REBUILD_COST_RATIO * builtCost; }
+
+	/**
+	* Finds the closest intersection of a ray with the surfaces. Returns a
+	* HitRecord with the t parmeter set to FLT_MAX if there is no intersection.
+	* @param ray - ray to check for intersection
+	*/
+	HitRecord findClosestIntersection(const Ray & ray) const;
+
+	/**
+	* Finds the closest intersection of every ray of a packet. Each result
+	* is the one findClosestIntersection gives for the ray on its own.
+	* @param packet - rays to check for intersection
+	* @param hits - set to the closest hit of each ray of the packet
+	*/
+	void findClosestIntersections(const RayPacket & packet, HitRecord hits[]) const;
+
+	/**
+	* Checks whether a ray intersects any surface closer than a given
+	* distance. Stops at the first such surface it finds rather than looking
+	* for the closest, and builds no HitRecord, which makes it the query for
+	* shadow rays.
+	* @param ray - ray to check for intersection
+	* @param maxDistance - intersections at or beyond this distance are ignored
+	*/
+	bool isOccluded(const Ray & ray, double maxDistance) const { return findOccluder(ray, maxDistance) >= 0; }
+
+	/**
+	* Finds a surface that a ray intersects closer than a given distance, as
+	* isOccluded does.
+	* @returns position of the surface in the surface list, or -1 if there is
+	* none
+	*/
+	int findOccluder(const Ray & ray, double maxDistance) const;
+
+	/**
+	* Checks whether a ray intersects one surface closer than a given
+	* distance.
+	* @param surface - position of the surface in the surface list
+	* @returns false if there is no surface at that position
+	*/
+	bool isOccludedBy(const Ray & ray, int surface, double maxDistance) const;
+
+	/**
+	* Returns the kind of the accelerator.
+	*/
+	virtual AcceleratorType getType() const = 0;
+
+	/**
+	* Returns the name of the kind of the accelerator.
+	*/
+	virtual const char * getName() const = 0;
+
+	/**
+	* Returns the cost of tracing a ray that the surface area heuristic
+	* predicts, in units of surface intersection tests. Lower is better.
+	* Used to compare the structures that different builders produce.
+	*/
+	virtual double getCost() const = 0;
+
+	/**
+	* Returns the number of bytes of memory that the accelerator takes, not
+	* counting the surfaces it was built over.
+	*/
+	virtual size_t getMemoryBytes() const;
+
+	/**
+	* Returns a line of statistics about the structure and the rays traced
+	* through it, or an empty string if it keeps none.
+	*/
+	virtual std::string getStatistics() const { return std::string(); }
+
+	/**
+	* Returns the time in seconds that the last build or refit took.
+	*/
+	double getBuildSeconds() const { return buildSeconds; }
+
+	/**
+	* Returns the number of refits since the structure was last built.
+	*/
+	int getRefitCount() const { return refitCount; }
+
+	/**
+	* Finds a box that contains every surface the accelerator was built over.
+	* @param box - set to the box
+	* @returns false if a surface has no bounds, in which case box is unchanged
+	*/
+	bool getBoundingBox(AABB & box) const;
+
+	/**
+	* Returns the number of surfaces that are tested outside the structure
+	* because they have no bounds.
+	*/
+	int getUnboundedCount() const { return (int)unboundedSurfaces.size(); }
+
+protected:
+
+	/**
+	* Bounded surface along with its box while the structure is built.
+	*/
+	struct Primitive
+	{
+		AABB bounds;
+		dvec3 center;
+		int surface;
+	};
+
+	/**
+	* Builds the structure over the bounded surfaces.
+	* @param primitives - bounded surfaces in list order. May be reordered.
+	* @param threadPool - pool for the parallel parts of the build or nullptr
+	*/
+	virtual void buildStructure(std::vector<Primitive> & primitives, ThreadPool * threadPool) = 0;
+
+	/**
+	* Updates the boxes of the structure to new boxes of the surfaces.
+	* @param bounds - padded box of each surface, indexed like surfaces.
+	* Empty for the surfaces that are not in the structure.
+	* @param threadPool - pool for the parallel parts of the refit or nullptr
+	*/
+	virtual void refitStructure(const std::vector<AABB> & bounds, ThreadPool * threadPool) = 0;
+
+	/**
+	* Returns false if the structure stores boxes that cannot be recomputed
+	* from the boxes of the surfaces, in which case refit gives nullptr and
+	* the structure has to be built again.
+	*/
+	virtual bool canRefit() const { return true; }
+
+	/**
+	* Returns a copy of the accelerator.
+	*/
+	virtual std::shared_ptr<Accelerator> clone() const = 0;
+
+	/**
+	* Tests a ray against the surfaces in the structure.
+	* @param ray - ray to check for intersection
+	* @param closestHit - closest hit found so far. Updated by testSurface.
+	* @param closestSurface - index of the surface of closestHit
+	*/
+	virtual void traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const = 0;
+
+	/**
+	* Finds a surface in the structure that a ray intersects closer than
+	* maxDistance. May visit the surfaces in any order.
+	* @returns index in surfaces of the surface, or -1 if there is none
+	*/
+	virtual int traverseOccluded(const Ray & ray, double maxDistance) const = 0;
+
+	/**
+	* Tests the rays of a packet against the surfaces in the structure. This
+	* one calls traverse for each ray. Structures that can test a node
+	* against every ray of the packet at once override it.
+	* @param hits - closest hit of each ray so far. Updated by testSurfacePacket.
+	* @param closestSurfaces - index of the surface of each hit
+	*/
+	virtual void traversePacket(const RayPacket & packet, HitRecord hits[], int closestSurfaces[]) const;
+
+	/**
+	* Sorts the surfaces into those that have no bounds, those in the
+	* structure, and those that no ray can hit, and finds the padded boxes of
+	* those in the structure.
+	* @param bounds - set to the box of each surface. Empty for the surfaces
+	* that are not in the structure.
+	* @param allBounds - set to the box that contains every box in bounds
+	*/
+	static void classifySurfaces(const SurfaceVector & surfaces, std::vector<int> & unbounded,
+		std::vector<int> & bounded, std::vector<AABB> & bounds, AABB & allBounds);
+
+	/**
+	* Tests a ray against a surface and keeps the hit if it is closer than
+	* the closest one so far or is as close and comes earlier in the list.
+	*/
+	void testSurface(const Ray & ray, int surface, HitRecord & closestHit, int & closestSurface) const;
+
+	/**
+	* Tests the rays of a packet that a mask enables against a surface, as
+	* testSurface does for each. The packet kernel of the surface finds the
+	* distances first, so HitRecords are only built for the rays the surface
+	* may bring closer.
+	*/
+	void testSurfacePacket(const RayPacket & packet, int mask, int surface, HitRecord hits[],
+		int closestSurfaces[]) const;
+
+	// Surfaces of the scene
+	SurfaceVector surfaces;
+
+	// Indices in surfaces of the surfaces without bounds
+	std::vector<int> unboundedSurfaces;
+
+	// Indices in surfaces of the surfaces in the structure, in list order
+	std::vector<int> boundedSurfaces;
+
+	// Box that contains the surfaces in the structure
+	AABB bounds;
+
+	// Time in seconds that the last build or refit took
+	double buildSeconds = 0.0;
+
+	// Cost predicted by the surface area heuristic right after the last build
+	double builtCost = 0.0;
+
+	// Number of refits since the last build
+	int refitCount = 0;
+
+	// Ratio of the cost after refits to the cost after the last build above
+	// which the structure is built again
+	static const double REBUILD_COST_RATIO;
+
+	// Cost of testing a ray against the boxes of a node and against a
+	// surface in the surface area heuristic
+	static const double TRAVERSAL_COST;
+	static const double INTERSECTION_COST;
+
+}; // end Accelerator class
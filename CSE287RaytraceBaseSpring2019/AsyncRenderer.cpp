@@ -0,0 +1,128 @@
+#include "AsyncRenderer.h"
+
+#include <chrono>
+
+
+AsyncRenderer::AsyncRenderer(std::function<bool(const CancellationToken &)> renderFrame)
+	: renderFrame(renderFrame), rendering(false), continuous(false), completedFrames(0), lastFrameSeconds(0.0)
+{
+	// Start the thread last so that it never sees partially initialized members
+	renderThread = std::thread(&AsyncRenderer::renderLoop, this);
+
+} // end AsyncRenderer constructor
+
+
+AsyncRenderer::~AsyncRenderer()
+{
+	cancel();
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	frameRequestedCondition.notify_one();
+
+	renderThread.join();
+
+} // end AsyncRenderer destructor
+
+
+void AsyncRenderer::requestFrame()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	// Abandon the frame in flight. The new request replaces it.
+	cancelToken.cancel();
+	idleCondition.wait(lock, [this] { return rendering == false; });
+
+	cancelToken.reset();
+	frameRequested = true;
+
+	frameRequestedCondition.notify_one();
+
+} // end requestFrame
+
+
+void AsyncRenderer::queueFrame()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	// The token is only cancelled by callers that wait for the render
+	// thread to go idle, so it can only need a reset when no frame is running
+	if (rendering == false) {
+		cancelToken.reset();
+	}
+	frameRequested = true;
+
+	frameRequestedCondition.notify_one();
+
+} // end queueFrame
+
+
+void AsyncRenderer::setContinuous(bool continuous)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	this->continuous = continuous;
+
+	// Start the first frame right away if the render thread is idle
+	if (continuous && rendering == false) {
+		cancelToken.reset();
+		frameRequested = true;
+		frameRequestedCondition.notify_one();
+	}
+
+} // end setContinuous
+
+
+void AsyncRenderer::cancel()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	frameRequested = false;
+	cancelToken.cancel();
+	idleCondition.wait(lock, [this] { return rendering == false; });
+
+} // end cancel
+
+
+void AsyncRenderer::renderLoop()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+
+	while (true) {
+
+		frameRequestedCondition.wait(lock, [this] { return frameRequested || stopping; });
+
+		if (stopping) {
+			break;
+		}
+
+		frameRequested = false;
+		rendering = true;
+
+		// Render without holding the lock so that requests can cancel the frame
+		lock.unlock();
+
+		auto startTime = std::chrono::steady_clock::now();
+		bool completed = renderFrame(cancelToken);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+		lock.lock();
+
+		if (completed) {
+			lastFrameSeconds = seconds;
+			completedFrames++;
+
+			// The finished frame has been handed off, so the next one can
+			// start while it is being displayed.
+			if (continuous) {
+				frameRequested = true;
+			}
+		}
+
+		rendering = false;
+		idleCondition.notify_all();
+	}
+
+} // end renderLoop
@@ -0,0 +1,120 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+/**
+* Runs frames on a background thread so that the thread that owns the window
+* never blocks for a whole frame. A frame in flight can be cancelled, in which
+* case the frame function is expected to stop at its next checkpoint (for the
+* ray tracer, the next tile).
+*
+* The owner of the window calls cancel before changing anything a frame
+* reads and requestFrame once the changes are complete. A request made with
+* requestFrame replaces the frame in flight, while one made with queueFrame
+* runs once the frame in flight is done.
+*/
+class AsyncRenderer
+{
+public:
+
+	/**
+	* Constructor. Starts the render thread, which waits for the first request.
+	* @param renderFrame - function that renders one frame. It must check the
+	* token it is given and return false if it stopped early.
+	*/
+	AsyncRenderer(std::function<bool(const CancellationToken &)> renderFrame);
+
+	/**
+	* Cancels any frame in flight and joins the render thread.
+	*/
+	~AsyncRenderer();
+
+	/**
+	* Asks the render thread to start a new frame. Any frame in flight is
+	* cancelled first.
+	*/
+	void requestFrame();
+
+	/**
+	* Asks the render thread to render one more frame without cancelling the
+	* frame in flight. For changes that the frame in flight does not read.
+	*/
+	void queueFrame();
+
+	/**
+	* Cancels the frame in flight and any pending request. Blocks until the
+	* render thread is idle so that the caller can safely change the scene.
+	*/
+	void cancel();
+
+	/**
+	* In continuous mode the render thread starts the next frame as soon as
+	* a frame completes rather than waiting for a request.
+	* @param continuous - true to render frames back to back
+	*/
+	void setContinuous(bool continuous);
+
+	/**
+	* Returns true if frames are rendered back to back.
+	*/
+	bool isContinuous() const { return continuous; }
+
+	/**
+	* Returns true while the render thread is working on a frame.
+	*/
+	bool isRendering() const { return rendering; }
+
+	/**
+	* Returns the number of frames that have run to completion.
+	*/
+	unsigned int getCompletedFrames() const { return completedFrames; }
+
+	/**
+	* Returns the time in seconds that the most recent completed frame took.
+	*/
+	double getLastFrameSeconds() const { return lastFrameSeconds; }
+
+protected:
+
+	/**
+	* Main loop of the render thread.
+	*/
+	void renderLoop();
+
+	// Renders one frame
+	std::function<bool(const CancellationToken &)> renderFrame;
+
+	// Cancels the frame in flight
+	CancellationToken cancelToken;
+
+	// Guards the request state below
+	std::mutex mutex;
+
+	// Signaled when a frame is requested or the renderer shuts down
+	std::condition_variable frameRequestedCondition;
+
+	// Signaled when the render thread finishes or abandons a frame
+	std::condition_variable idleCondition;
+
+	// True when a frame has been requested but not started
+	bool frameRequested = false;
+
+	// True to stop the render thread
+	bool stopping = false;
+
+	// True while a frame is being rendered
+	std::atomic<bool> rendering;
+
+	// True to start the next frame as soon as a frame completes
+	std::atomic<bool> continuous;
+
+	// Number of frames that have run to completion
+	std::atomic<unsigned int> completedFrames;
+
+	// Duration of the most recent completed frame in seconds
+	std::atomic<double> lastFrameSeconds;
+
+	// Thread on which frames are rendered
+	std::thread renderThread;
+
+}; // end AsyncRenderer class
@@ -0,0 +1,1225 @@
+#include "BoundingVolumeHierarchy.h"
+
+#include <algorithm>
+#include <sstream>
+
+// Ranges with fewer primitives or nodes are built, binned, sorted, or
+// refit on the calling thread rather than split into tasks
+static const int PARALLEL_SUBTREE_SIZE = 4096;
+static const int PARALLEL_CHUNK_SIZE = 16384;
+
+
+/**
+* Returns the number of chunks to divide a range of items into so that
+* each chunk is large enough to be worth a task.
+*/
+static int getChunkCount(ThreadPool * threadPool, int count)
+{
+	if (threadPool == nullptr) {
+		return 1;
+	}
+
+	int chunks = (count + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE;
+
+	return glm::clamp(chunks, 1, 4 * threadPool->getThreadCount());
+
+} // end getChunkCount
+
+
+/**
+* Divides a range of items into chunks and calls a function for each.
+* Runs the calls on the thread pool if there is more than one chunk.
+* @param body - called with the index of the chunk and its range
+*/
+static void forEachChunk(ThreadPool * threadPool, int chunkCount, int count,
+	const std::function<void(int chunk, int begin, int end)> & body)
+{
+	if (chunkCount <= 1) {
+		body(0, 0, count);
+		return;
+	}
+
+	TaskGroup chunks;
+
+	for (int chunk = 0; chunk < chunkCount; chunk++) {
+
+		int begin = (int)((long long)count * chunk / chunkCount);
+		int end = (int)((long long)count * (chunk + 1) / chunkCount);
+
+		threadPool->submit([&body, chunk, begin, end] { body(chunk, begin, end); }, chunks);
+	}
+
+	threadPool->wait(chunks);
+
+} // end forEachChunk
+
+
+/**
+* Spreads the lowest 10 bits of a value out so that two zero bits follow
+* each of them.
+*/
+static uint32_t spreadBits(uint32_t value)
+{
+	value &= 0x3FF;
+	value = (value | (value << 16)) & 0x030000FF;
+	value = (value | (value << 8)) & 0x0300F00F;
+	value = (value | (value << 4)) & 0x030C30C3;
+	value = (value | (value << 2)) & 0x09249249;
+
+	return value;
+
+} // end spreadBits
+
+
+/**
+* Returns the number of zero bits above the highest one bit of a value.
+*/
+static int countLeadingZeros(uint32_t value)
+{
+	int zeros = 0;
+
+	for (uint32_t bit = 0x80000000u; bit != 0 && (value & bit) == 0; bit >>= 1) {
+		zeros++;
+	}
+
+	return zeros;
+
+} // end countLeadingZeros
+
+
+BoundingVolumeHierarchy::BoundingVolumeHierarchy(BuildMethod buildMethod)
+	: buildMethod(buildMethod)
+{
+
+} // end BoundingVolumeHierarchy constructor
+
+
+AcceleratorType BoundingVolumeHierarchy::getType() const
+{
+	switch (buildMethod) {
+	case BuildMethod::BINNED_SAH:
+		return AcceleratorType::BINNED_BVH;
+	case BuildMethod::MORTON:
+		return AcceleratorType::MORTON_BVH;
+	case BuildMethod::SPATIAL_SPLITS:
+		return AcceleratorType::SPLIT_BVH;
+	default:
+		return AcceleratorType::BVH;
+	}
+
+} // end getType
+
+
+const char * BoundingVolumeHierarchy::getName() const
+{
+	switch (buildMethod) {
+	case BuildMethod::BINNED_SAH:
+		return "binned SAH BVH";
+	case BuildMethod::MORTON:
+		return "Morton code BVH";
+	case BuildMethod::SPATIAL_SPLITS:
+		return "spatial split BVH";
+	default:
+		return "sweep SAH BVH";
+	}
+
+} // end getName
+
+
+double BoundingVolumeHierarchy::getCost() const
+{
+	double cost = INTERSECTION_COST * unboundedSurfaces.size();
+
+	if (nodes.empty() || nodes[0].bounds.getSurfaceArea() <= 0.0) {
+		return cost + INTERSECTION_COST * surfaceOrder.size();
+	}
+
+	// Probability that a ray that hits the root also hits a node is the
+	// ratio of their surface areas
+	double rootArea = nodes[0].bounds.getSurfaceArea();
+
+	for (const Node & node : nodes) {
+
+		double probability = node.bounds.getSurfaceArea() / rootArea;
+
+		if (node.count > 0) {
+			cost += INTERSECTION_COST * node.count * probability;
+		}
+		else {
+			cost += TRAVERSAL_COST * probability;
+		}
+	}
+
+	return cost;
+
+} // end getCost
+
+
+size_t BoundingVolumeHierarchy::getMemoryBytes() const
+{
+	return Accelerator::getMemoryBytes() + nodes.capacity() * sizeof(Node) +
+		surfaceOrder.capacity() * sizeof(int);
+
+} // end getMemoryBytes
+
+
+std::string BoundingVolumeHierarchy::getStatistics() const
+{
+	if (nodes.empty()) {
+		return std::string();
+	}
+
+	double rootArea = nodes[0].bounds.getSurfaceArea();
+	double overlapArea = 0.0;
+
+	for (int index = 0; index < (int)nodes.size(); index++) {
+
+		if (nodes[index].count == 0) {
+
+			const AABB & first = nodes[index + 1].bounds;
+			const AABB & second = nodes[nodes[index].first].bounds;
+
+			overlapArea += AABB(glm::max(first.minimum, second.minimum),
+				glm::min(first.maximum, second.maximum)).getSurfaceArea();
+		}
+	}
+
+	std::ostringstream statistics;
+	statistics << nodes.size() << " nodes, " << surfaceOrder.size() << " references to "
+		<< boundedSurfaces.size() << " surfaces, sibling overlap " << ((rootArea > 0.0) ? overlapArea / rootArea : 0.0);
+
+	return statistics.str();
+
+} // end getStatistics
+
+
+void BoundingVolumeHierarchy::buildStructure(std::vector<Primitive> & primitives, ThreadPool * threadPool)
+{
+	surfaceOrder.clear();
+	nodes.clear();
+
+	if (primitives.empty()) {
+		return;
+	}
+
+	nodes.reserve(2 * primitives.size());
+
+	if (buildMethod == BuildMethod::SWEEP_SAH) {
+		buildNode(primitives, 0, (int)primitives.size(), 0);
+	}
+	else if (buildMethod == BuildMethod::SPATIAL_SPLITS) {
+
+		// The leaves list their references as they are built
+		remainingSplits = (int)(glm::max(splitBudget, 0.0) * primitives.size());
+		buildSplitNode(primitives, 0, bounds.getSurfaceArea());
+
+		nodes.shrink_to_fit();
+		surfaceOrder.shrink_to_fit();
+		return;
+	}
+	else {
+
+		BuildNode root;
+		root.begin = 0;
+		root.end = (int)primitives.size();
+
+		if (buildMethod == BuildMethod::BINNED_SAH) {
+			buildBinned(primitives, root, 0, threadPool);
+		}
+		else {
+			std::vector<uint32_t> codes;
+			sortByMortonCode(primitives, codes, threadPool);
+			buildMorton(codes, root, 0, threadPool);
+		}
+
+		flatten(primitives, root);
+	}
+
+	nodes.shrink_to_fit();
+
+	for (const Primitive & primitive : primitives) {
+		surfaceOrder.push_back(primitive.surface);
+	}
+
+} // end buildStructure
+
+
+int BoundingVolumeHierarchy::buildNode(std::vector<Primitive> & primitives, int begin, int end, int depth)
+{
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(Node());
+
+	AABB bounds;
+	AABB centers;
+
+	for (int i = begin; i < end; i++) {
+		bounds.expand(primitives[i].bounds);
+		centers.expand(primitives[i].center);
+	}
+
+	int count = end - begin;
+	double area = bounds.getSurfaceArea();
+
+	// Find the cheapest split by sweeping over the primitives sorted along
+	// each axis
+	double bestCost = count * INTERSECTION_COST;
+	int bestAxis = -1;
+	int bestSplit = 0;
+
+	std::vector<double> rightAreas(count);
+
+	for (int axis = 0; axis < 3 && count > 1 && area > 0.0 && depth < MAX_DEPTH - 1; axis++) {
+
+		if (centers.minimum[axis] == centers.maximum[axis]) {
+			continue;
+		}
+
+		// Ties are broken by surface so the tree does not depend on the
+		// sort implementation
+		std::sort(primitives.begin() + begin, primitives.begin() + end,
+			[axis](const Primitive & a, const Primitive & b) {
+			return a.center[axis] < b.center[axis] ||
+				(a.center[axis] == b.center[axis] && a.surface < b.surface); });
+
+		AABB right;
+		for (int i = count - 1; i > 0; i--) {
+			right.expand(primitives[begin + i].bounds);
+			rightAreas[i] = right.getSurfaceArea();
+		}
+
+		AABB left;
+		for (int i = 1; i < count; i++) {
+
+			left.expand(primitives[begin + i - 1].bounds);
+
+			double cost = TRAVERSAL_COST + INTERSECTION_COST *
+				(left.getSurfaceArea() * i + rightAreas[i] * (count - i)) / area;
+
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	// Make a leaf if no split is cheaper, unless the leaf would be too big
+	// and the primitives can be told apart
+	if (bestAxis < 0 && count > maxLeafSize && depth < MAX_DEPTH - 1) {
+
+		bestAxis = centers.getLongestAxis();
+		bestSplit = count / 2;
+
+		if (centers.minimum[bestAxis] == centers.maximum[bestAxis]) {
+			bestAxis = -1;
+		}
+	}
+
+	if (bestAxis < 0) {
+		nodes[nodeIndex].bounds = bounds;
+		nodes[nodeIndex].first = begin;
+		nodes[nodeIndex].count = count;
+		return nodeIndex;
+	}
+
+	std::sort(primitives.begin() + begin, primitives.begin() + end,
+		[bestAxis](const Primitive & a, const Primitive & b) {
+		return a.center[bestAxis] < b.center[bestAxis] ||
+			(a.center[bestAxis] == b.center[bestAxis] && a.surface < b.surface); });
+
+	buildNode(primitives, begin, begin + bestSplit, depth + 1);
+	int secondChild = buildNode(primitives, begin + bestSplit, end, depth + 1);
+
+	nodes[nodeIndex].bounds = bounds;
+	nodes[nodeIndex].first = secondChild;
+	nodes[nodeIndex].count = 0;
+
+	return nodeIndex;
+
+} // end buildNode
+
+
+int BoundingVolumeHierarchy::buildSplitNode(std::vector<Primitive> & references, int depth, double rootArea)
+{
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(Node());
+
+	AABB bounds;
+	AABB centers;
+
+	for (const Primitive & reference : references) {
+		bounds.expand(reference.bounds);
+		centers.expand(reference.center);
+	}
+
+	int count = (int)references.size();
+	double area = bounds.getSurfaceArea();
+	bool splittable = count > 1 && area > 0.0 && depth < MAX_DEPTH - 1;
+
+	// Find the cheapest object split as the sweep builder does. A node holds
+	// at most one reference to a surface, so ties are still broken by surface.
+	double bestCost = count * INTERSECTION_COST;
+	int bestAxis = -1;
+	int bestSplit = 0;
+
+	std::vector<double> rightAreas(count);
+
+	auto sortByCenter = [&references](int axis) {
+		std::sort(references.begin(), references.end(),
+			[axis](const Primitive & a, const Primitive & b) {
+			return a.center[axis] < b.center[axis] ||
+				(a.center[axis] == b.center[axis] && a.surface < b.surface); });
+	};
+
+	for (int axis = 0; axis < 3 && splittable; axis++) {
+
+		if (centers.minimum[axis] == centers.maximum[axis]) {
+			continue;
+		}
+
+		sortByCenter(axis);
+
+		AABB right;
+		for (int i = count - 1; i > 0; i--) {
+			right.expand(references[i].bounds);
+			rightAreas[i] = right.getSurfaceArea();
+		}
+
+		AABB left;
+		for (int i = 1; i < count; i++) {
+
+			left.expand(references[i - 1].bounds);
+
+			double cost = TRAVERSAL_COST + INTERSECTION_COST *
+				(left.getSurfaceArea() * i + rightAreas[i] * (count - i)) / area;
+
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = i;
+			}
+		}
+	}
+
+	// Splitting space only pays off where the children of the object split
+	// overlap
+	bool trySpatial = splittable && remainingSplits > 0;
+
+	if (trySpatial && bestAxis >= 0) {
+
+		sortByCenter(bestAxis);
+
+		AABB left;
+		AABB right;
+
+		for (int i = 0; i < count; i++) {
+			(i < bestSplit ? left : right).expand(references[i].bounds);
+		}
+
+		AABB overlap(glm::max(left.minimum, right.minimum), glm::min(left.maximum, right.maximum));
+		trySpatial = overlap.getSurfaceArea() > splitOverlapThreshold * rootArea;
+	}
+
+	int spatialAxis = -1;
+	double spatialPosition = 0.0;
+
+	if (trySpatial && findSpatialSplit(references, bounds, bestCost, spatialAxis, spatialPosition)) {
+
+		std::vector<Primitive> left;
+		std::vector<Primitive> right;
+		Primitive piece;
+
+		for (const Primitive & reference : references) {
+
+			if (reference.bounds.maximum[spatialAxis] <= spatialPosition) {
+				left.push_back(reference);
+			}
+			else if (reference.bounds.minimum[spatialAxis] >= spatialPosition) {
+				right.push_back(reference);
+			}
+			else {
+
+				// Crosses the plane. Each side gets the part of the surface
+				// on it, if there is one.
+				if (clipReference(reference, spatialAxis, reference.bounds.minimum[spatialAxis], spatialPosition, piece)) {
+					left.push_back(piece);
+				}
+				if (clipReference(reference, spatialAxis, spatialPosition, reference.bounds.maximum[spatialAxis], piece)) {
+					right.push_back(piece);
+				}
+			}
+		}
+
+		if (left.empty() == false && right.empty() == false) {
+
+			remainingSplits -= (int)(left.size() + right.size()) - count;
+
+			// Free the references of the node before building below it
+			std::vector<Primitive>().swap(references);
+
+			buildSplitNode(left, depth + 1, rootArea);
+			int secondChild = buildSplitNode(right, depth + 1, rootArea);
+
+			nodes[nodeIndex].bounds = bounds;
+			nodes[nodeIndex].first = secondChild;
+			nodes[nodeIndex].count = 0;
+
+			return nodeIndex;
+		}
+	}
+
+	// Make a leaf if no split is cheaper, unless the leaf would be too big
+	// and the references can be told apart
+	if (bestAxis < 0 && count > maxLeafSize && depth < MAX_DEPTH - 1) {
+
+		bestAxis = centers.getLongestAxis();
+		bestSplit = count / 2;
+
+		if (centers.minimum[bestAxis] == centers.maximum[bestAxis]) {
+			bestAxis = -1;
+		}
+	}
+
+	if (bestAxis < 0) {
+
+		nodes[nodeIndex].bounds = bounds;
+		nodes[nodeIndex].first = (int)surfaceOrder.size();
+		nodes[nodeIndex].count = count;
+
+		for (const Primitive & reference : references) {
+			surfaceOrder.push_back(reference.surface);
+		}
+		return nodeIndex;
+	}
+
+	sortByCenter(bestAxis);
+
+	std::vector<Primitive> left(references.begin(), references.begin() + bestSplit);
+	std::vector<Primitive> right(references.begin() + bestSplit, references.end());
+	std::vector<Primitive>().swap(references);
+
+	buildSplitNode(left, depth + 1, rootArea);
+	int secondChild = buildSplitNode(right, depth + 1, rootArea);
+
+	nodes[nodeIndex].bounds = bounds;
+	nodes[nodeIndex].first = secondChild;
+	nodes[nodeIndex].count = 0;
+
+	return nodeIndex;
+
+} // end buildSplitNode
+
+
+bool BoundingVolumeHierarchy::findSpatialSplit(const std::vector<Primitive> & references, const AABB & bounds,
+	double & cost, int & axis, double & position) const
+{
+	struct Bin
+	{
+		AABB bounds;
+		int entries = 0;
+		int exits = 0;
+	};
+
+	int count = (int)references.size();
+	double area = bounds.getSurfaceArea();
+	int bins = glm::max(binCount, 2);
+	bool found = false;
+
+	std::vector<Bin> binList(bins);
+	std::vector<AABB> rightBounds(bins);
+	std::vector<int> rightCounts(bins);
+	Primitive piece;
+
+	for (int splitAxis = 0; splitAxis < 3; splitAxis++) {
+
+		double low = bounds.minimum[splitAxis];
+		double width = (bounds.maximum[splitAxis] - low) / bins;
+
+		if (width <= 0.0) {
+			continue;
+		}
+
+		std::fill(binList.begin(), binList.end(), Bin());
+
+		// Every reference enters the bin of its lowest point and exits the
+		// bin of its highest. Each bin in between grows by the part of the
+		// surface in it.
+		for (const Primitive & reference : references) {
+
+			int first = glm::clamp((int)((reference.bounds.minimum[splitAxis] - low) / width), 0, bins - 1);
+			int last = glm::clamp((int)((reference.bounds.maximum[splitAxis] - low) / width), first, bins - 1);
+
+			for (int bin = first; bin <= last; bin++) {
+
+				double binLow = (bin == first) ? reference.bounds.minimum[splitAxis] : low + bin * width;
+				double binHigh = (bin == last) ? reference.bounds.maximum[splitAxis] : low + (bin + 1) * width;
+
+				if (clipReference(reference, splitAxis, binLow, binHigh, piece)) {
+					binList[bin].bounds.expand(piece.bounds);
+				}
+			}
+
+			binList[first].entries++;
+			binList[last].exits++;
+		}
+
+		AABB right;
+		int rightCount = 0;
+
+		for (int bin = bins - 1; bin > 0; bin--) {
+			right.expand(binList[bin].bounds);
+			rightCount += binList[bin].exits;
+			rightBounds[bin] = right;
+			rightCounts[bin] = rightCount;
+		}
+
+		AABB left;
+		int leftCount = 0;
+
+		for (int bin = 1; bin < bins; bin++) {
+
+			left.expand(binList[bin - 1].bounds);
+			leftCount += binList[bin - 1].entries;
+
+			// References that cross the plane are counted on both sides
+			int added = leftCount + rightCounts[bin] - count;
+
+			if (added > remainingSplits || leftCount == 0 || rightCounts[bin] == 0) {
+				continue;
+			}
+
+			double splitCost = TRAVERSAL_COST + INTERSECTION_COST *
+				(left.getSurfaceArea() * leftCount + rightBounds[bin].getSurfaceArea() * rightCounts[bin]) / area;
+
+			if (splitCost < cost) {
+				cost = splitCost;
+				axis = splitAxis;
+				position = low + bin * width;
+				found = true;
+			}
+		}
+	}
+
+	return found;
+
+} // end findSpatialSplit
+
+
+bool BoundingVolumeHierarchy::clipReference(const Primitive & reference, int axis, double low, double high,
+	Primitive & piece) const
+{
+	AABB clip = reference.bounds;
+	clip.minimum[axis] = glm::max(clip.minimum[axis], low);
+	clip.maximum[axis] = glm::min(clip.maximum[axis], high);
+
+	AABB box;
+
+	if (clip.isEmpty() || surfaces[reference.surface]->getClippedBoundingBox(clip, box) == false) {
+		return false;
+	}
+
+	// Padded as classifySurfaces pads whole surfaces, but never beyond the
+	// box of the reference
+	box.minimum = glm::max(box.minimum - dvec3(EPSILON), reference.bounds.minimum);
+	box.maximum = glm::min(box.maximum + dvec3(EPSILON), reference.bounds.maximum);
+
+	piece.bounds = box;
+	piece.center = box.getCenter();
+	piece.surface = reference.surface;
+
+	return true;
+
+} // end clipReference
+
+
+void BoundingVolumeHierarchy::buildBinned(std::vector<Primitive> & primitives, BuildNode & node, int depth, ThreadPool * threadPool)
+{
+	int count = node.end - node.begin;
+
+	if (count <= 1 || depth >= MAX_DEPTH - 1) {
+		return;
+	}
+
+	struct Bin
+	{
+		AABB bounds;
+		int count = 0;
+	};
+
+	// Bounds of the node and of the centers of its primitives
+	int chunkCount = getChunkCount(threadPool, count);
+	std::vector<AABB> chunkBounds(chunkCount);
+	std::vector<AABB> chunkCenters(chunkCount);
+
+	forEachChunk(threadPool, chunkCount, count, [&](int chunk, int begin, int end) {
+		for (int i = node.begin + begin; i < node.begin + end; i++) {
+			chunkBounds[chunk].expand(primitives[i].bounds);
+			chunkCenters[chunk].expand(primitives[i].center);
+		}
+	});
+
+	AABB bounds;
+	AABB centers;
+
+	for (int chunk = 0; chunk < chunkCount; chunk++) {
+		bounds.expand(chunkBounds[chunk]);
+		centers.expand(chunkCenters[chunk]);
+	}
+
+	dvec3 extent = centers.maximum - centers.minimum;
+
+	auto getBin = [&](const Primitive & primitive, int axis) {
+		int bin = (int)(binCount * (primitive.center[axis] - centers.minimum[axis]) / extent[axis]);
+		return glm::clamp(bin, 0, binCount - 1);
+	};
+
+	// Sort the primitives into bins along every axis. Each chunk fills its
+	// own bins, which are merged afterwards.
+	std::vector<std::vector<Bin>> chunkBins(chunkCount, std::vector<Bin>(3 * binCount));
+
+	forEachChunk(threadPool, chunkCount, count, [&](int chunk, int begin, int end) {
+		for (int i = node.begin + begin; i < node.begin + end; i++) {
+			for (int axis = 0; axis < 3; axis++) {
+				if (extent[axis] > 0.0) {
+					Bin & bin = chunkBins[chunk][axis * binCount + getBin(primitives[i], axis)];
+					bin.bounds.expand(primitives[i].bounds);
+					bin.count++;
+				}
+			}
+		}
+	});
+
+	std::vector<Bin> bins(3 * binCount);
+
+	for (int chunk = 0; chunk < chunkCount; chunk++) {
+		for (int i = 0; i < 3 * binCount; i++) {
+			bins[i].bounds.expand(chunkBins[chunk][i].bounds);
+			bins[i].count += chunkBins[chunk][i].count;
+		}
+	}
+
+	// Evaluate the SAH at the boundaries between bins
+	double area = bounds.getSurfaceArea();
+	double bestCost = count * INTERSECTION_COST;
+	int bestAxis = -1;
+	int bestBin = 0;
+
+	std::vector<double> rightCosts(binCount);
+
+	for (int axis = 0; axis < 3 && area > 0.0; axis++) {
+
+		if (extent[axis] <= 0.0) {
+			continue;
+		}
+
+		const Bin * axisBins = &bins[axis * binCount];
+
+		AABB right;
+		int rightCount = 0;
+		for (int i = binCount - 1; i > 0; i--) {
+			right.expand(axisBins[i].bounds);
+			rightCount += axisBins[i].count;
+			rightCosts[i] = right.getSurfaceArea() * rightCount;
+		}
+
+		AABB left;
+		int leftCount = 0;
+		for (int i = 0; i < binCount - 1; i++) {
+
+			left.expand(axisBins[i].bounds);
+			leftCount += axisBins[i].count;
+
+			if (leftCount == 0 || leftCount == count) {
+				continue;
+			}
+
+			double cost = TRAVERSAL_COST + INTERSECTION_COST *
+				(left.getSurfaceArea() * leftCount + rightCosts[i + 1]) / area;
+
+			if (cost < bestCost) {
+				bestCost = cost;
+				bestAxis = axis;
+				bestBin = i;
+			}
+		}
+	}
+
+	int middle;
+
+	if (bestAxis >= 0) {
+		middle = (int)(std::partition(primitives.begin() + node.begin, primitives.begin() + node.end,
+			[&](const Primitive & primitive) { return getBin(primitive, bestAxis) <= bestBin; }) - primitives.begin());
+	}
+	else if (count > maxLeafSize && centers.isEmpty() == false && extent[centers.getLongestAxis()] > 0.0) {
+
+		// No split is cheaper but the leaf would be too big. Split at the
+		// median along the longest axis instead.
+		int axis = centers.getLongestAxis();
+		middle = node.begin + count / 2;
+
+		std::nth_element(primitives.begin() + node.begin, primitives.begin() + middle, primitives.begin() + node.end,
+			[axis](const Primitive & a, const Primitive & b) {
+			return a.center[axis] < b.center[axis] ||
+				(a.center[axis] == b.center[axis] && a.surface < b.surface); });
+	}
+	else {
+		return;
+	}
+
+	node.children[0].reset(new BuildNode());
+	node.children[0]->begin = node.begin;
+	node.children[0]->end = middle;
+
+	node.children[1].reset(new BuildNode());
+	node.children[1]->begin = middle;
+	node.children[1]->end = node.end;
+
+	if (threadPool != nullptr && count >= PARALLEL_SUBTREE_SIZE) {
+
+		TaskGroup subtree;
+		threadPool->submit([&] { buildBinned(primitives, *node.children[0], depth + 1, threadPool); }, subtree);
+		buildBinned(primitives, *node.children[1], depth + 1, threadPool);
+		threadPool->wait(subtree);
+	}
+	else {
+		buildBinned(primitives, *node.children[0], depth + 1, threadPool);
+		buildBinned(primitives, *node.children[1], depth + 1, threadPool);
+	}
+
+} // end buildBinned
+
+
+void BoundingVolumeHierarchy::sortByMortonCode(std::vector<Primitive> & primitives, std::vector<uint32_t> & codes, ThreadPool * threadPool)
+{
+	int count = (int)primitives.size();
+	int chunkCount = getChunkCount(threadPool, count);
+
+	std::vector<AABB> chunkCenters(chunkCount);
+
+	forEachChunk(threadPool, chunkCount, count, [&](int chunk, int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			chunkCenters[chunk].expand(primitives[i].center);
+		}
+	});
+
+	AABB centers;
+	for (const AABB & chunkCenter : chunkCenters) {
+		centers.expand(chunkCenter);
+	}
+
+	// Quantize the centers to 10 bits per axis and interleave the bits
+	dvec3 extent = centers.maximum - centers.minimum;
+	std::vector<std::pair<uint32_t, int>> keys(count);
+
+	forEachChunk(threadPool, chunkCount, count, [&](int, int begin, int end) {
+		for (int i = begin; i < end; i++) {
+
+			uint32_t quantized[3];
+			for (int axis = 0; axis < 3; axis++) {
+				double position = (extent[axis] > 0.0) ? (primitives[i].center[axis] - centers.minimum[axis]) / extent[axis] : 0.0;
+				quantized[axis] = (uint32_t)glm::clamp((int)(position * 1024.0), 0, 1023);
+			}
+
+			keys[i].first = (spreadBits(quantized[0]) << 2) | (spreadBits(quantized[1]) << 1) | spreadBits(quantized[2]);
+			keys[i].second = i;
+		}
+	});
+
+	// Equal codes are ordered by surface so the order does not depend on
+	// the number of chunks
+	auto isBefore = [&primitives](const std::pair<uint32_t, int> & a, const std::pair<uint32_t, int> & b) {
+		return a.first < b.first ||
+			(a.first == b.first && primitives[a.second].surface < primitives[b.second].surface);
+	};
+
+	// Sort every chunk, then merge neighboring runs until one is left
+	forEachChunk(threadPool, chunkCount, count, [&](int, int begin, int end) {
+		std::sort(keys.begin() + begin, keys.begin() + end, isBefore);
+	});
+
+	for (int width = 1; width < chunkCount; width *= 2) {
+
+		int mergeCount = (chunkCount + 2 * width - 1) / (2 * width);
+
+		forEachChunk(threadPool, mergeCount, mergeCount, [&](int merge, int, int) {
+
+			int first = merge * 2 * width;
+			int begin = (int)((long long)count * first / chunkCount);
+			int middle = (int)((long long)count * glm::min(first + width, chunkCount) / chunkCount);
+			int end = (int)((long long)count * glm::min(first + 2 * width, chunkCount) / chunkCount);
+
+			std::inplace_merge(keys.begin() + begin, keys.begin() + middle, keys.begin() + end, isBefore);
+		});
+	}
+
+	std::vector<Primitive> sorted(count);
+	codes.resize(count);
+
+	forEachChunk(threadPool, chunkCount, count, [&](int, int begin, int end) {
+		for (int i = begin; i < end; i++) {
+			sorted[i] = primitives[keys[i].second];
+			codes[i] = keys[i].first;
+		}
+	});
+
+	primitives.swap(sorted);
+
+} // end sortByMortonCode
+
+
+void BoundingVolumeHierarchy::buildMorton(const std::vector<uint32_t> & codes, BuildNode & node, int depth, ThreadPool * threadPool)
+{
+	int count = node.end - node.begin;
+
+	if (count <= maxLeafSize || depth >= MAX_DEPTH - 1) {
+		return;
+	}
+
+	uint32_t firstCode = codes[node.begin];
+	uint32_t lastCode = codes[node.end - 1];
+	int middle;
+
+	if (firstCode == lastCode) {
+		middle = node.begin + count / 2;
+	}
+	else {
+
+		// The primitives whose codes share more leading bits with the first
+		// one than the last one does come first. Find where they end.
+		int commonBits = countLeadingZeros(firstCode ^ lastCode);
+		int low = node.begin;
+		int high = node.end - 1;
+
+		while (low < high) {
+
+			int probe = (low + high + 1) / 2;
+
+			if (countLeadingZeros(firstCode ^ codes[probe]) > commonBits) {
+				low = probe;
+			}
+			else {
+				high = probe - 1;
+			}
+		}
+
+		middle = low + 1;
+	}
+
+	node.children[0].reset(new BuildNode());
+	node.children[0]->begin = node.begin;
+	node.children[0]->end = middle;
+
+	node.children[1].reset(new BuildNode());
+	node.children[1]->begin = middle;
+	node.children[1]->end = node.end;
+
+	if (threadPool != nullptr && count >= PARALLEL_SUBTREE_SIZE) {
+
+		TaskGroup subtree;
+		threadPool->submit([&] { buildMorton(codes, *node.children[0], depth + 1, threadPool); }, subtree);
+		buildMorton(codes, *node.children[1], depth + 1, threadPool);
+		threadPool->wait(subtree);
+	}
+	else {
+		buildMorton(codes, *node.children[0], depth + 1, threadPool);
+		buildMorton(codes, *node.children[1], depth + 1, threadPool);
+	}
+
+} // end buildMorton
+
+
+AABB BoundingVolumeHierarchy::flatten(const std::vector<Primitive> & primitives, const BuildNode & node)
+{
+	int nodeIndex = (int)nodes.size();
+	nodes.push_back(Node());
+
+	AABB bounds;
+
+	if (node.children[0] == nullptr) {
+
+		for (int i = node.begin; i < node.end; i++) {
+			bounds.expand(primitives[i].bounds);
+		}
+
+		nodes[nodeIndex].first = node.begin;
+		nodes[nodeIndex].count = node.end - node.begin;
+	}
+	else {
+
+		bounds.expand(flatten(primitives, *node.children[0]));
+
+		int secondChild = (int)nodes.size();
+		bounds.expand(flatten(primitives, *node.children[1]));
+
+		nodes[nodeIndex].first = secondChild;
+		nodes[nodeIndex].count = 0;
+	}
+
+	nodes[nodeIndex].bounds = bounds;
+
+	return bounds;
+
+} // end flatten
+
+
+void BoundingVolumeHierarchy::refitStructure(const std::vector<AABB> & bounds, ThreadPool * threadPool)
+{
+	if (nodes.empty() == false) {
+		refitNode(bounds, 0, (int)nodes.size(), threadPool);
+	}
+
+} // end refitStructure
+
+
+AABB BoundingVolumeHierarchy::refitNode(const std::vector<AABB> & bounds, int index, int end, ThreadPool * threadPool)
+{
+	AABB box;
+
+	if (nodes[index].count > 0) {
+
+		for (int i = nodes[index].first; i < nodes[index].first + nodes[index].count; i++) {
+			box.expand(bounds[surfaceOrder[i]]);
+		}
+	}
+	else {
+
+		// The subtree of the first child lies between the node and the
+		// second child, and that of the second child from there to the end
+		int secondChild = nodes[index].first;
+		AABB firstBox;
+		AABB secondBox;
+
+		if (threadPool != nullptr && end - index >= PARALLEL_SUBTREE_SIZE) {
+
+			TaskGroup subtree;
+			threadPool->submit([&] { firstBox = refitNode(bounds, index + 1, secondChild, threadPool); }, subtree);
+			secondBox = refitNode(bounds, secondChild, end, threadPool);
+			threadPool->wait(subtree);
+		}
+		else {
+			firstBox = refitNode(bounds, index + 1, secondChild, threadPool);
+			secondBox = refitNode(bounds, secondChild, end, threadPool);
+		}
+
+		box.expand(firstBox);
+		box.expand(secondBox);
+	}
+
+	nodes[index].bounds = box;
+
+	return box;
+
+} // end refitNode
+
+
+void BoundingVolumeHierarchy::traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const
+{
+	if (nodes.empty()) {
+		return;
+	}
+
+	dvec3 inverseDirection = 1.0 / ray.direct;
+	double entryDistance;
+
+	if (nodes[0].bounds.intersect(ray.origin, inverseDirection, closestHit.t, entryDistance) == false) {
+		return;
+	}
+
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+	int nodeIndex = 0;
+
+	while (true) {
+
+		const Node & node = nodes[nodeIndex];
+
+		if (node.count > 0) {
+
+			for (int i = node.first; i < node.first + node.count; i++) {
+				testSurface(ray, surfaceOrder[i], closestHit, closestSurface);
+			}
+		}
+		else {
+
+			int firstChild = nodeIndex + 1;
+			int secondChild = node.first;
+			double firstDistance, secondDistance;
+
+			bool hitFirst = nodes[firstChild].bounds.intersect(ray.origin, inverseDirection, closestHit.t, firstDistance);
+			bool hitSecond = nodes[secondChild].bounds.intersect(ray.origin, inverseDirection, closestHit.t, secondDistance);
+
+			if (hitFirst && hitSecond) {
+
+				// Visit the nearer child first. Its hits may let the other
+				// be skipped.
+				if (secondDistance < firstDistance) {
+					std::swap(firstChild, secondChild);
+				}
+				stack[stackSize++] = secondChild;
+				nodeIndex = firstChild;
+				continue;
+			}
+			else if (hitFirst || hitSecond) {
+				nodeIndex = hitFirst ? firstChild : secondChild;
+				continue;
+			}
+		}
+
+		// Pop nodes until one still starts before the closest hit. The
+		// entry distance is tested again since closestHit may have moved.
+		bool found = false;
+
+		while (stackSize > 0 && found == false) {
+			nodeIndex = stack[--stackSize];
+			found = nodes[nodeIndex].bounds.intersect(ray.origin, inverseDirection, closestHit.t, entryDistance);
+		}
+
+		if (found == false) {
+			break;
+		}
+	}
+
+} // end traverse
+
+
+void BoundingVolumeHierarchy::traversePacket(const RayPacket & packet, HitRecord hits[], int closestSurfaces[]) const
+{
+	if (nodes.empty()) {
+		return;
+	}
+
+	// Kept apart from the hits so that the box tests read contiguous memory
+	double maxDistances[RayPacket::MAX_SIZE];
+
+	for (int lane = 0; lane < packet.size; lane++) {
+		maxDistances[lane] = hits[lane].t;
+	}
+
+	// Node along with the rays that entered its parent. Each interior node
+	// replaces itself with its two children, so the stack holds at most
+	// one node more than the tree is deep.
+	struct StackEntry
+	{
+		int node;
+		int mask;
+	};
+
+	StackEntry stack[MAX_DEPTH + 1];
+	int stackSize = 0;
+	stack[stackSize++] = { 0, packet.getMask() };
+
+	while (stackSize > 0) {
+
+		StackEntry entry = stack[--stackSize];
+		const Node & node = nodes[entry.node];
+
+		// Tested when popped rather than when pushed since the closest hits
+		// may have moved in the meantime
+		int mask = intersectPacket(node.bounds, packet, maxDistances) & entry.mask;
+
+		if (mask == 0) {
+			continue;
+		}
+
+		if (node.count > 0) {
+
+			for (int i = node.first; i < node.first + node.count; i++) {
+				testSurfacePacket(packet, mask, surfaceOrder[i], hits, closestSurfaces);
+			}
+
+			for (int lane = 0; lane < packet.size; lane++) {
+				maxDistances[lane] = hits[lane].t;
+			}
+			continue;
+		}
+
+		int firstChild = entry.node + 1;
+		int secondChild = node.first;
+
+		// Coherent rays agree on which child is nearer, so the first active
+		// ray decides for the packet
+		int lane = 0;
+		while ((mask & (1 << lane)) == 0) {
+			lane++;
+		}
+
+		dvec3 between = nodes[secondChild].bounds.getCenter() - nodes[firstChild].bounds.getCenter();
+
+		if (glm::dot(between, packet.getDirection(lane)) < 0.0) {
+			std::swap(firstChild, secondChild);
+		}
+
+		stack[stackSize++] = { secondChild, mask };
+		stack[stackSize++] = { firstChild, mask };
+	}
+
+} // end traversePacket
+
+
+int BoundingVolumeHierarchy::intersectPacket(const AABB & box, const RayPacket & packet, const double maxDistances[])
+{
+	int mask = 0;
+
+	// Without branches so that the rays are tested side by side
+	for (int lane = 0; lane < packet.size; lane++) {
+
+		double x0 = (box.minimum.x - packet.originX[lane]) * packet.inverseDirectionX[lane];
+		double x1 = (box.maximum.x - packet.originX[lane]) * packet.inverseDirectionX[lane];
+		double y0 = (box.minimum.y - packet.originY[lane]) * packet.inverseDirectionY[lane];
+		double y1 = (box.maximum.y - packet.originY[lane]) * packet.inverseDirectionY[lane];
+		double z0 = (box.minimum.z - packet.originZ[lane]) * packet.inverseDirectionZ[lane];
+		double z1 = (box.maximum.z - packet.originZ[lane]) * packet.inverseDirectionZ[lane];
+
+		double tEnter = glm::max(glm::max(glm::min(x0, x1), glm::min(y0, y1)), glm::max(glm::min(z0, z1), 0.0));
+		double tExit = glm::min(glm::min(glm::max(x0, x1), glm::max(y0, y1)), glm::min(glm::max(z0, z1), maxDistances[lane]));
+
+		mask |= (tEnter <= tExit) << lane;
+	}
+
+	return mask;
+
+} // end intersectPacket
+
+
+int BoundingVolumeHierarchy::traverseOccluded(const Ray & ray, double maxDistance) const
+{
+	if (nodes.empty()) {
+		return -1;
+	}
+
+	dvec3 inverseDirection = 1.0 / ray.direct;
+	double entryDistance;
+
+	// Any blocker will do, so the children are visited in the order they are
+	// stored and the range never shrinks
+	int stack[MAX_DEPTH];
+	int stackSize = 0;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+
+		int nodeIndex = stack[--stackSize];
+		const Node & node = nodes[nodeIndex];
+
+		if (node.bounds.intersect(ray.origin, inverseDirection, maxDistance, entryDistance) == false) {
+			continue;
+		}
+
+		if (node.count > 0) {
+
+			for (int i = node.first; i < node.first + node.count; i++) {
+				if (surfaces[surfaceOrder[i]]->isOccluding(ray, maxDistance)) {
+					return surfaceOrder[i];
+				}
+			}
+		}
+		else {
+			stack[stackSize++] = node.first;
+			stack[stackSize++] = nodeIndex + 1;
+		}
+	}
+
+	return -1;
+
+} // end traverseOccluded
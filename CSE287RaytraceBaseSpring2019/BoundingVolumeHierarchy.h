@@ -0,0 +1,239 @@
+#pragma once
+
+#include "Accelerator.h"
+
+/**
+* Binary tree of axis aligned boxes over the bounded surfaces of a scene.
+* Each node is split where the surface area heuristic (SAH) predicts the
+* cheapest traversal: a ray that hits a box hits each child with a
+* probability proportional to the surface area of the child, so a split
+* costs the area weighted number of surfaces on each side.
+*
+* A ray visits the nearer child of a node first and skips every box that
+* starts beyond the closest hit found so far.
+*
+* Three builders trade the quality of the tree against build time. The
+* sweep builder evaluates the SAH at every surface and runs on one thread.
+* The binned builder evaluates it at the boundaries of a few bins and the
+* Morton builder splits surfaces sorted along a Morton curve where their
+* codes first differ. Both build independent subtrees on the thread pool
+* passed to build. Every builder gives the same tree whatever the number
+* of threads.
+*
+* The spatial split builder extends the sweep builder for surfaces whose
+* boxes overlap heavily, such as large polygons and long cylinders. Where
+* the children of a node would overlap, it also tries splitting space
+* itself and puts a surface that crosses the split into both children,
+* each with the box of its part on that side. A surface may then be in
+* several leaves. splitBudget limits how many references are added.
+*
+* A refit keeps the tree and recomputes the boxes from the leaves up, again
+* with independent subtrees on the thread pool. A spatial split tree is
+* built again instead, as the box of the whole surface would replace the
+* clipped box of each of its parts.
+*/
+class BoundingVolumeHierarchy : public Accelerator
+{
+public:
+
+	/**
+	* Algorithms that build the tree.
+	*/
+	enum class BuildMethod
+	{
+		SWEEP_SAH, // Best trees. Serial and slowest.
+		BINNED_SAH, // Nearly as good. Parallel.
+		MORTON, // Fastest and parallel. For content that is rebuilt every frame.
+		SPATIAL_SPLITS // Sweep SAH that may also split surfaces between nodes. Serial.
+	};
+
+	/**
+	* Constructor.
+	* @param buildMethod - algorithm that builds the tree
+	*/
+	BoundingVolumeHierarchy(BuildMethod buildMethod = BuildMethod::SWEEP_SAH);
+
+	virtual AcceleratorType getType() const;
+
+	virtual const char * getName() const;
+
+	virtual double getCost() const;
+
+	virtual size_t getMemoryBytes() const;
+
+	/**
+	* Reports the number of nodes and references and how much the boxes of
+	* sibling nodes overlap: the sum of the areas of the overlaps relative
+	* to the area of the root.
+	*/
+	virtual std::string getStatistics() const;
+
+	// Largest number of surfaces that a leaf holds when splitting it would
+	// not lower the cost
+	int maxLeafSize = 4;
+
+	// Number of bins per axis of the binned builder and of the spatial
+	// splits of the spatial split builder
+	int binCount = 16;
+
+	// References the spatial split builder may add, as a fraction of the
+	// number of surfaces
+	double splitBudget = 0.5;
+
+	// Spatial splits are only tried in nodes whose children overlap by more
+	// than this fraction of the area of the root
+	double splitOverlapThreshold = 1e-5;
+
+protected:
+
+	/**
+	* Node of the tree. Nodes are stored depth first, so the first child of
+	* an interior node directly follows it.
+	*/
+	struct Node
+	{
+		// Box that contains every surface below the node
+		AABB bounds;
+
+		// Leaves: index in surfaceOrder of the first surface of the leaf.
+		// Interior nodes: index of the second child.
+		int first;
+
+		// Number of surfaces in a leaf. Zero for interior nodes.
+		int count;
+	};
+
+	/**
+	* Node of the tree while it is built in parallel. Every node covers a
+	* range of the primitives. Flattened into nodes once complete.
+	*/
+	struct BuildNode
+	{
+		int begin;
+		int end;
+		std::unique_ptr<BuildNode> children[2];
+	};
+
+	virtual void buildStructure(std::vector<Primitive> & primitives, ThreadPool * threadPool);
+
+	virtual void refitStructure(const std::vector<AABB> & bounds, ThreadPool * threadPool);
+
+	// The leaves of a spatial split tree hold clipped parts of surfaces
+	virtual bool canRefit() const { return buildMethod != BuildMethod::SPATIAL_SPLITS; }
+
+	virtual std::shared_ptr<Accelerator> clone() const { return std::make_shared<BoundingVolumeHierarchy>(*this); }
+
+	virtual void traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const;
+
+	virtual int traverseOccluded(const Ray & ray, double maxDistance) const;
+
+	/**
+	* Visits the nodes once for a whole packet. A node is entered by the rays
+	* whose closest hit so far lies beyond its box, and the children are
+	* visited in the order that suits the first of those rays.
+	*/
+	virtual void traversePacket(const RayPacket & packet, HitRecord hits[], int closestSurfaces[]) const;
+
+	/**
+	* Checks the rays of a packet for intersection with a box.
+	* @param maxDistances - closest hit of each ray so far
+	* @returns mask in which bit i is set if ray i passes through the box
+	* closer than maxDistances[i]
+	*/
+	static int intersectPacket(const AABB & box, const RayPacket & packet, const double maxDistances[]);
+
+	/**
+	* Recomputes the boxes of a subtree from the boxes of its surfaces.
+	* @param bounds - box of each surface, indexed like surfaces
+	* @param index - node at the root of the subtree
+	* @param end - node after the last one of the subtree
+	* @returns box of the subtree
+	*/
+	AABB refitNode(const std::vector<AABB> & bounds, int index, int end, ThreadPool * threadPool);
+
+	/**
+	* Builds the subtree over a range of primitives and reorders them so
+	* that every leaf holds a contiguous range.
+	* @param primitives - primitives to build over
+	* @param begin - first primitive of the range
+	* @param end - primitive after the last one of the range
+	* @param depth - depth of the node in the tree
+	* @returns index of the node at the root of the subtree
+	*/
+	int buildNode(std::vector<Primitive> & primitives, int begin, int end, int depth);
+
+	/**
+	* Builds the subtree of the spatial split builder over a list of
+	* references and adds the references of its leaves to surfaceOrder.
+	* @param references - parts of surfaces to build over. Emptied.
+	* @param depth - depth of the node in the tree
+	* @param rootArea - surface area of the box of the root
+	* @returns index of the node at the root of the subtree
+	*/
+	int buildSplitNode(std::vector<Primitive> & references, int depth, double rootArea);
+
+	/**
+	* Finds the cheapest binned spatial split of a node that adds no more
+	* references than the budget has left.
+	* @param references - references in the node
+	* @param bounds - box of the node
+	* @param cost - cost to beat. Set to the cost of the split if one is found.
+	* @param axis - set to the axis of the split
+	* @param position - set to the coordinate of the split plane
+	* @returns false if no split costs less than cost
+	*/
+	bool findSpatialSplit(const std::vector<Primitive> & references, const AABB & bounds,
+		double & cost, int & axis, double & position) const;
+
+	/**
+	* Finds the part of a reference that lies between two planes across an
+	* axis.
+	* @param piece - set to the part, with a padded box that is no larger
+	* than the box of the reference
+	* @returns false if no part of the surface lies between the planes
+	*/
+	bool clipReference(const Primitive & reference, int axis, double low, double high,
+		Primitive & piece) const;
+
+	/**
+	* Splits a node with the binned SAH and builds its subtrees. Subtrees
+	* over many primitives are built as separate tasks.
+	*/
+	void buildBinned(std::vector<Primitive> & primitives, BuildNode & node, int depth, ThreadPool * threadPool);
+
+	/**
+	* Splits a node of primitives sorted by Morton code where the codes of
+	* the first and last primitive first differ and builds its subtrees.
+	*/
+	void buildMorton(const std::vector<uint32_t> & codes, BuildNode & node, int depth, ThreadPool * threadPool);
+
+	/**
+	* Sorts the primitives by the Morton codes of their centers.
+	* @param codes - set to the sorted codes
+	*/
+	void sortByMortonCode(std::vector<Primitive> & primitives, std::vector<uint32_t> & codes, ThreadPool * threadPool);
+
+	/**
+	* Appends a built subtree to nodes depth first.
+	* @returns box of the subtree
+	*/
+	AABB flatten(const std::vector<Primitive> & primitives, const BuildNode & node);
+
+	// Algorithm that builds the tree
+	BuildMethod buildMethod;
+
+	// Indices in surfaces of the surfaces in the leaves, leaf by leaf. The
+	// spatial split builder may list a surface in several leaves.
+	std::vector<int> surfaceOrder;
+
+	// References the spatial split builder may still add during a build
+	int remainingSplits = 0;
+
+	// Nodes of the tree. The root is the first node. Empty if no surface
+	// is bounded.
+	std::vector<Node> nodes;
+
+	// Deepest the tree may get. Sets the size of the traversal stack.
+	static const int MAX_DEPTH = 64;
+
+}; // end BoundingVolumeHierarchy class
@@ -0,0 +1,237 @@
+#include "Calibrator.h"
+
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <typeinfo>
+
+
+/**
+* Adds bytes to a 64 bit FNV-1a hash.
+*/
+static void hashBytes(uint64_t & hash, const void * bytes, size_t count)
+{
+	const unsigned char * data = (const unsigned char *)bytes;
+
+	for (size_t i = 0; i < count; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001B3ull;
+	}
+
+} // end hashBytes
+
+
+Calibrator::Calibrator(RayTracer & rayTracer, FrameBuffer & frameBuffer)
+	: rayTracer(rayTracer), frameBuffer(frameBuffer)
+{
+
+} // end Calibrator constructor
+
+
+RenderConfiguration Calibrator::calibrate(std::shared_ptr<const Scene> scene,
+	const std::string & cachePath)
+{
+	uint64_t sceneHash = hashScene(scene);
+	RenderConfiguration best;
+
+	if (load(cachePath, sceneHash, best)) {
+
+		std::cout << "Using the stored calibration: " << best.threadCount << " threads, "
+			<< best.tileSize << " pixel tiles, " << (best.renderWavefront ? "wavefront" : "recursive")
+			<< " integrator." << std::endl;
+
+		apply(best);
+		return best;
+	}
+
+	double bestSeconds = 0.0;
+	bool first = true;
+
+	for (const RenderConfiguration & candidate : createCandidates()) {
+
+		double seconds = measure(candidate, scene);
+
+		if (first || seconds < bestSeconds) {
+			best = candidate;
+			bestSeconds = seconds;
+			first = false;
+		}
+	}
+
+	std::cout << "Calibrated: " << best.threadCount << " threads, " << best.tileSize
+		<< " pixel tiles, " << (best.renderWavefront ? "wavefront" : "recursive") << " integrator ("
+		<< bestSeconds * 1000.0 << " ms per downscaled frame)." << std::endl;
+
+	save(cachePath, sceneHash, best);
+	apply(best);
+
+	return best;
+
+} // end calibrate
+
+
+uint64_t Calibrator::hashScene(std::shared_ptr<const Scene> scene)
+{
+	uint64_t hash = 0xCBF29CE484222325ull;
+
+	for (const std::shared_ptr<Surface> & surface : scene->getSurfaces()) {
+		const char * type = typeid(*surface).name();
+		hashBytes(hash, type, strlen(type));
+	}
+
+	for (const std::shared_ptr<LightSource> & light : scene->getLights()) {
+		const char * type = typeid(*light).name();
+		hashBytes(hash, type, strlen(type));
+	}
+
+	// Settings that change the work done per pixel and the host it runs on
+	int settings[] = { frameBuffer.getWindowWidth(), frameBuffer.getWindowHeight(),
+		rayTracer.getRecursionDepth(), ThreadPool::getHardwareConcurrency() };
+	hashBytes(hash, settings, sizeof(settings));
+
+	// A thumbnail stands in for the positions and materials of the objects
+	FrameBuffer thumbnail(32, glm::max(1, 32 * frameBuffer.getWindowHeight() / glm::max(1, frameBuffer.getWindowWidth())));
+	RayTracer thumbnailTracer(thumbnail, rayTracer);
+	thumbnailTracer.raytraceScene(scene);
+
+	for (int y = 0; y < thumbnail.getWindowHeight(); y++) {
+		for (int x = 0; x < thumbnail.getWindowWidth(); x++) {
+
+			color c = thumbnail.getPixel(x, y);
+			unsigned char rgb[] = { (unsigned char)(c.r * 255.0 + 0.5),
+				(unsigned char)(c.g * 255.0 + 0.5), (unsigned char)(c.b * 255.0 + 0.5) };
+			hashBytes(hash, rgb, sizeof(rgb));
+		}
+	}
+
+	return hash;
+
+} // end hashScene
+
+
+std::vector<RenderConfiguration> Calibrator::createCandidates()
+{
+	std::vector<int> threadCounts;
+	for (int threads = ThreadPool::getHardwareConcurrency(); threads > 1; threads /= 2) {
+		threadCounts.push_back(threads);
+	}
+	threadCounts.push_back(1);
+
+	std::vector<RenderConfiguration> candidates;
+
+	for (int threadCount : threadCounts) {
+		for (int tileSize : { 8, 16, 32, 64 }) {
+			candidates.push_back({ threadCount, tileSize, false });
+			candidates.push_back({ threadCount, tileSize, true });
+		}
+	}
+
+	return candidates;
+
+} // end createCandidates
+
+
+double Calibrator::measure(const RenderConfiguration & configuration,
+	std::shared_ptr<const Scene> scene)
+{
+	FrameBuffer downscaled(glm::max(1, frameBuffer.getWindowWidth() / downscale),
+		glm::max(1, frameBuffer.getWindowHeight() / downscale));
+
+	// Replaces the thread pool of the copy only
+	RayTracer tracer(downscaled, rayTracer);
+	tracer.setThreadCount(configuration.threadCount);
+	tracer.setTileSize(configuration.tileSize);
+	tracer.renderWavefront = configuration.renderWavefront;
+
+	double fastest = 0.0;
+
+	for (int i = 0; i < glm::max(repetitions, 1); i++) {
+
+		auto startTime = std::chrono::steady_clock::now();
+		tracer.raytraceScene(scene);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+		if (i == 0 || seconds < fastest) {
+			fastest = seconds;
+		}
+	}
+
+	return fastest;
+
+} // end measure
+
+
+bool Calibrator::load(const std::string & cachePath, uint64_t sceneHash, RenderConfiguration & configuration)
+{
+	std::ifstream file(cachePath);
+	std::string line;
+
+	while (std::getline(file, line)) {
+
+		std::istringstream values(line);
+		uint64_t hash;
+		RenderConfiguration stored;
+
+		if (values >> std::hex >> hash >> std::dec >> stored.threadCount >> stored.tileSize >> stored.renderWavefront) {
+
+			if (hash == sceneHash) {
+				configuration = stored;
+				return true;
+			}
+		}
+	}
+
+	return false;
+
+} // end load
+
+
+void Calibrator::save(const std::string & cachePath, uint64_t sceneHash, const RenderConfiguration & configuration)
+{
+	// Keep the entries of other scenes
+	std::vector<std::string> lines;
+	{
+		std::ifstream file(cachePath);
+		std::string line;
+
+		while (std::getline(file, line)) {
+
+			std::istringstream values(line);
+			uint64_t hash;
+
+			if ((values >> std::hex >> hash) && hash != sceneHash) {
+				lines.push_back(line);
+			}
+		}
+	}
+
+	std::ostringstream entry;
+	entry << std::hex << std::setw(16) << std::setfill('0') << sceneHash << std::dec << " "
+		<< configuration.threadCount << " " << configuration.tileSize << " " << configuration.renderWavefront;
+	lines.push_back(entry.str());
+
+	std::ofstream file(cachePath);
+
+	for (const std::string & line : lines) {
+		file << line << "\n";
+	}
+
+	if (file.good() == false) {
+		std::cerr << "Unable to store the calibration in " << cachePath << "." << std::endl;
+	}
+
+} // end save
+
+
+void Calibrator::apply(const RenderConfiguration & configuration)
+{
+	if (configuration.threadCount != rayTracer.getThreadCount()) {
+		rayTracer.setThreadCount(configuration.threadCount);
+	}
+
+	rayTracer.setTileSize(configuration.tileSize);
+	rayTracer.renderWavefront = configuration.renderWavefront;
+
+} // end apply
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "RayTracer.h"
+
+#include <string>
+
+/**
+* Settings of a RayTracer that affect only how fast a frame renders.
+*/
+struct RenderConfiguration
+{
+	int threadCount;
+	int tileSize;
+	bool renderWavefront;
+};
+
+/**
+* Picks the fastest thread count, tile size, and integrator for a scene on
+* the current host. Each configuration renders a downscaled frame of the
+* scene and the one with the shortest render time is applied to the ray
+* tracer.
+*
+* Results are stored in a text file under a hash of the scene, the window
+* size, and the host, so a later run of the same scene applies the stored
+* configuration without rendering anything.
+*/
+class Calibrator
+{
+public:
+
+	/**
+	* Constructor.
+	* @param rayTracer - ray tracer to tune. Its camera and viewing
+	* parameters must be set.
+	* @param frameBuffer - frame buffer that rayTracer renders into
+	*/
+	Calibrator(RayTracer & rayTracer, FrameBuffer & frameBuffer);
+
+	/**
+	* Applies the stored configuration for the scene, or measures every
+	* candidate configuration and stores the fastest.
+	* @param scene - snapshot of the scene
+	* @param cachePath - file that holds the stored configurations
+	* @returns configuration that was applied
+	*/
+	RenderConfiguration calibrate(std::shared_ptr<const Scene> scene,
+		const std::string & cachePath);
+
+	// Factor by which the width and height of the window are divided for
+	// the frames rendered during calibration
+	int downscale = 4;
+
+	// Number of frames rendered with each configuration. The fastest counts.
+	int repetitions = 2;
+
+protected:
+
+	/**
+	* Returns a hash that identifies the scene, the window size, and the
+	* host. The scene is identified by the types of its surfaces and lights
+	* and by the pixels of a small rendering of it, so moving an object or
+	* changing a material changes the hash.
+	*/
+	uint64_t hashScene(std::shared_ptr<const Scene> scene);
+
+	/**
+	* Returns the configurations to try.
+	*/
+	std::vector<RenderConfiguration> createCandidates();
+
+	/**
+	* Returns the shortest time in seconds it took to render a downscaled
+	* frame with a configuration.
+	*/
+	double measure(const RenderConfiguration & configuration,
+		std::shared_ptr<const Scene> scene);
+
+	/**
+	* Looks up the configuration stored for a scene hash.
+	* @returns false if the file has no entry for the hash
+	*/
+	bool load(const std::string & cachePath, uint64_t sceneHash, RenderConfiguration & configuration);
+
+	/**
+	* Stores the configuration for a scene hash, replacing any earlier entry.
+	*/
+	void save(const std::string & cachePath, uint64_t sceneHash, const RenderConfiguration & configuration);
+
+	/**
+	* Sets the configuration of the ray tracer that is tuned.
+	*/
+	void apply(const RenderConfiguration & configuration);
+
+	// Ray tracer that is tuned
+	RayTracer & rayTracer;
+
+	// Frame buffer that rayTracer renders into
+	FrameBuffer & frameBuffer;
+
+}; // end Calibrator class
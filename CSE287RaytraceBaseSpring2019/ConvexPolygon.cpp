@@ -23,6 +23,68 @@ HitRecord ConvexPolygon::findClosestIntersection(const Ray & ray)
 	return hitRecord;
 }
 
-int ConvexPolygon::checkLeft(dvec3 start, dvec3 end, dvec3 p, dvec3 n) {
+bool ConvexPolygon::isOccluding(const Ray & ray, double maxDistance)
+{
+	// Only hits of the plane that are close enough need the edge tests
+	if (findDistance(ray) >= maxDistance) {
+		return false;
+	}
+
+	return findClosestIntersection(ray).t < maxDistance;
+}
+
+double ConvexPolygon::checkLeft(dvec3 start, dvec3 end, dvec3 p, dvec3 n) {
 	return glm::dot(glm::cross(end - start, p - start), n);
 }
+
+bool ConvexPolygon::getBoundingBox(AABB & box) const {
+	box = AABB();
+	for (const dvec3 & vertex : v) {
+		box.expand(vertex);
+	}
+	return true;
+}
+
+bool ConvexPolygon::getClippedBoundingBox(const AABB & clip, AABB & box) const {
+
+	std::vector<dvec3> polygon = v;
+	std::vector<dvec3> clipped;
+
+	// Cut away the part outside each of the six planes of the box in turn
+	for (int plane = 0; plane < 6 && polygon.empty() == false; plane++) {
+
+		int axis = plane / 2;
+		double limit = (plane % 2 == 0) ? clip.minimum[axis] : clip.maximum[axis];
+		double inward = (plane % 2 == 0) ? 1.0 : -1.0;
+
+		clipped.clear();
+
+		for (size_t i = 0; i < polygon.size(); i++) {
+
+			const dvec3 & a = polygon[i];
+			const dvec3 & b = polygon[(i + 1) % polygon.size()];
+			double aDistance = inward * (a[axis] - limit);
+			double bDistance = inward * (b[axis] - limit);
+
+			if (aDistance >= 0.0) {
+				clipped.push_back(a);
+			}
+
+			// The edge crosses the plane
+			if ((aDistance < 0.0) != (bDistance < 0.0)) {
+				dvec3 crossing = a + (b - a) * (aDistance / (aDistance - bDistance));
+				crossing[axis] = limit;
+				clipped.push_back(crossing);
+			}
+		}
+
+		std::swap(polygon, clipped);
+	}
+
+	box = AABB();
+	for (const dvec3 & vertex : polygon) {
+		box.expand(vertex);
+	}
+
+	return polygon.empty() == false;
+}
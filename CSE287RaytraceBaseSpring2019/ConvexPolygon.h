@@ -7,7 +7,15 @@ class ConvexPolygon :
 public:
 	ConvexPolygon(std::vector<dvec3> vertices, const color & material);
 	virtual HitRecord findClosestIntersection(const Ray & ray);
-	int checkLeft(dvec3 v1, dvec3 v2, dvec3 p, dvec3 n);
+	virtual bool isOccluding(const Ray & ray, double maxDistance);
+	virtual bool getBoundingBox(AABB & box) const;
+
+	/**
+	* Clips the polygon to the box and finds the bounds of what is left, which
+	* for a large polygon is much smaller than the overlap of the boxes.
+	*/
+	virtual bool getClippedBoundingBox(const AABB & clip, AABB & box) const;
+	double checkLeft(dvec3 v1, dvec3 v2, dvec3 p, dvec3 n);
 	std::vector<dvec3> v;
 };
 
@@ -0,0 +1,275 @@
+#include "DistributedRenderer.h"
+#include "OccluderCache.h"
+
+#include <deque>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+
+DistributedRenderer::DistributedRenderer(RayTracer & rayTracer, FrameBuffer & frameBuffer, int workerCount)
+	: rayTracer(rayTracer), frameBuffer(frameBuffer),
+	workerCount(workerCount > 0 ? workerCount : ThreadPool::getHardwareConcurrency())
+{
+	// Workers write their pixels straight into the color buffer
+	frameBuffer.setSharedMemory(true);
+
+} // end DistributedRenderer constructor
+
+
+std::vector<Tile> DistributedRenderer::createCrops()
+{
+	std::vector<Tile> crops;
+
+	for (int y = 0; y < frameBuffer.getWindowHeight(); y += cropSize) {
+		for (int x = 0; x < frameBuffer.getWindowWidth(); x += cropSize) {
+
+			Tile crop;
+			crop.x = x;
+			crop.y = y;
+			crop.width = glm::min(cropSize, frameBuffer.getWindowWidth() - x);
+			crop.height = glm::min(cropSize, frameBuffer.getWindowHeight() - y);
+			crops.push_back(crop);
+		}
+	}
+
+	return crops;
+
+} // end createCrops
+
+
+void DistributedRenderer::renderCropLocally(const Tile & crop)
+{
+	rayTracer.setCropWindow(crop);
+	rayTracer.renderFrame();
+	rayTracer.clearCropWindow();
+
+} // end renderCropLocally
+
+
+#ifdef _WIN32
+
+bool DistributedRenderer::render(std::shared_ptr<const Scene> scene,
+	const CancellationToken * cancelToken)
+{
+	// No fork on Windows. Render the whole frame in this process.
+	reissuedCrops = 0;
+
+	return rayTracer.raytraceScene(scene, cancelToken);
+
+} // end render
+
+#else
+
+bool DistributedRenderer::render(std::shared_ptr<const Scene> scene,
+	const CancellationToken * cancelToken)
+{
+	reissuedCrops = 0;
+
+	// Workers would write their crops into copies of private pages that
+	// the coordinator never sees
+	if (frameBuffer.usesSharedMemory() == false) {
+		return rayTracer.raytraceScene(scene, cancelToken);
+	}
+
+	std::vector<Tile> crops = createCrops();
+	std::vector<int> attempts(crops.size(), 0);
+	std::deque<int> pendingCrops;
+	size_t completedCrops = 0;
+
+	for (size_t i = 0; i < crops.size(); i++) {
+		pendingCrops.push_back((int)i);
+	}
+
+	// Everything a worker would otherwise set up under a lock is set up
+	// here and inherited: the bins of the whole frame, which every crop
+	// shares, and the occluder cache, which registers under a lock.
+	rayTracer.prepareFrame(scene);
+	OccluderCache::getThreadCache();
+
+	// Worker process, the coordinator's end of its socket, and the crop it is
+	// rendering (-1 if idle)
+	struct Worker
+	{
+		pid_t pid;
+		int socket;
+		int crop;
+	};
+
+	std::vector<Worker> workers;
+
+	auto spawnWorker = [&]() {
+
+		int sockets[2];
+
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) != 0) {
+			return false;
+		}
+
+		pid_t pid = fork();
+
+		if (pid < 0) {
+			close(sockets[0]);
+			close(sockets[1]);
+			return false;
+		}
+
+		if (pid == 0) {
+
+			// The coordinator only notices that a worker died when every
+			// copy of that worker's socket is closed, so keep only our own.
+			close(sockets[0]);
+			for (const Worker & other : workers) {
+				close(other.socket);
+			}
+
+			workerMain(sockets[1], crops);
+		}
+
+		close(sockets[1]);
+		workers.push_back({ pid, sockets[0], -1 });
+		return true;
+	};
+
+	for (int i = 0; i < workerCount && i < (int)crops.size(); i++) {
+		spawnWorker();
+	}
+
+	bool cancelled = false;
+
+	while (completedCrops < crops.size()) {
+
+		if (cancelToken != nullptr && cancelToken->isCancelled()) {
+			cancelled = true;
+			break;
+		}
+
+		// Render in this process if no worker can be started
+		if (workers.empty() && spawnWorker() == false) {
+
+			int crop = pendingCrops.front();
+			pendingCrops.pop_front();
+
+			renderCropLocally(crops[crop]);
+			completedCrops++;
+			continue;
+		}
+
+		// Hand out crops to idle workers. A failed send shows up as a dead
+		// worker when its socket is polled.
+		for (Worker & worker : workers) {
+
+			if (worker.crop < 0 && pendingCrops.empty() == false) {
+
+				worker.crop = pendingCrops.front();
+				pendingCrops.pop_front();
+				attempts[worker.crop]++;
+
+				send(worker.socket, &worker.crop, sizeof(worker.crop), MSG_NOSIGNAL);
+			}
+		}
+
+		std::vector<pollfd> sockets;
+		for (const Worker & worker : workers) {
+			sockets.push_back({ worker.socket, POLLIN, 0 });
+		}
+
+		// Time out periodically to check for cancellation
+		if (poll(sockets.data(), (nfds_t)sockets.size(), 50) <= 0) {
+			continue;
+		}
+
+		// Walk backwards so that removing a worker does not disturb the
+		// indices that are still to be checked
+		for (int i = (int)sockets.size() - 1; i >= 0; i--) {
+
+			if (sockets[i].revents == 0) {
+				continue;
+			}
+
+			Worker & worker = workers[i];
+			int finishedCrop;
+
+			if (recv(worker.socket, &finishedCrop, sizeof(finishedCrop), MSG_WAITALL) == sizeof(finishedCrop)) {
+				worker.crop = -1;
+				completedCrops++;
+				continue;
+			}
+
+			// The worker died. Its crop may be partly written, so it is
+			// rendered again from scratch.
+			close(worker.socket);
+			waitpid(worker.pid, nullptr, 0);
+
+			int lostCrop = worker.crop;
+			workers.erase(workers.begin() + i);
+
+			if (lostCrop >= 0) {
+
+				reissuedCrops++;
+
+				if (attempts[lostCrop] < maxAttempts) {
+					pendingCrops.push_front(lostCrop);
+				}
+				else {
+					std::cerr << "Crop " << lostCrop << " failed " << attempts[lostCrop]
+						<< " times. Rendering it in the coordinator." << std::endl;
+
+					renderCropLocally(crops[lostCrop]);
+					completedCrops++;
+				}
+			}
+
+			if (pendingCrops.empty() == false) {
+				spawnWorker();
+			}
+		}
+	}
+
+	// Closing the socket tells an idle worker to exit
+	for (const Worker & worker : workers) {
+
+		if (cancelled) {
+			kill(worker.pid, SIGKILL);
+		}
+
+		close(worker.socket);
+		waitpid(worker.pid, nullptr, 0);
+	}
+
+	return cancelled == false;
+
+} // end render
+
+
+void DistributedRenderer::workerMain(int socket, const std::vector<Tile> & crops)
+{
+	// Only the forking thread exists in this process, so the worker threads
+	// of the coordinator's pool cannot be used. Nothing here may take a
+	// lock, since another thread may have held it at the fork.
+	rayTracer.renderTiled = false;
+
+	int crop;
+
+	while (recv(socket, &crop, sizeof(crop), MSG_WAITALL) == sizeof(crop)) {
+
+		rayTracer.setCropWindow(crops[crop]);
+		rayTracer.renderFrame();
+
+		if (send(socket, &crop, sizeof(crop), MSG_NOSIGNAL) != sizeof(crop)) {
+			break;
+		}
+	}
+
+	// Skip the destructors and exit handlers, which belong to the coordinator
+	_exit(0);
+
+} // end workerMain
+
+#endif
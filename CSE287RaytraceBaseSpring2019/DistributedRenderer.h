@@ -0,0 +1,101 @@
+#pragma once
+
+#include "RayTracer.h"
+
+/**
+* Renders a frame with several worker processes on the local host. The
+* coordinator (the calling process) divides the image plane into crop
+* windows and forks the workers, which inherit a copy of the scene. Each
+* worker traces the crops it is handed directly into the color buffer of
+* a shared memory FrameBuffer and reports back when a crop is done.
+*
+* Other threads of the coordinator may hold locks when it forks, and the
+* workers would wait for those locks forever. The workers therefore take
+* none: the surfaces are sorted into bins and the occluder cache of the
+* forking thread is created before the first fork.
+*
+* A worker that crashes only loses the crop it was working on. The crop is
+* handed to a replacement worker, and after maxAttempts failures the
+* coordinator traces it itself.
+*
+* Uses fork and Unix domain sockets. On Windows, or if the color buffers
+* could not be placed in shared memory, the frame is rendered by the
+* RayTracer in the calling process.
+*/
+class DistributedRenderer
+{
+public:
+
+	/**
+	* Constructor. Switches the frame buffer to shared memory.
+	* @param rayTracer - ray tracer with the camera and viewing parameters to use
+	* @param frameBuffer - frame buffer into which rayTracer renders
+	* @param workerCount - number of worker processes. Values of zero or less
+	* result in one worker for every hardware thread.
+	*/
+	DistributedRenderer(RayTracer & rayTracer, FrameBuffer & frameBuffer, int workerCount = 0);
+
+	/**
+	* Renders every crop of the frame into the back color buffer.
+	* @param scene - snapshot of the scene
+	* @param cancelToken - optional token. Workers are killed if it is cancelled.
+	* @returns true if every crop was rendered, false if the frame was cancelled
+	*/
+	bool render(std::shared_ptr<const Scene> scene,
+		const CancellationToken * cancelToken = nullptr);
+
+	/**
+	* Sets the width and height in pixels of the square crop windows.
+	* @param cropSize - width and height of a crop in pixels
+	*/
+	void setCropSize(int cropSize) { this->cropSize = glm::max(cropSize, 1); }
+
+	/**
+	* Returns the number of crops that had to be re-issued during the most
+	* recent frame because the worker rendering them failed.
+	*/
+	int getReissuedCrops() const { return reissuedCrops; }
+
+	// Number of times a crop is handed to a worker before the coordinator
+	// renders it itself
+	int maxAttempts = 3;
+
+protected:
+
+	/**
+	* Divides the rendering window into crops of cropSize by cropSize pixels.
+	*/
+	std::vector<Tile> createCrops();
+
+	/**
+	* Renders a crop of the prepared frame in the calling process.
+	*/
+	void renderCropLocally(const Tile & crop);
+
+#ifndef _WIN32
+	/**
+	* Body of a worker process. Renders the crops of the prepared frame whose
+	* indices arrive on the socket and writes each index back once the crop
+	* is in the color buffer. Never returns.
+	* @param socket - connection to the coordinator
+	* @param crops - crops of the frame
+	*/
+	void workerMain(int socket, const std::vector<Tile> & crops);
+#endif
+
+	// Ray tracer used by the workers and for crops rendered locally
+	RayTracer & rayTracer;
+
+	// Shared memory frame buffer that rayTracer renders into
+	FrameBuffer & frameBuffer;
+
+	// Number of worker processes
+	int workerCount;
+
+	// Width and height of the crop windows
+	int cropSize = 64;
+
+	// Crops that were re-issued during the most recent frame
+	int reissuedCrops = 0;
+
+}; // end DistributedRenderer class
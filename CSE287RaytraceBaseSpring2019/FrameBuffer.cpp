@@ -1,9 +1,26 @@
 #include "FrameBuffer.h"
 
+#include <new>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+// Size of the smallest memory page on the supported platforms
+static const size_t PAGE_BYTES = 4096;
+
+// Size of a transparent huge page. Smaller allocations cannot use one.
+static const size_t HUGE_PAGE_BYTES = 2 * 1024 * 1024;
+
 /**
 * Constructor. Allocates memory for storing pixel values.
 */
 FrameBuffer::FrameBuffer(const int width, const int height)
+	: colorBuffers{ nullptr, nullptr }, frontBuffer(0), colorBuffer(nullptr),
+	sharedColorBuffers(false), colorBufferBytes(0), depthBuffer(nullptr),
+	allocationCount(0), hugePages(false)
 {
 	setFrameBufferSize(width, height);
 
@@ -15,9 +32,10 @@ FrameBuffer::FrameBuffer(const int width, const int height)
 */
 FrameBuffer::~FrameBuffer(void)
 {
-	// Free the memory associated with the color buffer
-	delete[] colorBuffer;
-	delete[] depthBuffer;
+	// Free the memory associated with the color buffers
+	freeColorBuffer(colorBuffers[0], colorBufferBytes);
+	freeColorBuffer(colorBuffers[1], colorBufferBytes);
+	freePrivateMemory(depthBuffer, colorBufferBytes);
 
 } // end FrameBuffer destructor
 
@@ -32,22 +50,219 @@ void FrameBuffer::setFrameBufferSize(const int width, const int height) {
 	window.width = width;
 	window.height = height;
 
-	// Set pixel storage modes. 
-	// (https://www.opengl.org/archives/resources/features/KilgardTechniques/oglpitfall/)
-	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
-	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	// Hold the display off while the buffers it reads are replaced
+	std::lock_guard<std::mutex> lock(presentMutex);
 
-	// Free the memory previously associated with the color buffer
-	delete[] colorBuffer;
-	delete[] depthBuffer;
+	// Free the memory previously associated with the color buffers
+	freeColorBuffer(colorBuffers[0], colorBufferBytes);
+	freeColorBuffer(colorBuffers[1], colorBufferBytes);
+	freePrivateMemory(depthBuffer, colorBufferBytes);
+
+	// Allocate the front and back color buffers to match the size of the window.
+	// Both start out cleared so a new front buffer never shows stale memory.
+	colorBufferBytes = (size_t)width*BYTES_PER_PIXEL*height;
+	hugePages = colorBufferBytes >= HUGE_PAGE_BYTES;
+	colorBuffers[0] = allocateColorBuffer(colorBufferBytes);
+	colorBuffers[1] = allocateColorBuffer(colorBufferBytes);
+
+	if (sharedColorBuffers && (colorBuffers[0] == nullptr || colorBuffers[1] == nullptr)) {
+
+		std::cerr << "Shared color buffer allocation failed. Using private memory." << std::endl;
+
+		freeColorBuffer(colorBuffers[0], colorBufferBytes);
+		freeColorBuffer(colorBuffers[1], colorBufferBytes);
+		sharedColorBuffers = false;
+		hugePages = colorBufferBytes >= HUGE_PAGE_BYTES;
+
+		colorBuffers[0] = allocateColorBuffer(colorBufferBytes);
+		colorBuffers[1] = allocateColorBuffer(colorBufferBytes);
+	}
 
-	// Allocate the color buffer to match the size of the window
-	colorBuffer = new GLubyte[width*BYTES_PER_PIXEL*height];
-	depthBuffer = new float[width*height];
+	// A float is as large as a pixel, so the depth buffer has the size of
+	// a color buffer
+	static_assert(sizeof(float) == BYTES_PER_PIXEL, "depth and color buffers differ in size");
+	depthBuffer = (float*)allocatePrivateMemory(colorBufferBytes);
+
+	// Fail as new would have rather than leave buffers that are drawn into
+	// unallocated
+	if (colorBufferBytes > 0 && (colorBuffers[0] == nullptr || colorBuffers[1] == nullptr || depthBuffer == nullptr)) {
+
+		std::cerr << "Private frame buffer allocation failed." << std::endl;
+		throw std::bad_alloc();
+	}
+
+	colorBuffer = colorBuffers[1 - frontBuffer];
+
+	allocationCount++;
 
 } // end setFrameBufferSize
 
 
+/**
+* Selects whether the color buffers are shared with child processes.
+*/
+void FrameBuffer::setSharedMemory(const bool shared)
+{
+	if (shared == sharedColorBuffers) {
+		return;
+	}
+
+	// Release the buffers with the allocator that created them before
+	// switching allocators
+	{
+		std::lock_guard<std::mutex> lock(presentMutex);
+
+		freeColorBuffer(colorBuffers[0], colorBufferBytes);
+		freeColorBuffer(colorBuffers[1], colorBufferBytes);
+		colorBuffers[0] = colorBuffers[1] = colorBuffer = nullptr;
+
+		sharedColorBuffers = shared;
+	}
+
+	setFrameBufferSize(window.width, window.height);
+
+} // end setSharedMemory
+
+
+bool FrameBuffer::usesSharedMemory() const
+{
+#ifdef _WIN32
+	return false;
+#else
+	return sharedColorBuffers;
+#endif
+
+} // end usesSharedMemory
+
+
+GLubyte* FrameBuffer::allocateColorBuffer(const size_t bytes)
+{
+#ifndef _WIN32
+	if (sharedColorBuffers) {
+
+		// Anonymous shared mappings are inherited by forked processes and
+		// start out filled with zeros
+		void * memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+
+		hugePages = false;
+
+		return (memory != MAP_FAILED) ? (GLubyte*)memory : nullptr;
+	}
+#endif
+
+	return (GLubyte*)allocatePrivateMemory(bytes);
+
+} // end allocateColorBuffer
+
+
+void FrameBuffer::freeColorBuffer(GLubyte* buffer, const size_t bytes)
+{
+	if (buffer == nullptr) {
+		return;
+	}
+
+#ifndef _WIN32
+	if (sharedColorBuffers) {
+		munmap(buffer, bytes);
+		return;
+	}
+#endif
+
+	freePrivateMemory(buffer, bytes);
+
+} // end freeColorBuffer
+
+
+void* FrameBuffer::allocatePrivateMemory(const size_t bytes)
+{
+	if (bytes == 0) {
+		return nullptr;
+	}
+
+#ifdef _WIN32
+	// Committed pages are cleared and placed when they are first written
+	void * memory = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+
+	hugePages = false;
+
+	return memory;
+#else
+	// Unlike new, mmap returns memory that has not been written to. The
+	// pages are filled with zeros when they are first touched.
+	void * memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+	if (memory == MAP_FAILED) {
+		hugePages = false;
+		return nullptr;
+	}
+
+#ifdef MADV_HUGEPAGE
+	if (bytes < HUGE_PAGE_BYTES || madvise(memory, bytes, MADV_HUGEPAGE) != 0) {
+		hugePages = false;
+	}
+#else
+	hugePages = false;
+#endif
+
+	return memory;
+#endif
+
+} // end allocatePrivateMemory
+
+
+void FrameBuffer::freePrivateMemory(void* memory, const size_t bytes)
+{
+	if (memory == nullptr) {
+		return;
+	}
+
+#ifdef _WIN32
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	munmap(memory, bytes);
+#endif
+
+} // end freePrivateMemory
+
+
+/**
+* Touches the pages that hold a band of rows.
+*/
+size_t FrameBuffer::touchRows(const int firstRow, const int lastRow)
+{
+	// Hold the display off so it never reads a byte while it is rewritten
+	std::lock_guard<std::mutex> lock(presentMutex);
+
+	size_t rowBytes = (size_t)window.width * BYTES_PER_PIXEL;
+	size_t start = (size_t)glm::clamp(firstRow, 0, window.height) * rowBytes;
+	size_t end = (size_t)glm::clamp(lastRow, 0, window.height) * rowBytes;
+
+	// The buffers start on page boundaries. Touch each page that starts in
+	// the band by writing back the value it holds.
+	size_t firstPage = (start + PAGE_BYTES - 1) / PAGE_BYTES * PAGE_BYTES;
+
+	GLubyte * buffers[] = { colorBuffers[0], colorBuffers[1], (GLubyte*)depthBuffer };
+	size_t touchedBytes = 0;
+
+	for (GLubyte * buffer : buffers) {
+
+		if (buffer == nullptr) {
+			continue;
+		}
+
+		for (size_t offset = firstPage; offset < end; offset += PAGE_BYTES) {
+
+			volatile GLubyte * page = buffer + offset;
+			*page = *page;
+			touchedBytes += glm::min(PAGE_BYTES, colorBufferBytes - offset);
+		}
+	}
+
+	return touchedBytes;
+
+} // end touchRows
+
+
 /**
 * Sets the color to which the window will be cleared. Does NOT
 * actually clear the window
@@ -85,11 +300,24 @@ void FrameBuffer::clearColorAndDepthBuffers() {
 */
 void FrameBuffer::showColorBuffer()
 {
+	// Set pixel storage modes. Done here rather than when the buffers are
+	// sized so that frame buffers can be created on threads without a
+	// rendering context.
+	// (https://www.opengl.org/archives/resources/features/KilgardTechniques/oglpitfall/)
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
 	// Insure raster position is lower left hand corner of the window. (OpenGL command)
 	glRasterPos2d(-1, -1);
 
-	// Copy color buffer to raster (Legacy OpenGL command)
-	glDrawPixels(window.width, window.height, GL_RGBA, GL_UNSIGNED_BYTE, colorBuffer);
+	{
+		// glDrawPixels is finished with the memory once it returns, so the
+		// buffers only need to stay put for the copy.
+		std::lock_guard<std::mutex> lock(presentMutex);
+
+		// Copy front color buffer to raster (Legacy OpenGL command)
+		glDrawPixels(window.width, window.height, GL_RGBA, GL_UNSIGNED_BYTE, colorBuffers[frontBuffer]);
+	}
 
 	// Flush all drawing commands and swapbuffers (Glut command)
 	glutSwapBuffers();
@@ -97,6 +325,19 @@ void FrameBuffer::showColorBuffer()
 } // end showFrameBuffer
 
 
+/**
+* Makes the back buffer the front buffer.
+*/
+void FrameBuffer::swapColorBuffers()
+{
+	std::lock_guard<std::mutex> lock(presentMutex);
+
+	colorBuffer = colorBuffers[frontBuffer];
+	frontBuffer = 1 - frontBuffer;
+
+} // end swapColorBuffers
+
+
 
 bool FrameBuffer::checkInWindow(const int & x, const int & y)
 {
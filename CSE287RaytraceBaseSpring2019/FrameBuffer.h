@@ -3,6 +3,9 @@
 #include "Defines.h"
 #include "Lights.h"
 
+#include <atomic>
+#include <mutex>
+
 
 /**
 * Preprocessor statement for text substitution
@@ -28,6 +31,17 @@ struct Window {
 	int height;
 };
 
+/**
+* Rectangular block of pixels in the rendering window. The pixel in the
+* lower left hand corner of the block is (x, y).
+*/
+struct Tile {
+	int x;
+	int y;
+	int width;
+	int height;
+};
+
 /**
 * Class which controls memory that stores a color value for every pixel
 * in a rendering window with a specified width and height. setBufferSize
@@ -35,6 +49,12 @@ struct Window {
 * clearColorBuffer to the color that is specifed using setClearColor.
 * showColorBuffer copies the memory into the color buffer for display
 * by the graphics card.
+*
+* The color memory is double buffered. setPixel, getPixel, and
+* clearColorAndDepthBuffers work on the back buffer while showColorBuffer
+* displays the front buffer, so a frame can be rendered while the previous
+* one is displayed. swapColorBuffers hands a finished back buffer to the
+* display.
 */
 class FrameBuffer
 {
@@ -62,6 +82,49 @@ public:
 	*/
 	void setFrameBufferSize(const int width, const int height);
 
+	/**
+	* Selects whether the color buffers are allocated in memory that is
+	* shared with child processes created by fork. Pixels set by a child
+	* are then visible to the parent. Reallocates the color buffers. Has
+	* no effect on Windows.
+	*
+	* @param shared - true to allocate shared color buffers
+	*/
+	void setSharedMemory(const bool shared);
+
+	/**
+	* Returns true if the color buffers are shared with child processes.
+	* False if shared memory was not requested, could not be allocated, or
+	* is not supported, as on Windows.
+	*/
+	bool usesSharedMemory() const;
+
+	/**
+	* Writes to the memory pages that hold rows of the color and depth
+	* buffers for the first time. Pages are placed next to the core of the
+	* thread that first writes to them, so each thread that renders a band
+	* of rows should touch it before anything else does. Pages that start
+	* before firstRow are left to the thread that touches the row above.
+	*
+	* @param firstRow - lowest row to touch
+	* @param lastRow - row above the highest row to touch
+	* @return number of bytes in the pages that were touched
+	*/
+	size_t touchRows(const int firstRow, const int lastRow);
+
+	/**
+	* Returns a number that changes every time the buffers are reallocated,
+	* so that callers can tell when the memory has to be touched again.
+	*/
+	unsigned int getAllocationCount() const { return allocationCount; }
+
+	/**
+	* Returns true if the operating system accepted the request to back
+	* every private buffer with transparent huge pages. Buffers shared with
+	* child processes are never backed by huge pages.
+	*/
+	bool usesHugePages() const { return hugePages; }
+
 	/**
 	* Sets the color to which the window will be cleared. Does NOT
 	* actually clear the window
@@ -74,11 +137,18 @@ public:
 	void clearColorAndDepthBuffers();
 
 	/**
-	* Copies memory into frame buffer and updates the window
+	* Copies the front buffer into frame buffer and updates the window
 	* using an OpenGL command.
 	*/
 	void showColorBuffer();
 
+	/**
+	* Makes the back buffer the front buffer so that it is displayed by the
+	* next call to showColorBuffer. The previous front buffer becomes the back
+	* buffer. Waits if showColorBuffer is copying the front buffer.
+	*/
+	void swapColorBuffers();
+
 	/**
 	* Returns the width of the rendering window in pixels
 	* @ return width of the rendering window
@@ -155,6 +225,37 @@ public:
 	*/
 	inline bool checkInWindow(const int & x, const int & y);
 
+	/**
+	* Allocates cleared memory for one color buffer, shared between
+	* processes if sharedColorBuffers is true.
+	* @param bytes - size of the buffer
+	* @ return the memory or nullptr if shared memory is not available
+	*/
+	GLubyte* allocateColorBuffer(const size_t bytes);
+
+	/**
+	* Frees memory returned by allocateColorBuffer.
+	* @param buffer - memory to free. May be nullptr.
+	* @param bytes - size that was allocated
+	*/
+	void freeColorBuffer(GLubyte* buffer, const size_t bytes);
+
+	/**
+	* Allocates cleared memory that is private to the process. Pages are
+	* not touched, so they are placed when they are first written. Large
+	* allocations are backed by transparent huge pages where available.
+	* @param bytes - size of the memory
+	* @ return the memory or nullptr if the allocation failed
+	*/
+	void* allocatePrivateMemory(const size_t bytes);
+
+	/**
+	* Frees memory returned by allocatePrivateMemory.
+	* @param memory - memory to free. May be nullptr.
+	* @param bytes - size that was allocated
+	*/
+	void freePrivateMemory(void* memory, const size_t bytes);
+
 	/**
 	* Struct that maintains the width and height of the rendering window
 	*/
@@ -166,14 +267,52 @@ public:
 	GLubyte clearColor[BYTES_PER_PIXEL];
 
 	/**
-	* Storage for red, green, blue, alpha color values
+	* Storage for red, green, blue, alpha color values of the front and
+	* back buffers
+	*/
+	GLubyte* colorBuffers[2];
+
+	/**
+	* Index in colorBuffers of the buffer that is displayed
+	*/
+	std::atomic<int> frontBuffer;
+
+	/**
+	* Storage for red, green, blue, alpha color values of the back buffer,
+	* which is the one that is rendered into
 	*/
 	GLubyte* colorBuffer;
 
+	/**
+	* Held while the front buffer is copied for display and while the
+	* buffers are swapped
+	*/
+	std::mutex presentMutex;
+
+	/**
+	* True if the color buffers are shared with child processes
+	*/
+	bool sharedColorBuffers;
+
+	/**
+	* Size in bytes of each of the color buffers
+	*/
+	size_t colorBufferBytes;
+
 	/*
 	* Storage for fragment depth values
 	*/
 	float* depthBuffer;
 
+	/**
+	* Incremented every time the buffers are reallocated
+	*/
+	unsigned int allocationCount;
+
+	/**
+	* True if every private buffer was advised to use huge pages
+	*/
+	bool hugePages;
+
 }; // end FrameBuffer class
 
@@ -0,0 +1,533 @@
+#include "GridAccelerator.h"
+
+#include <functional>
+#include <limits>
+#include <sstream>
+
+// Grids over fewer surfaces are filled on the calling thread
+static const int PARALLEL_SURFACE_COUNT = 16384;
+
+
+/**
+* Calls a function for every task index, on the thread pool if there is
+* one and more than one task.
+*/
+static void runTasks(ThreadPool * threadPool, int taskCount, const std::function<void(int task)> & body)
+{
+	if (threadPool == nullptr || taskCount <= 1) {
+		for (int task = 0; task < taskCount; task++) {
+			body(task);
+		}
+		return;
+	}
+
+	TaskGroup tasks;
+
+	for (int task = 0; task < taskCount; task++) {
+		threadPool->submit([&body, task] { body(task); }, tasks);
+	}
+
+	threadPool->wait(tasks);
+
+} // end runTasks
+
+
+/**
+* Finds the range of cells of a grid along each axis that a box overlaps.
+*/
+static void getCellRange(const AABB & gridBounds, const int resolution[3], const dvec3 & cellSize,
+	const AABB & box, int low[3], int high[3])
+{
+	for (int axis = 0; axis < 3; axis++) {
+
+		low[axis] = (int)glm::floor((box.minimum[axis] - gridBounds.minimum[axis]) / cellSize[axis]);
+		high[axis] = (int)glm::floor((box.maximum[axis] - gridBounds.minimum[axis]) / cellSize[axis]);
+
+		low[axis] = glm::clamp(low[axis], 0, resolution[axis] - 1);
+		high[axis] = glm::clamp(high[axis], 0, resolution[axis] - 1);
+	}
+
+} // end getCellRange
+
+
+GridAccelerator::GridAccelerator(bool twoLevel)
+	: twoLevel(twoLevel), counters(new TraversalCounter[COUNTER_COUNT](), std::default_delete<TraversalCounter[]>())
+{
+
+} // end GridAccelerator constructor
+
+
+double GridAccelerator::getCost() const
+{
+	double cost = INTERSECTION_COST * unboundedSurfaces.size();
+
+	if (grid.cellStart.empty()) {
+		return cost;
+	}
+
+	return cost + getGridCost(grid);
+
+} // end getCost
+
+
+double GridAccelerator::getGridCost(const Grid & grid) const
+{
+	// A cell is priced like a leaf of a tree whose root is the box of the
+	// grid, plus a traversal step to get to it
+	double gridArea = grid.bounds.getSurfaceArea();
+	AABB cell(dvec3(0.0), grid.cellSize);
+	double probability = (gridArea > 0.0) ? cell.getSurfaceArea() / gridArea : 1.0;
+	double cost = 0.0;
+
+	for (int index = 0; index + 1 < (int)grid.cellStart.size(); index++) {
+
+		cost += TRAVERSAL_COST * probability;
+
+		if (grid.cellSubgrid.empty() == false && grid.cellSubgrid[index] >= 0) {
+			cost += probability * getGridCost(subgrids[grid.cellSubgrid[index]]);
+		}
+		else {
+			cost += INTERSECTION_COST * probability * (grid.cellStart[index + 1] - grid.cellStart[index]);
+		}
+	}
+
+	return cost;
+
+} // end getGridCost
+
+
+size_t GridAccelerator::getMemoryBytes() const
+{
+	size_t bytes = Accelerator::getMemoryBytes() + subgrids.capacity() * sizeof(Grid) +
+		COUNTER_COUNT * sizeof(TraversalCounter);
+
+	bytes += (grid.cellStart.capacity() + grid.cellSurfaces.capacity() + grid.cellSubgrid.capacity()) * sizeof(int);
+
+	for (const Grid & subgrid : subgrids) {
+		bytes += (subgrid.cellStart.capacity() + subgrid.cellSurfaces.capacity()) * sizeof(int);
+	}
+
+	return bytes;
+
+} // end getMemoryBytes
+
+
+std::string GridAccelerator::getStatistics() const
+{
+	int cellCount = (int)grid.cellStart.size() - 1;
+	int emptyCells = 0;
+	int subgridCells = 0;
+
+	for (int index = 0; index < cellCount; index++) {
+		if (grid.cellStart[index + 1] == grid.cellStart[index]) {
+			emptyCells++;
+		}
+	}
+
+	for (const Grid & subgrid : subgrids) {
+
+		subgridCells += (int)subgrid.cellStart.size() - 1;
+
+		for (int index = 0; index + 1 < (int)subgrid.cellStart.size(); index++) {
+			if (subgrid.cellStart[index + 1] == subgrid.cellStart[index]) {
+				emptyCells++;
+			}
+		}
+	}
+
+	size_t references = grid.cellSurfaces.size();
+	for (const Grid & subgrid : subgrids) {
+		references += subgrid.cellSurfaces.size();
+	}
+
+	uint64_t rays = 0;
+	uint64_t cells = 0;
+	uint64_t surfaceTests = 0;
+
+	for (int i = 0; i < COUNTER_COUNT; i++) {
+		rays += counters.get()[i].rays.load(std::memory_order_relaxed);
+		cells += counters.get()[i].cells.load(std::memory_order_relaxed);
+		surfaceTests += counters.get()[i].surfaces.load(std::memory_order_relaxed);
+	}
+
+	std::ostringstream statistics;
+	statistics << grid.resolution[0] << "x" << grid.resolution[1] << "x" << grid.resolution[2] << " cells";
+
+	if (twoLevel) {
+		statistics << ", " << subgrids.size() << " subgrids of " << subgridCells << " cells";
+	}
+
+	int totalCells = glm::max(cellCount + subgridCells, 1);
+	int filledCells = glm::max(totalCells - emptyCells, 1);
+
+	statistics << ", " << 100 * emptyCells / totalCells << "% empty, "
+		<< (double)references / filledCells << " surfaces per filled cell";
+
+	if (rays > 0) {
+		statistics << ", " << (double)cells / rays << " cells and " << (double)surfaceTests / rays
+			<< " surfaces per ray over " << rays << " rays";
+	}
+
+	return statistics.str();
+
+} // end getStatistics
+
+
+void GridAccelerator::buildStructure(std::vector<Primitive> & primitives, ThreadPool * threadPool)
+{
+	std::vector<AABB> surfaceBounds(surfaces.size());
+
+	for (const Primitive & primitive : primitives) {
+		surfaceBounds[primitive.surface] = primitive.bounds;
+	}
+
+	buildGrids(surfaceBounds, threadPool);
+
+} // end buildStructure
+
+
+void GridAccelerator::refitStructure(const std::vector<AABB> & bounds, ThreadPool * threadPool)
+{
+	// Listing the surfaces in the cells again is as fast as moving them
+	// between cells
+	buildGrids(bounds, threadPool);
+
+} // end refitStructure
+
+
+void GridAccelerator::buildGrids(const std::vector<AABB> & surfaceBounds, ThreadPool * threadPool)
+{
+	grid = Grid();
+	subgrids.clear();
+
+	if (boundedSurfaces.empty()) {
+		return;
+	}
+
+	// Crowded cells of a two level grid are divided further, so the top grid
+	// is coarser
+	buildGrid(grid, bounds, boundedSurfaces, surfaceBounds, twoLevel ? 0.125 * density : density, threadPool);
+
+	if (twoLevel == false) {
+		return;
+	}
+
+	int cellCount = (int)grid.cellStart.size() - 1;
+	grid.cellSubgrid.assign(cellCount, -1);
+
+	// Number the crowded cells, then build their grids in ranges side by side
+	std::vector<int> crowdedCells;
+
+	for (int index = 0; index < cellCount; index++) {
+
+		if (grid.cellStart[index + 1] - grid.cellStart[index] > subgridThreshold) {
+			grid.cellSubgrid[index] = (int)crowdedCells.size();
+			crowdedCells.push_back(index);
+		}
+	}
+
+	int subgridCount = (int)crowdedCells.size();
+	int taskCount = (threadPool != nullptr && (int)boundedSurfaces.size() >= PARALLEL_SURFACE_COUNT) ?
+		glm::min(4 * threadPool->getThreadCount(), subgridCount) : 1;
+
+	subgrids.resize(subgridCount);
+
+	runTasks(threadPool, taskCount, [&](int task) {
+
+		int first = (int)((long long)subgridCount * task / taskCount);
+		int last = (int)((long long)subgridCount * (task + 1) / taskCount);
+
+		for (int subgrid = first; subgrid < last; subgrid++) {
+
+			int index = crowdedCells[subgrid];
+			int begin = grid.cellStart[index];
+			int end = grid.cellStart[index + 1];
+
+			int x = index % grid.resolution[0];
+			int y = (index / grid.resolution[0]) % grid.resolution[1];
+			int z = index / (grid.resolution[0] * grid.resolution[1]);
+
+			dvec3 minimum = grid.bounds.minimum + dvec3(x, y, z) * grid.cellSize;
+			AABB cellBounds(minimum, minimum + grid.cellSize);
+
+			std::vector<int> cellSurfaces(grid.cellSurfaces.begin() + begin, grid.cellSurfaces.begin() + end);
+
+			buildGrid(subgrids[subgrid], cellBounds, cellSurfaces, surfaceBounds, density, nullptr);
+		}
+	});
+
+} // end buildGrids
+
+
+void GridAccelerator::buildGrid(Grid & grid, const AABB & box, const std::vector<int> & surfaceList,
+	const std::vector<AABB> & surfaceBounds, double cellDensity, ThreadPool * threadPool)
+{
+	grid.bounds = box;
+
+	// Cells are close to cubes and there are about cellDensity of them per
+	// surface. Flat boxes are given a little depth so their volume is not zero.
+	dvec3 extent = box.maximum - box.minimum;
+	double largest = glm::max(extent.x, glm::max(extent.y, extent.z));
+	dvec3 depth = glm::max(extent, dvec3(1e-3 * largest));
+	double cellsPerUnit = std::cbrt(cellDensity * surfaceList.size() / (depth.x * depth.y * depth.z));
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		int resolution = (int)glm::ceil(extent[axis] * cellsPerUnit);
+		grid.resolution[axis] = glm::clamp(resolution, 1, maxResolution);
+		grid.cellSize[axis] = (extent[axis] > 0.0) ? extent[axis] / grid.resolution[axis] : 1.0;
+	}
+
+	int cellCount = grid.resolution[0] * grid.resolution[1] * grid.resolution[2];
+	grid.cellStart.assign(cellCount + 1, 0);
+
+	int surfaceCount = (int)surfaceList.size();
+
+	if (threadPool == nullptr || surfaceCount < PARALLEL_SURFACE_COUNT) {
+		threadPool = nullptr;
+	}
+
+	// Each task takes a range of surfaces or a slab of layers of cells
+	int taskCount = (threadPool != nullptr) ? 4 * threadPool->getThreadCount() : 1;
+	int slabCount = glm::min(taskCount, grid.resolution[2]);
+	int layerCells = grid.resolution[0] * grid.resolution[1];
+
+	// Low x, y, and z and high x, y, and z cell of every surface
+	std::vector<int> ranges(6 * (size_t)surfaceCount);
+
+	runTasks(threadPool, taskCount, [&](int task) {
+
+		int begin = (int)((long long)surfaceCount * task / taskCount);
+		int end = (int)((long long)surfaceCount * (task + 1) / taskCount);
+
+		for (int i = begin; i < end; i++) {
+			int * range = &ranges[6 * (size_t)i];
+			getCellRange(grid.bounds, grid.resolution, grid.cellSize, surfaceBounds[surfaceList[i]], range, range + 3);
+		}
+	});
+
+	// Count the surfaces of each cell, then list them in a second pass at the
+	// offsets that the counts add up to. A slab only writes its own cells.
+	auto forEachCell = [&](int slab, auto visit) {
+
+		int firstLayer = (int)((long long)grid.resolution[2] * slab / slabCount);
+		int lastLayer = (int)((long long)grid.resolution[2] * (slab + 1) / slabCount) - 1;
+
+		for (int i = 0; i < surfaceCount; i++) {
+
+			const int * range = &ranges[6 * (size_t)i];
+
+			for (int z = glm::max(range[2], firstLayer); z <= glm::min(range[5], lastLayer); z++) {
+				for (int y = range[1]; y <= range[4]; y++) {
+					for (int x = range[0]; x <= range[3]; x++) {
+						visit(surfaceList[i], z * layerCells + y * grid.resolution[0] + x);
+					}
+				}
+			}
+		}
+	};
+
+	runTasks(threadPool, slabCount, [&](int slab) {
+		forEachCell(slab, [&grid](int, int cell) { grid.cellStart[cell + 1]++; });
+	});
+
+	for (int index = 0; index < cellCount; index++) {
+		grid.cellStart[index + 1] += grid.cellStart[index];
+	}
+
+	grid.cellSurfaces.resize(grid.cellStart[cellCount]);
+	std::vector<int> next(grid.cellStart.begin(), grid.cellStart.end() - 1);
+
+	runTasks(threadPool, slabCount, [&](int slab) {
+		forEachCell(slab, [&grid, &next](int surface, int cell) { grid.cellSurfaces[next[cell]++] = surface; });
+	});
+
+} // end buildGrid
+
+
+void GridAccelerator::traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const
+{
+	if (grid.cellStart.empty()) {
+		return;
+	}
+
+	dvec3 inverseDirection = 1.0 / ray.direct;
+	uint64_t cellCount = 0;
+	uint64_t surfaceCount = 0;
+
+	traverseGrid(grid, ray, inverseDirection, 0.0, closestHit, closestSurface, cellCount, surfaceCount);
+
+	TraversalCounter & counter = getCounter();
+	counter.rays.fetch_add(1, std::memory_order_relaxed);
+	counter.cells.fetch_add(cellCount, std::memory_order_relaxed);
+	counter.surfaces.fetch_add(surfaceCount, std::memory_order_relaxed);
+
+} // end traverse
+
+
+int GridAccelerator::traverseOccluded(const Ray & ray, double maxDistance) const
+{
+	if (grid.cellStart.empty()) {
+		return -1;
+	}
+
+	dvec3 inverseDirection = 1.0 / ray.direct;
+	uint64_t cellCount = 0;
+	uint64_t surfaceCount = 0;
+	int occluder = -1;
+
+	traverseOccludedGrid(grid, ray, inverseDirection, 0.0, maxDistance, occluder, cellCount, surfaceCount);
+
+	TraversalCounter & counter = getCounter();
+	counter.rays.fetch_add(1, std::memory_order_relaxed);
+	counter.cells.fetch_add(cellCount, std::memory_order_relaxed);
+	counter.surfaces.fetch_add(surfaceCount, std::memory_order_relaxed);
+
+	return occluder;
+
+} // end traverseOccluded
+
+
+template <typename VisitCell>
+bool GridAccelerator::walkGrid(const Grid & grid, const Ray & ray, const dvec3 & inverseDirection,
+	double minDistance, const double & maxDistance, VisitCell visitCell) const
+{
+	double entry;
+
+	if (grid.bounds.intersect(ray.origin, inverseDirection, maxDistance, entry) == false) {
+		return false;
+	}
+
+	entry = glm::max(entry, minDistance);
+	dvec3 point = ray.origin + entry * ray.direct;
+
+	// Cell the ray enters the grid in, the direction it steps in along each
+	// axis, the distance at which it crosses into the next cell along each
+	// axis, and the distance between crossings along each axis
+	int cell[3];
+	int step[3];
+	double crossing[3];
+	double spacing[3];
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		int index = (int)glm::floor((point[axis] - grid.bounds.minimum[axis]) / grid.cellSize[axis]);
+		cell[axis] = glm::clamp(index, 0, grid.resolution[axis] - 1);
+
+		// A ray parallel to the slabs never crosses them. Checked first since
+		// tiny components have an infinite inverse.
+		if (std::isinf(inverseDirection[axis])) {
+			step[axis] = 0;
+			crossing[axis] = std::numeric_limits<double>::infinity();
+			spacing[axis] = 0.0;
+		}
+		else if (ray.direct[axis] > 0.0) {
+			step[axis] = 1;
+			crossing[axis] = (grid.bounds.minimum[axis] + (cell[axis] + 1) * grid.cellSize[axis] - ray.origin[axis]) * inverseDirection[axis];
+			spacing[axis] = grid.cellSize[axis] * inverseDirection[axis];
+		}
+		else {
+			step[axis] = -1;
+			crossing[axis] = (grid.bounds.minimum[axis] + cell[axis] * grid.cellSize[axis] - ray.origin[axis]) * inverseDirection[axis];
+			spacing[axis] = -grid.cellSize[axis] * inverseDirection[axis];
+		}
+	}
+
+	double cellEntry = entry;
+
+	while (true) {
+
+		int axis = (crossing[0] < crossing[1]) ? (crossing[0] < crossing[2] ? 0 : 2) : (crossing[1] < crossing[2] ? 1 : 2);
+		double cellExit = crossing[axis];
+
+		if (visitCell((cell[2] * grid.resolution[1] + cell[1]) * grid.resolution[0] + cell[0], cellEntry)) {
+			return true;
+		}
+
+		// Cells farther along are entered past the range, which is where the
+		// closest hit so far is. A hit exactly on the boundary may be tied by
+		// a surface of the next cell that comes earlier in the list, so that
+		// cell is still visited.
+		if (maxDistance < cellExit) {
+			break;
+		}
+
+		cell[axis] += step[axis];
+
+		if (step[axis] == 0 || cell[axis] < 0 || cell[axis] >= grid.resolution[axis]) {
+			break;
+		}
+
+		cellEntry = cellExit;
+		crossing[axis] += spacing[axis];
+	}
+
+	return false;
+
+} // end walkGrid
+
+
+void GridAccelerator::traverseGrid(const Grid & grid, const Ray & ray, const dvec3 & inverseDirection,
+	double minDistance, HitRecord & closestHit, int & closestSurface, uint64_t & cellCount,
+	uint64_t & surfaceCount) const
+{
+	// The range follows closestHit.t as hits are found
+	walkGrid(grid, ray, inverseDirection, minDistance, closestHit.t, [&](int index, double cellEntry) {
+
+		cellCount++;
+
+		if (grid.cellSubgrid.empty() == false && grid.cellSubgrid[index] >= 0) {
+
+			traverseGrid(subgrids[grid.cellSubgrid[index]], ray, inverseDirection, cellEntry,
+				closestHit, closestSurface, cellCount, surfaceCount);
+			return false;
+		}
+
+		for (int i = grid.cellStart[index]; i < grid.cellStart[index + 1]; i++) {
+			testSurface(ray, grid.cellSurfaces[i], closestHit, closestSurface);
+		}
+		surfaceCount += grid.cellStart[index + 1] - grid.cellStart[index];
+
+		return false;
+	});
+
+} // end traverseGrid
+
+
+bool GridAccelerator::traverseOccludedGrid(const Grid & grid, const Ray & ray, const dvec3 & inverseDirection,
+	double minDistance, double maxDistance, int & occluder, uint64_t & cellCount, uint64_t & surfaceCount) const
+{
+	return walkGrid(grid, ray, inverseDirection, minDistance, maxDistance, [&](int index, double cellEntry) {
+
+		cellCount++;
+
+		if (grid.cellSubgrid.empty() == false && grid.cellSubgrid[index] >= 0) {
+			return traverseOccludedGrid(subgrids[grid.cellSubgrid[index]], ray, inverseDirection, cellEntry,
+				maxDistance, occluder, cellCount, surfaceCount);
+		}
+
+		for (int i = grid.cellStart[index]; i < grid.cellStart[index + 1]; i++) {
+
+			surfaceCount++;
+
+			if (surfaces[grid.cellSurfaces[i]]->isOccluding(ray, maxDistance)) {
+				occluder = grid.cellSurfaces[i];
+				return true;
+			}
+		}
+
+		return false;
+	});
+
+} // end traverseOccludedGrid
+
+
+GridAccelerator::TraversalCounter & GridAccelerator::getCounter() const
+{
+	// Threads take counters in turn when they first trace a ray
+	static std::atomic<int> nextCounter(0);
+	static thread_local int counterIndex = nextCounter++ % COUNTER_COUNT;
+
+	return counters.get()[counterIndex];
+
+} // end getCounter
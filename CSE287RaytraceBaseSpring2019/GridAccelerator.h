@@ -0,0 +1,186 @@
+#pragma once
+
+#include "Accelerator.h"
+
+#include <atomic>
+#include <string>
+
+/**
+* Accelerator that divides the box of the scene into a grid of equal
+* cells and lists in each cell the surfaces whose boxes overlap it. A ray
+* walks the cells it passes through in order with a 3D digital
+* differential analyzer (3D-DDA) and stops after the cell that contains
+* the closest hit found so far. The number of cells grows with the number
+* of surfaces, so a cell of an evenly filled scene holds a few surfaces.
+*
+* Grids build in one pass over the surfaces and are fast to traverse when
+* the surfaces are spread evenly, as in a field of particles, but waste
+* cells on empty space and pile surfaces into the cells of dense clusters.
+* The two level grid is coarser and gives each crowded cell a grid of its
+* own, which adapts to clusters at the cost of a second walk.
+*
+* A refit lists the surfaces in the cells again, which is as fast as the
+* build. Large grids are filled by slabs of cells on the thread pool, and
+* the grids of crowded cells are built as separate tasks. Counts of the cells visited and surfaces tested by every ray are
+* kept for getStatistics.
+*/
+class GridAccelerator : public Accelerator
+{
+public:
+
+	/**
+	* Constructor.
+	* @param twoLevel - true to give crowded cells a grid of their own
+	*/
+	GridAccelerator(bool twoLevel = false);
+
+	virtual AcceleratorType getType() const { return twoLevel ? AcceleratorType::TWO_LEVEL_GRID : AcceleratorType::GRID; }
+
+	virtual const char * getName() const { return twoLevel ? "two-level grid" : "uniform grid"; }
+
+	virtual double getCost() const;
+
+	virtual size_t getMemoryBytes() const;
+
+	virtual std::string getStatistics() const;
+
+	// Number of cells per bounded surface
+	double density = 2.0;
+
+	// Largest number of cells along an axis of a grid
+	int maxResolution = 256;
+
+	// Cells of the top grid of a two level grid with more surfaces get a
+	// grid of their own
+	int subgridThreshold = 16;
+
+protected:
+
+	/**
+	* Grid of cells. Each cell lists the indices in surfaces of the surfaces
+	* that overlap it, in list order.
+	*/
+	struct Grid
+	{
+		// Box divided into cells
+		AABB bounds;
+
+		// Number of cells along each axis
+		int resolution[3];
+
+		// Size of a cell
+		dvec3 cellSize;
+
+		// Index in cellSurfaces of the first surface of each cell. Has one
+		// more entry than there are cells.
+		std::vector<int> cellStart;
+
+		// Surfaces of the cells, cell by cell
+		std::vector<int> cellSurfaces;
+
+		// Index in subgrids of the grid of each cell, or -1. Empty if no cell
+		// has a grid.
+		std::vector<int> cellSubgrid;
+	};
+
+	/**
+	* Counts of the work done by rays, added to by one thread each.
+	*/
+	struct TraversalCounter
+	{
+		std::atomic<uint64_t> rays;
+		std::atomic<uint64_t> cells;
+		std::atomic<uint64_t> surfaces;
+
+		// Keeps counters of different threads out of each other's cache line
+		char padding[40];
+	};
+
+	virtual void buildStructure(std::vector<Primitive> & primitives, ThreadPool * threadPool);
+
+	virtual void refitStructure(const std::vector<AABB> & bounds, ThreadPool * threadPool);
+
+	virtual std::shared_ptr<Accelerator> clone() const { return std::make_shared<GridAccelerator>(*this); }
+
+	virtual void traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const;
+
+	virtual int traverseOccluded(const Ray & ray, double maxDistance) const;
+
+	/**
+	* Builds the grids over the bounded surfaces.
+	* @param bounds - padded box of each surface, indexed like surfaces
+	* @param threadPool - pool for the parallel parts of the build, or nullptr
+	*/
+	void buildGrids(const std::vector<AABB> & bounds, ThreadPool * threadPool);
+
+	/**
+	* Divides a box into cells and lists the surfaces that overlap each.
+	* Long lists are split into slabs of cells that are filled as separate
+	* tasks. Every slab walks the surfaces in list order, so the cells are
+	* the same as those of a serial build.
+	* @param surfaceList - surfaces to list, in list order
+	* @param cellDensity - number of cells per surface
+	* @param threadPool - pool that fills the slabs, or nullptr
+	*/
+	void buildGrid(Grid & grid, const AABB & box, const std::vector<int> & surfaceList,
+		const std::vector<AABB> & bounds, double cellDensity, ThreadPool * threadPool);
+
+	/**
+	* Walks a ray through the cells of a grid in order until it leaves the
+	* grid or passes maxDistance.
+	* @param minDistance - distance along the ray at which the walk starts
+	* @param maxDistance - end of the range. Read again after every cell, so
+	* it may refer to a distance that visitCell shortens.
+	* @param visitCell - called with the index and entry distance of each
+	* cell. Returns true to stop the walk.
+	* @returns true if visitCell stopped the walk
+	*/
+	template <typename VisitCell>
+	bool walkGrid(const Grid & grid, const Ray & ray, const dvec3 & inverseDirection, double minDistance,
+		const double & maxDistance, VisitCell visitCell) const;
+
+	/**
+	* Walks a ray through the cells of a grid and tests it against their
+	* surfaces until it leaves the grid or passes the closest hit.
+	* @param minDistance - distance along the ray at which the walk starts
+	* @param cellCount - incremented for every cell visited
+	* @param surfaceCount - incremented for every surface tested
+	*/
+	void traverseGrid(const Grid & grid, const Ray & ray, const dvec3 & inverseDirection, double minDistance,
+		HitRecord & closestHit, int & closestSurface, uint64_t & cellCount, uint64_t & surfaceCount) const;
+
+	/**
+	* Walks a ray through the cells of a grid until it finds a surface that
+	* it intersects closer than maxDistance.
+	* @param occluder - set to the index in surfaces of the surface found
+	* @returns true if a surface was found
+	*/
+	bool traverseOccludedGrid(const Grid & grid, const Ray & ray, const dvec3 & inverseDirection, double minDistance,
+		double maxDistance, int & occluder, uint64_t & cellCount, uint64_t & surfaceCount) const;
+
+	/**
+	* Returns the SAH cost of the cells of a grid relative to its box.
+	*/
+	double getGridCost(const Grid & grid) const;
+
+	/**
+	* Returns the counter of the calling thread.
+	*/
+	TraversalCounter & getCounter() const;
+
+	// True to give crowded cells a grid of their own
+	bool twoLevel;
+
+	// Grid over the bounded surfaces
+	Grid grid;
+
+	// Grids of the crowded cells of grid
+	std::vector<Grid> subgrids;
+
+	// Number of counters that threads share in turn
+	static const int COUNTER_COUNT = 64;
+
+	// Counts of the work done by rays. Shared by copies.
+	std::shared_ptr<TraversalCounter> counters;
+
+}; // end GridAccelerator class
@@ -0,0 +1,101 @@
+#include "Instance.h"
+
+
+Instance::Instance(std::shared_ptr<const Accelerator> object, const dmat4 & transform)
+	: Surface(WHITE), object(object)
+{
+	setTransform(transform);
+
+} // end Instance constructor
+
+
+std::shared_ptr<const Accelerator> Instance::createObject(const SurfaceVector & surfaces, AcceleratorType type)
+{
+	std::shared_ptr<Accelerator> object = Accelerator::create(type);
+	object->build(surfaces);
+
+	return object;
+
+} // end createObject
+
+
+void Instance::setTransform(const dmat4 & transform)
+{
+	this->transform = transform;
+	inverseTransform = glm::inverse(transform);
+	normalMatrix = glm::transpose(dmat3(inverseTransform));
+
+} // end setTransform
+
+
+/*
+* Checks a ray for intersection with the object. Finds the closest point of intersection
+* if one exits. Returns a HitRecord with the t parmeter set to FLT_MAX if there is no
+* intersection.
+*/
+HitRecord Instance::findClosestIntersection(const Ray & ray)
+{
+	// The Ray constructor normalizes the direction in object coordinates, so
+	// distances along the object ray are those along the world ray times
+	// the length the direction had before it was normalized
+	dvec3 objectDirection = dvec3(inverseTransform * dvec4(ray.direct, 0.0));
+	double scale = glm::length(objectDirection);
+
+	Ray objectRay(dvec3(inverseTransform * dvec4(ray.origin, 1.0)), objectDirection);
+
+	HitRecord hitRecord = object->findClosestIntersection(objectRay);
+
+	if (hitRecord.t < FLT_MAX) {
+
+		hitRecord.t /= scale;
+		hitRecord.interceptPoint = ray.origin + hitRecord.t * ray.direct;
+
+		// Facing is kept. The normal faced the object ray, so it faces the ray.
+		hitRecord.surfaceNormal = glm::normalize(normalMatrix * hitRecord.surfaceNormal);
+	}
+
+	return hitRecord;
+
+} // end findClosestIntersection
+
+
+bool Instance::isOccluding(const Ray & ray, double maxDistance)
+{
+	dvec3 objectDirection = dvec3(inverseTransform * dvec4(ray.direct, 0.0));
+	double scale = glm::length(objectDirection);
+
+	Ray objectRay(dvec3(inverseTransform * dvec4(ray.origin, 1.0)), objectDirection);
+
+	// Misses are at FLT_MAX in either space, so the range is not scaled past it
+	return object->isOccluded(objectRay, glm::min(maxDistance * scale, (double)FLT_MAX));
+
+} // end isOccluding
+
+
+bool Instance::getBoundingBox(AABB & box) const
+{
+	AABB objectBox;
+
+	if (object->getBoundingBox(objectBox) == false) {
+		return false;
+	}
+
+	box = AABB();
+
+	// An empty object stays empty
+	if (objectBox.isEmpty()) {
+		return true;
+	}
+
+	for (int corner = 0; corner < 8; corner++) {
+
+		dvec3 point((corner & 1) ? objectBox.maximum.x : objectBox.minimum.x,
+			(corner & 2) ? objectBox.maximum.y : objectBox.minimum.y,
+			(corner & 4) ? objectBox.maximum.z : objectBox.minimum.z);
+
+		box.expand(dvec3(transform * dvec4(point, 1.0)));
+	}
+
+	return true;
+
+} // end getBoundingBox
@@ -0,0 +1,86 @@
+#pragma once
+
+#include "Surface.h"
+#include "Accelerator.h"
+
+/**
+* Sub-class of Surface that places a copy of shared geometry in the scene.
+* The geometry is a list of surfaces in object coordinates with an
+* Accelerator built over it once. Every instance points at the same
+* accelerator and adds only a transformation, so memory grows with the
+* number of distinct objects rather than with the number of copies.
+*
+* The accelerator of the scene is built over the instances like over any
+* other bounded surface, which makes the pair a two level structure. Rays
+* that reach an instance are transformed into object coordinates and
+* traced through its accelerator. Hits carry the materials of the shared
+* surfaces.
+*/
+class Instance : public Surface
+{
+public:
+
+	/**
+	* Constructor for the instance.
+	* @param object - accelerator built over the surfaces of the object in
+	* object coordinates
+	* @param transform - transformation from object to world coordinates.
+	* Must be invertible.
+	*/
+	Instance(std::shared_ptr<const Accelerator> object, const dmat4 & transform);
+
+	/**
+	* Builds the accelerator that instances of an object share.
+	* @param surfaces - surfaces of the object in object coordinates
+	* @param type - kind of accelerator to build over them
+	*/
+	static std::shared_ptr<const Accelerator> createObject(const SurfaceVector & surfaces,
+		AcceleratorType type = AcceleratorType::BVH);
+
+	/**
+	* Checks a ray for intersection with the object. Finds the closest point of intersection
+	* if one exits. Returns a HitRecord with the t parmeter set to FLT_MAX if there is no
+	* intersection.
+	* @param ray - ray in world coordinates
+	* returns HitRecord containing intormation about the point of intersection in world coordinates.
+	*/
+	virtual HitRecord findClosestIntersection(const Ray & ray);
+
+	/**
+	* Checks whether a ray intersects the object closer than maxDistance,
+	* stopping at the first surface of the object that it finds in range.
+	* @param ray - ray in world coordinates
+	* @param maxDistance - distance along the ray in world coordinates
+	*/
+	virtual bool isOccluding(const Ray & ray, double maxDistance);
+
+	/**
+	* Finds the box that encloses the transformed box of the object.
+	* Returns false if a surface of the object has no bounds.
+	*/
+	virtual bool getBoundingBox(AABB & box) const;
+
+	/**
+	* Sets the transformation from object to world coordinates.
+	*/
+	void setTransform(const dmat4 & transform);
+
+	/**
+	* Returns the transformation from object to world coordinates.
+	*/
+	const dmat4 & getTransform() const { return transform; }
+
+protected:
+
+	// Shared geometry in object coordinates
+	std::shared_ptr<const Accelerator> object;
+
+	// Transformation from object to world coordinates
+	dmat4 transform;
+
+	// Transformation from world to object coordinates
+	dmat4 inverseTransform;
+
+	// Transforms normals from object to world coordinates
+	dmat3 normalMatrix;
+};
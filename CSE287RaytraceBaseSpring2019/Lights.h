@@ -4,6 +4,8 @@
 #include "HitRecord.h"
 #include "Surface.h"
 #include "Ray.h"
+#include "Accelerator.h"
+#include "OccluderCache.h"
 
 HitRecord findIntersection( const Ray & ray, SurfaceVector & surfaces );
 
@@ -29,7 +31,57 @@ struct LightSource
 		specularLightColor = WHITE;
 	}
 
-	virtual color illuminate(const dvec3 & eyeVector, HitRecord & closestHit, SurfaceVector & surfaces)
+	/**
+	* Returns a copy of the light with the same type and settings. Used to
+	* give each of several frames rendered at once its own lights.
+	*/
+	virtual std::shared_ptr<LightSource> clone() const
+	{
+		return std::make_shared<LightSource>(*this);
+	}
+
+	/**
+	* Returns the light reflected toward the viewer from a point of
+	* intersection. Traces the shadow ray returned by getShadowRay, if any,
+	* and passes the outcome to shade. The ray first tests the surface that
+	* last shadowed a point for this light on the calling thread.
+	* @param light - position of the light in the light list of the scene
+	*/
+	color illuminate(const dvec3 & eyeVector, HitRecord & closestHit, const Accelerator & accelerator, int light)
+	{
+		Ray shadowRay;
+		double maxDistance;
+		bool inShadow = false;
+
+		if (getShadowRay(closestHit, shadowRay, maxDistance)) {
+			inShadow = OccluderCache::getThreadCache().isOccluded(accelerator, light, shadowRay, maxDistance);
+		}
+
+		return shade(eyeVector, closestHit, inShadow);
+	}
+
+	/**
+	* Returns the ray that determines whether a point of intersection is in
+	* the shadow of this light. The point is in shadow if any surface is hit
+	* closer than maxDistance along the ray.
+	* @param closestHit - point of intersection being lit
+	* @param shadowRay - set to the shadow ray
+	* @param maxDistance - set to the distance beyond which hits do not shadow
+	* @returns false if the light does not need a shadow ray for the point
+	*/
+	virtual bool getShadowRay(const HitRecord & closestHit, Ray & shadowRay, double & maxDistance)
+	{
+		return false;
+	}
+
+	/**
+	* Returns the light reflected toward the viewer from a point of
+	* intersection once it is known whether the point is in shadow.
+	* @param eyeVector - unit vector from the point toward the viewer
+	* @param closestHit - point of intersection being lit
+	* @param inShadow - result of tracing the ray from getShadowRay
+	*/
+	virtual color shade(const dvec3 & eyeVector, HitRecord & closestHit, bool inShadow)
 	{
 		if (enabled) {
 			return ambientLightColor * closestHit.material.ambientColor;
@@ -70,22 +122,37 @@ struct PositionalLight : public LightSource
 	: LightSource(lightColor), lightPosition(position)
 	{}
 
-	virtual color illuminate(const glm::dvec3 & eyeVector, HitRecord & closestHit, SurfaceVector & surfaces)
+	virtual std::shared_ptr<LightSource> clone() const
+	{
+		return std::make_shared<PositionalLight>(*this);
+	}
+
+	virtual bool getShadowRay(const HitRecord & closestHit, Ray & shadowRay, double & maxDistance)
 	{
 		if (enabled) {
 			dvec3 lightVector = glm::normalize(lightPosition - closestHit.interceptPoint);
 
-			dvec3 reflectionVector = glm::normalize(glm::reflect(-lightVector, closestHit.surfaceNormal));
+			shadowRay = Ray(closestHit.interceptPoint + closestHit.surfaceNormal * EPSILON, lightVector);
+			maxDistance = glm::length(lightPosition - closestHit.interceptPoint);
+			return true;
+		}
+		else {
+			return false;
+		}
+	}
 
-			Ray shadowRay(closestHit.interceptPoint + closestHit.surfaceNormal * EPSILON, lightVector);
+	virtual color shade(const glm::dvec3 & eyeVector, HitRecord & closestHit, bool inShadow)
+	{
+		if (enabled) {
+			dvec3 lightVector = glm::normalize(lightPosition - closestHit.interceptPoint);
 
-			HitRecord shadowHit = shadowRay.findIntersection(surfaces);
+			dvec3 reflectionVector = glm::normalize(glm::reflect(-lightVector, closestHit.surfaceNormal));
 
 			color totalLight = BLACK;
 
-			if (shadowHit.t > glm::length( lightPosition - closestHit.interceptPoint )) {
+			if (inShadow == false) {
 
-				totalLight += (LightSource::illuminate(eyeVector, closestHit, surfaces));
+				totalLight += (LightSource::shade(eyeVector, closestHit, false));
 				totalLight += glm::max(glm::dot(lightVector, closestHit.surfaceNormal), 0.0) * diffuseLightColor * closestHit.material.diffuseColor;
 				totalLight += glm::pow(glm::max(0.0, glm::dot(eyeVector, reflectionVector)), closestHit.material.shininess) * specularLightColor * closestHit.material.specularColor;
 			}
@@ -123,7 +190,24 @@ struct DirectionalLight : public LightSource
 	: LightSource(lightColor), lightDirection(glm::normalize(direction))
 	{}
 
-	virtual color illuminate(const dvec3 & eyeVector, HitRecord & closestHit, SurfaceVector & surfaces)
+	virtual std::shared_ptr<LightSource> clone() const
+	{
+		return std::make_shared<DirectionalLight>(*this);
+	}
+
+	virtual bool getShadowRay(const HitRecord & closestHit, Ray & shadowRay, double & maxDistance)
+	{
+		if (enabled) {
+			shadowRay = Ray(closestHit.interceptPoint + closestHit.surfaceNormal * EPSILON, lightDirection);
+			maxDistance = FLT_MAX;
+			return true;
+		}
+		else {
+			return false;
+		}
+	}
+
+	virtual color shade(const dvec3 & eyeVector, HitRecord & closestHit, bool inShadow)
 	{
 		if (enabled) {
 
@@ -133,16 +217,13 @@ struct DirectionalLight : public LightSource
 			
 			color totalLight = BLACK;
 
-			Ray shadowRay( closestHit.interceptPoint + closestHit.surfaceNormal * EPSILON, lightVector);
-			HitRecord shadowHit = shadowRay.findIntersection(surfaces);
-
-			if (shadowHit.t == FLT_MAX) {
-				totalLight += (LightSource::illuminate(eyeVector, closestHit, surfaces));
+			if (inShadow == false) {
+				totalLight += (LightSource::shade(eyeVector, closestHit, false));
 				totalLight += glm::max(glm::dot(lightVector, closestHit.surfaceNormal), 0.0) * diffuseLightColor * closestHit.material.diffuseColor;
 				totalLight += glm::pow(glm::max(0.0, glm::dot(eyeVector, reflectionVector)), closestHit.material.shininess) * specularLightColor * closestHit.material.specularColor;
 			}
 			else {
-				totalLight += (LightSource::illuminate(eyeVector, closestHit, surfaces));
+				totalLight += (LightSource::shade(eyeVector, closestHit, false));
 			}
 			if (day) {
 				return totalLight;
@@ -182,14 +263,31 @@ struct SpotLight : public PositionalLight
 	{
 	}
 
-	virtual color illuminate(const glm::dvec3 & eyeVector,
+	virtual std::shared_ptr<LightSource> clone() const
+	{
+		return std::make_shared<SpotLight>(*this);
+	}
+
+	virtual bool getShadowRay(const HitRecord & closestHit, Ray & shadowRay, double & maxDistance)
+	{
+		// Points outside of the beam are not lit, so they need no shadow ray
+		double spotCosine = glm::dot(spotDirection, -glm::normalize(lightPosition - closestHit.interceptPoint));
+		if (spotCosine > (cutOffCosineRadians)) {
+			return PositionalLight::getShadowRay(closestHit, shadowRay, maxDistance);
+		}
+		else {
+			return false;
+		}
+	}
+
+	virtual color shade(const glm::dvec3 & eyeVector,
 		HitRecord & closestHit,
-		SurfaceVector & surfaces)
+		bool inShadow)
 	{
 		double spotCosine = glm::dot(spotDirection, -glm::normalize(lightPosition - closestHit.interceptPoint));
 		if (spotCosine > (cutOffCosineRadians)) {
 			double falloff = 1 - (1 - spotCosine) / (1 - (cutOffCosineRadians));
-			return falloff * PositionalLight::illuminate(eyeVector, closestHit, surfaces);
+			return falloff * PositionalLight::shade(eyeVector, closestHit, inShadow);
 		}
 		else {
 			return BLACK;
@@ -0,0 +1,42 @@
+#include "LinearAccelerator.h"
+
+
+// Has no structure. The bounded surfaces are tested in list order.
+
+void LinearAccelerator::traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const
+{
+	for (int surface : boundedSurfaces) {
+		testSurface(ray, surface, closestHit, closestSurface);
+	}
+
+} // end traverse
+
+
+int LinearAccelerator::traverseOccluded(const Ray & ray, double maxDistance) const
+{
+	for (int surface : boundedSurfaces) {
+		if (surfaces[surface]->isOccluding(ray, maxDistance)) {
+			return surface;
+		}
+	}
+
+	return -1;
+
+} // end traverseOccluded
+
+
+void LinearAccelerator::traversePacket(const RayPacket & packet, HitRecord hits[], int closestSurfaces[]) const
+{
+	for (int surface : boundedSurfaces) {
+		testSurfacePacket(packet, packet.getMask(), surface, hits, closestSurfaces);
+	}
+
+} // end traversePacket
+
+
+double LinearAccelerator::getCost() const
+{
+	// Every ray is tested against every surface
+	return INTERSECTION_COST * (boundedSurfaces.size() + unboundedSurfaces.size());
+
+} // end getCost
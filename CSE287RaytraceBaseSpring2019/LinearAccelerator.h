@@ -0,0 +1,34 @@
+#pragma once
+
+#include "Accelerator.h"
+
+/**
+* Accelerator that tests a ray against every surface of the scene. Slow
+* for more than a few surfaces, but trivially correct, which makes it the
+* reference the other accelerators are validated against.
+*/
+class LinearAccelerator : public Accelerator
+{
+public:
+
+	virtual AcceleratorType getType() const { return AcceleratorType::LINEAR; }
+
+	virtual const char * getName() const { return "linear"; }
+
+	virtual double getCost() const;
+
+protected:
+
+	virtual void buildStructure(std::vector<Primitive> &, ThreadPool *) {}
+
+	virtual void refitStructure(const std::vector<AABB> &, ThreadPool *) {}
+
+	virtual std::shared_ptr<Accelerator> clone() const { return std::make_shared<LinearAccelerator>(*this); }
+
+	virtual void traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const;
+
+	virtual int traverseOccluded(const Ray & ray, double maxDistance) const;
+
+	virtual void traversePacket(const RayPacket & packet, HitRecord hits[], int closestSurfaces[]) const;
+
+}; // end LinearAccelerator class
@@ -0,0 +1,113 @@
+#include "OccluderCache.h"
+
+#include <algorithm>
+#include <mutex>
+
+
+/**
+* Caches of the running threads and the counts of the caches of threads
+* that have ended. Never freed, since threads may end after static objects
+* are destroyed.
+*/
+struct OccluderCacheRegistry
+{
+	std::mutex mutex;
+	std::vector<OccluderCache *> caches;
+	OccluderCacheStatistics ended = { 0, 0, 0 };
+};
+
+static OccluderCacheRegistry & getRegistry()
+{
+	static OccluderCacheRegistry * registry = new OccluderCacheRegistry();
+
+	return *registry;
+
+} // end getRegistry
+
+
+OccluderCache::OccluderCache()
+	: lookups(0), occluded(0), hits(0)
+{
+	OccluderCacheRegistry & registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	registry.caches.push_back(this);
+
+} // end OccluderCache constructor
+
+
+OccluderCache::~OccluderCache()
+{
+	OccluderCacheRegistry & registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	registry.ended.lookups += lookups;
+	registry.ended.occluded += occluded;
+	registry.ended.hits += hits;
+
+	registry.caches.erase(std::find(registry.caches.begin(), registry.caches.end(), this));
+
+} // end OccluderCache destructor
+
+
+OccluderCache & OccluderCache::getThreadCache()
+{
+	static thread_local OccluderCache cache;
+
+	return cache;
+
+} // end getThreadCache
+
+
+bool OccluderCache::isOccluded(const Accelerator & accelerator, int light, const Ray & ray, double maxDistance)
+{
+	if (&accelerator != this->accelerator) {
+		this->accelerator = &accelerator;
+		lastOccluders.clear();
+	}
+
+	if (light >= (int)lastOccluders.size()) {
+		lastOccluders.resize(light + 1, -1);
+	}
+
+	increment(lookups);
+
+	int & lastOccluder = lastOccluders[light];
+
+	if (lastOccluder >= 0 && accelerator.isOccludedBy(ray, lastOccluder, maxDistance)) {
+		increment(occluded);
+		increment(hits);
+		return true;
+	}
+
+	int occluder = accelerator.findOccluder(ray, maxDistance);
+
+	if (occluder < 0) {
+		return false;
+	}
+
+	// Rays that are not blocked keep the last blocker for the next ray
+	lastOccluder = occluder;
+	increment(occluded);
+
+	return true;
+
+} // end isOccluded
+
+
+OccluderCacheStatistics OccluderCache::getStatistics()
+{
+	OccluderCacheRegistry & registry = getRegistry();
+	std::lock_guard<std::mutex> lock(registry.mutex);
+
+	OccluderCacheStatistics statistics = registry.ended;
+
+	for (const OccluderCache * cache : registry.caches) {
+		statistics.lookups += cache->lookups.load(std::memory_order_relaxed);
+		statistics.occluded += cache->occluded.load(std::memory_order_relaxed);
+		statistics.hits += cache->hits.load(std::memory_order_relaxed);
+	}
+
+	return statistics;
+
+} // end getStatistics
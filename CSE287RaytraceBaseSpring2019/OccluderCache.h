@@ -0,0 +1,87 @@
+#pragma once
+
+#include "Accelerator.h"
+
+#include <atomic>
+
+/**
+* Counts of the shadow rays traced through OccluderCache objects.
+*/
+struct OccluderCacheStatistics
+{
+	// Shadow rays traced
+	uint64_t lookups;
+
+	// Shadow rays that were blocked
+	uint64_t occluded;
+
+	// Blocked shadow rays whose blocker was the remembered surface
+	uint64_t hits;
+};
+
+/**
+* Remembers for each light the surface that last blocked a shadow ray of
+* the thread that owns the cache, and tests that surface before searching
+* the accelerator. Neighboring points tend to be shadowed by the same
+* surface, so most blocked rays need a single intersection test.
+*
+* The remembered surface is only a guess. Whatever surface it is, a hit on
+* it closer than the light puts the point in shadow, and a miss falls back
+* to the full search, so the answer is always that of the accelerator. The
+* guesses are forgotten when rays are traced through another accelerator,
+* since the surface with the same index in another scene is likely to be
+* a different one.
+*/
+class OccluderCache
+{
+public:
+
+	~OccluderCache();
+
+	/**
+	* Returns the cache of the calling thread.
+	*/
+	static OccluderCache & getThreadCache();
+
+	/**
+	* Checks whether a shadow ray intersects any surface closer than a given
+	* distance, testing the surface that last blocked a ray of the same
+	* light first.
+	* @param accelerator - accelerator of the scene
+	* @param light - position of the light in the light list
+	* @param ray - shadow ray
+	* @param maxDistance - intersections at or beyond this distance are ignored
+	*/
+	bool isOccluded(const Accelerator & accelerator, int light, const Ray & ray, double maxDistance);
+
+	/**
+	* Returns the counts of the caches of every thread, including the threads
+	* that have ended.
+	*/
+	static OccluderCacheStatistics getStatistics();
+
+protected:
+
+	OccluderCache();
+
+	/**
+	* Adds one to a counter that only the owning thread changes.
+	*/
+	static void increment(std::atomic<uint64_t> & counter)
+	{
+		counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+	}
+
+	// Accelerator the remembered surfaces belong to
+	const Accelerator * accelerator = nullptr;
+
+	// Surface that last blocked a shadow ray of each light, or -1
+	std::vector<int> lastOccluders;
+
+	// Counts of the shadow rays traced through the cache. Read by other
+	// threads in getStatistics.
+	std::atomic<uint64_t> lookups;
+	std::atomic<uint64_t> occluded;
+	std::atomic<uint64_t> hits;
+
+}; // end OccluderCache class
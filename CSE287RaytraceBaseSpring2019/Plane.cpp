@@ -1,4 +1,5 @@
 #include "Plane.h"
+#include "RayPacket.h"
 
 /**
 * Constructor for the Plane.
@@ -52,3 +53,54 @@ HitRecord Plane::findClosestIntersection( const Ray & ray )
 
 } // end findClosestIntersection
 
+
+/*
+* Checks whether a ray intersects the plane closer than maxDistance. Shadow
+* rays need no point of intersection, normal, or material.
+*/
+bool Plane::isOccluding( const Ray & ray, double maxDistance )
+{
+	return findDistance(ray) < maxDistance;
+
+} // end isOccluding
+
+
+/*
+* Finds the t of every ray of a packet with the arithmetic of findDistance,
+* without branches so that the rays are processed side by side. The mask is
+* ignored as it is by Sphere. Rays that share an origin share the numerator.
+*/
+void Plane::findDistances( const RayPacket & packet, int, double distances[] )
+{
+	double sharedNumerator = glm::dot(a - packet.getOrigin(0), n);
+
+	for (int lane = 0; lane < packet.size; lane++) {
+
+		double numerator = packet.sharedOrigin ? sharedNumerator :
+			(a.x - packet.originX[lane]) * n.x + (a.y - packet.originY[lane]) * n.y + (a.z - packet.originZ[lane]) * n.z;
+		double denominator = packet.directionX[lane] * n.x + packet.directionY[lane] * n.y + packet.directionZ[lane] * n.z;
+
+		double t = numerator / denominator;
+
+		distances[lane] = (denominator != 0 && t >= 0) ? t : FLT_MAX;
+	}
+
+} // end findDistances
+
+
+/*
+* Returns the parameter t of the point at which a ray intersects the plane,
+* or FLT_MAX if there is no intersection.
+*/
+double Plane::findDistance( const Ray & ray ) const
+{
+	if (glm::dot(ray.direct, n) == 0) {
+		return FLT_MAX;
+	}
+
+	double t = glm::dot(a - ray.origin, n) / glm::dot(ray.direct, n);
+
+	return (t >= 0) ? t : FLT_MAX;
+
+} // end findDistance
+
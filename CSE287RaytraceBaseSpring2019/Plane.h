@@ -28,6 +28,25 @@ class Plane : public Surface
 	*/
 	virtual HitRecord findClosestIntersection( const Ray & ray );
 
+	/**
+	* Checks whether a ray intersects the plane closer than maxDistance
+	* without filling in a HitRecord.
+	*/
+	virtual bool isOccluding( const Ray & ray, double maxDistance );
+
+	/**
+	* Finds the t at which every ray of a packet intersects the plane. Also
+	* serves sub-classes that are parts of the plane, for which the t of the
+	* plane is never larger than theirs.
+	*/
+	virtual void findDistances( const RayPacket & packet, int mask, double distances[] );
+
+	/**
+	* Returns the parameter t of the point at which a ray intersects the
+	* plane, or FLT_MAX if there is no intersection.
+	*/
+	double findDistance( const Ray & ray ) const;
+
 	/** Point on the plane */
 	dvec3 a;
 
@@ -11,7 +11,7 @@ HitRecord Polygon::findClosestIntersection(const Ray & ray)
 	HitRecord hitRecord = Plane::findClosestIntersection(ray);
 	if (checkLeft(v[0], v[1], hitRecord.interceptPoint, hitRecord.surfaceNormal) > 0
 		&& checkLeft(v[1], v[2], hitRecord.interceptPoint, hitRecord.surfaceNormal) > 0
-		&& checkLeft(v[0], v[1], hitRecord.interceptPoint, hitRecord.surfaceNormal) > 0) {
+		&& checkLeft(v[2], v[0], hitRecord.interceptPoint, hitRecord.surfaceNormal) > 0) {
 		return hitRecord;
 	}
 	else {
@@ -20,6 +20,14 @@ HitRecord Polygon::findClosestIntersection(const Ray & ray)
 	}
 }
 
-int Polygon::checkLeft(dvec3 v1, dvec3 v2, dvec3 p, dvec3 n) {
+double Polygon::checkLeft(dvec3 v1, dvec3 v2, dvec3 p, dvec3 n) {
 	return glm::dot(glm::cross(v2 - v1, p - v1), n);
 }
+
+bool Polygon::getBoundingBox(AABB & box) const {
+	box = AABB();
+	for (const dvec3 & vertex : v) {
+		box.expand(vertex);
+	}
+	return true;
+}
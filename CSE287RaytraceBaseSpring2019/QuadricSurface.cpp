@@ -1,4 +1,5 @@
 #include "QuadricSurface.h"
+#include "RayPacket.h"
 
 
 QuadricSurface::QuadricSurface( const dvec3 & position, const color & mat )
@@ -58,6 +59,75 @@ HitRecord QuadricSurface::findClosestIntersection( const Ray & ray )
 	dvec3 Ro = ray.origin - center;
 	dvec3 Rd = ray.direct;
 
+	double t = findDistance( Ro, Rd, findOriginTerm( Ro ) );
+
+	if (t == FLT_MAX) {
+		// Set parameter, t, in the hit record to indicate "no intersection."
+		hitRecord.t = FLT_MAX;
+		return hitRecord;
+	}
+
+	// Calculate the point of intersection using the parameter t
+	dvec3 Ri = Ro + t * Rd;
+	
+	// Find the normal vector of the surface at the point of intersection
+	// using partial derivativex with respect to x, y, and z
+	dvec3 Rn;
+	Rn.x = 2 * A * Ri.x + D * Ri.y + E * Ri.z + G;
+	Rn.y = 2 * B * Ri.y + D * Ri.x + F * Ri.z + H;
+	Rn.z = 2 * C * Ri.z + E * Ri.x + F * Ri.y + I;
+
+	// Check if the intersection with the inside or back of the surface
+	if (glm::dot(Rn, Rd) > 0) { Rn = -Rn; }
+
+	// Set hit record information about the intersetion.
+	hitRecord.t = t;
+	hitRecord.interceptPoint = Ri + center;
+	hitRecord.surfaceNormal = normalize( Rn );
+	hitRecord.material = material;
+
+	return hitRecord;
+
+} // end checkIntercept
+
+
+/*
+* Finds the t of every ray of a packet. Rays that share an origin share the
+* constant term of the quadratic.
+*/
+void QuadricSurface::findDistances( const RayPacket & packet, int mask, double distances[] )
+{
+	dvec3 sharedOffset = packet.getOrigin( 0 ) - center;
+	double sharedOriginTerm = findOriginTerm( sharedOffset );
+
+	for (int lane = 0; lane < packet.size; lane++) {
+
+		if (mask & (1 << lane)) {
+
+			if (packet.sharedOrigin) {
+				distances[lane] = findDistance( sharedOffset, packet.getDirection( lane ), sharedOriginTerm );
+			}
+			else {
+				dvec3 Ro = packet.getOrigin( lane ) - center;
+				distances[lane] = findDistance( Ro, packet.getDirection( lane ), findOriginTerm( Ro ) );
+			}
+		}
+	}
+
+} // end findDistances
+
+
+double QuadricSurface::findOriginTerm( const dvec3 & Ro ) const
+{
+	return A * (Ro.x * Ro.x) + B * (Ro.y * Ro.y) + C * (Ro.z * Ro.z) +
+		   D * (Ro.x * Ro.y) + E * (Ro.x * Ro.z) + F * (Ro.y * Ro.z) +
+		   G * Ro.x + H * Ro.y + I * Ro.z + J; 
+
+} // end findOriginTerm
+
+
+double QuadricSurface::findDistance( const dvec3 & Ro, const dvec3 & Rd, double Cq ) const
+{
 	// After substituting the parametric form of the ray, Ro + t* Rd, into the 
 	// generalized form of the quadratic equation for a quadric surface the equation
 	// reduces to Aq(tt) + Bq(t) + Cq where
@@ -71,10 +141,6 @@ HitRecord QuadricSurface::findClosestIntersection( const Ray & ray )
 			   F * (Ro.y * Rd.z + Ro.z * Rd.y) +
 			   G * Rd.x + H * Rd.y + I * Rd.z;
 
-	double Cq = A * (Ro.x * Ro.x) + B * (Ro.y * Ro.y) + C * (Ro.z * Ro.z) +
-			   D * (Ro.x * Ro.y) + E * (Ro.x * Ro.z) + F * (Ro.y * Ro.z) +
-			   G * Ro.x + H * Ro.y + I * Ro.z + J; 
-	
 	// The quadratic equation in the form (-Bq +/- sqrt(Bq*Bq-4 * Aq * Cq))/(2*Aq) is 
 	// used to solve for the parameter t..
 
@@ -82,67 +148,102 @@ HitRecord QuadricSurface::findClosestIntersection( const Ray & ray )
 	double discriminant = Bq * Bq - 4 * Aq * Cq;
 	 
 	// Check if there are any real (non-imaginary) roots to the equation
-	if (discriminant >= 0) {
+	if ((discriminant >= 0) == false) {
+		return FLT_MAX;
+	}
 
-		// Initialize parameter for the point of intersection to largest float possible
-		double t = FLT_MAX; 
+	// Initialize parameter for the point of intersection to largest float possible
+	double t = FLT_MAX; 
 
-		// Does the ray just graze the surface intersecting at only one point?
-		if (Aq == 0) {
+	// Does the ray just graze the surface intersecting at only one point?
+	if (Aq == 0) {
 
-			t = -Cq / Bq; // Set parameter, t, for the point of intersection
+		t = -Cq / Bq; // Set parameter, t, for the point of intersection
 
-		} 
-		else {
+		if (isKept(Ro + t * Rd + center) == false) {
+			t = -1.0;
+		}
+	} 
+	else {
 
-			// Use quadratic equation to solve for the closest of the two roots.
-			double t0 = (-Bq - sqrt(discriminant)) / (2 * Aq);
+		// Use quadratic equation to solve for the closest of the two roots.
+		double t0 = (-Bq - sqrt(discriminant)) / (2 * Aq);
 
-			// Is closest point of intersection on the ray or on the negative side of 
-			// Ro on a geometric line described by Ro + t* Rd?
-			if (t0 > 0) {
+		// Is closest point of intersection on the ray or on the negative side of 
+		// Ro on a geometric line described by Ro + t* Rd? If it has been clipped
+		// away the ray continues to the far side.
+		if (t0 > 0 && isKept(Ro + t0 * Rd + center)) {
 
-				t = t0;
-			}
-			else {
+			t = t0;
+		}
+		else {
 
-				// Use quadratic equation to solve for the second closest of the two roots.
-				t = (-Bq + sqrt(discriminant)) / (2 * Aq);
+			// Use quadratic equation to solve for the second closest of the two roots.
+			t = (-Bq + sqrt(discriminant)) / (2 * Aq);
+
+			if (isKept(Ro + t * Rd + center) == false) {
+				t = -1.0;
 			}
 		}
+	}
+
+	return (t < 0) ? FLT_MAX : t;
+
+} // end findDistance
+
 
-		if (t < 0) {
-			// Set parameter, t, in the hit record to indicate "no intersection."
-			hitRecord.t = FLT_MAX;
-			return hitRecord;
-		}
 
-		// Calculate the point of intersection using the parameter t
-		dvec3 Ri = Ro + t * Rd;
-		
-		// Find the normal vector of the surface at the point of intersection
-		// using partial derivativex with respect to x, y, and z
-		dvec3 Rn;
-		Rn.x = 2 * A * Ri.x + D * Ri.y + E * Ri.z + G;
-		Rn.y = 2 * B * Ri.y + D * Ri.x + F * Ri.z + H;
-		Rn.z = 2 * C * Ri.z + E * Ri.x + F * Ri.y + I;
-
-		// Check if the intersection with the inside or back of the surface
-		if (glm::dot(Rn, Rd) > 0) { Rn = -Rn; }
-
-		// Set hit record information about the intersetion.
-		hitRecord.t = t;
-		hitRecord.interceptPoint = Ri + center;
-		hitRecord.surfaceNormal = normalize( Rn );
-		hitRecord.material = material;
+bool QuadricSurface::isKept( const dvec3 & point ) const
+{
+	if (clipped == false) {
+		return true;
 	}
-	else {
 
-		// Set parameter, t, in the hit record to indicate "no intersection."
-		hitRecord.t = FLT_MAX;
+	return glm::all(glm::greaterThanEqual(point, clipBox.minimum)) &&
+		glm::all(glm::lessThanEqual(point, clipBox.maximum));
+
+} // end isKept
+
+
+/*
+* Finds the box that contains the surface.
+*/
+bool QuadricSurface::getBoundingBox( AABB & box ) const
+{
+	// Write the quadric as x'Mx + b.x + J = 0, relative to center
+	dmat3 M(A, D / 2.0, E / 2.0,
+		D / 2.0, B, F / 2.0,
+		E / 2.0, F / 2.0, C);
+	dvec3 b(G, H, I);
+
+	// The surface is an ellipsoid if M is positive definite, which is the
+	// case if its leading principal minors are all positive
+	bool closed = A > 0.0 && A * B - D * D / 4.0 > 0.0 && glm::determinant(M) > 0.0;
+
+	if (closed) {
+
+		// Moving the origin to the middle of the ellipsoid, c, removes the
+		// linear term: y'My = k. Along axis i it reaches sqrt(k * inverse(M)ii).
+		dmat3 inverseM = glm::inverse(M);
+		dvec3 middle = -0.5 * (inverseM * b);
+		double k = glm::max(glm::dot(middle, M * middle) - J, 0.0);
+
+		dvec3 extent(sqrt(k * inverseM[0][0]), sqrt(k * inverseM[1][1]), sqrt(k * inverseM[2][2]));
+
+		box = AABB(center + middle - extent, center + middle + extent);
+
+		if (clipped) {
+			box.minimum = glm::max(box.minimum, clipBox.minimum);
+			box.maximum = glm::min(box.maximum, clipBox.maximum);
+		}
+		return true;
 	}
 
-	return hitRecord;
+	if (clipped) {
+		box = clipBox;
+		return true;
+	}
 
-} // end checkIntercept
+	return false;
 
+} // end getBoundingBox
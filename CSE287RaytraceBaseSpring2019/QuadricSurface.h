@@ -37,6 +37,32 @@ public:
 	*/
 	virtual HitRecord findClosestIntersection( const Ray & ray );
 
+	/**
+	* Finds the exact t of every ray of a packet.
+	*/
+	virtual void findDistances( const RayPacket & packet, int mask, double distances[] );
+
+	/**
+	* Finds the box that contains the surface. Closed surfaces, ellipsoids,
+	* are bounded by their extent along each axis. Open ones, such as
+	* cylinders and paraboloids, are bounded only if they are clipped.
+	*/
+	virtual bool getBoundingBox( AABB & box ) const;
+
+	/**
+	* Cuts away the parts of the surface that lie outside of a box, which
+	* makes open surfaces such as cylinders finite. Rays pass through the
+	* parts that are cut away, so the inside of a clipped cylinder can be
+	* seen through its open ends.
+	* @param box - part of space, in world coordinates, that is kept
+	*/
+	void setClipBox( const AABB & box ) { clipBox = box; clipped = true; }
+
+	/**
+	* Removes the clip box so that the whole surface is kept.
+	*/
+	void clearClipBox() { clipped = false; }
+
 	/**
 	* xyz location of the center of the surface
 	*/
@@ -44,6 +70,35 @@ public:
 
 	protected:
 
+	/**
+	* Returns true if a point is kept by the clip box. Always true for
+	* surfaces that are not clipped.
+	*/
+	bool isKept( const dvec3 & point ) const;
+
+	/**
+	* Returns the constant term, Cq, of the quadratic in t that a ray
+	* substituted into the surface equation gives. It depends only on the
+	* origin of the ray.
+	* @param Ro - origin of the ray relative to center
+	*/
+	double findOriginTerm( const dvec3 & Ro ) const;
+
+	/**
+	* Returns the parameter t of the closest point at which a ray hits the
+	* part of the surface that is kept, or FLT_MAX if there is none.
+	* @param Ro - origin of the ray relative to center
+	* @param Rd - direction of the ray
+	* @param Cq - findOriginTerm of Ro
+	*/
+	double findDistance( const dvec3 & Ro, const dvec3 & Rd, double Cq ) const;
+
+	/**
+	* Part of space that is kept if clipped is true
+	*/
+	AABB clipBox;
+	bool clipped = false;
+
 	/**
 	* Coeficients is the  quadric surface equation
 	* Ax2 + By2 + Cz2 + Dxy+ Exz + Fyz + Gx + Hy + Iz + J = 0
@@ -0,0 +1,556 @@
+#include "QuantizedBoundingVolumeHierarchy.h"
+
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUANTIZED_BVH_SSE
+#include <emmintrin.h>
+#endif
+
+// Grid offsets run from 0 to MAX_OFFSET
+static const int MAX_OFFSET = 255;
+
+// Grid spacings are kept between these powers of two so that every grid
+// point is a normal float
+static const int MIN_EXPONENT = -100;
+static const int MAX_EXPONENT = 100;
+
+// Trees over fewer surfaces are refit on the calling thread. Larger ones
+// refit the subtrees of the top levels of nodes as separate tasks.
+static const int PARALLEL_REFIT_SIZE = 4096;
+static const int PARALLEL_REFIT_DEPTH = 2;
+
+
+/**
+* Returns two to the power of an exponent between MIN_EXPONENT and
+* MAX_EXPONENT.
+*/
+static float getScale(int exponent)
+{
+	uint32_t bits = (uint32_t)(exponent + 127) << 23;
+	float scale;
+	memcpy(&scale, &bits, sizeof(scale));
+
+	return scale;
+
+} // end getScale
+
+
+QuantizedBoundingVolumeHierarchy::QuantizedBoundingVolumeHierarchy(BuildMethod buildMethod)
+	: WideBoundingVolumeHierarchy<8>(buildMethod)
+{
+
+} // end QuantizedBoundingVolumeHierarchy constructor
+
+
+double QuantizedBoundingVolumeHierarchy::getCost() const
+{
+	double cost = INTERSECTION_COST * unboundedSurfaces.size();
+
+	if (quantizedNodes.empty()) {
+		return cost;
+	}
+
+	std::vector<AABB> nodeBoxes(quantizedNodes.size());
+	std::vector<std::vector<AABB>> laneBoxes(quantizedNodes.size(), std::vector<AABB>(WIDTH));
+
+	for (size_t i = 0; i < quantizedNodes.size(); i++) {
+
+		float bounds[6][WIDTH];
+		decode(quantizedNodes[i], bounds);
+
+		for (int lane = 0; lane < WIDTH; lane++) {
+			if (quantizedNodes[i].count[lane] != EMPTY_LANE) {
+				laneBoxes[i][lane] = AABB(dvec3(bounds[0][lane], bounds[1][lane], bounds[2][lane]),
+					dvec3(bounds[3][lane], bounds[4][lane], bounds[5][lane]));
+				nodeBoxes[i].expand(laneBoxes[i][lane]);
+			}
+		}
+	}
+
+	double rootArea = nodeBoxes[0].getSurfaceArea();
+
+	if (rootArea <= 0.0) {
+		return cost + INTERSECTION_COST * surfaceOrder.size();
+	}
+
+	for (size_t i = 0; i < quantizedNodes.size(); i++) {
+
+		cost += TRAVERSAL_COST * nodeBoxes[i].getSurfaceArea() / rootArea;
+
+		for (int lane = 0; lane < WIDTH; lane++) {
+
+			uint8_t count = quantizedNodes[i].count[lane];
+
+			if (count != EMPTY_LANE && count != INTERIOR_LANE) {
+				cost += INTERSECTION_COST * count * laneBoxes[i][lane].getSurfaceArea() / rootArea;
+			}
+		}
+	}
+
+	return cost;
+
+} // end getCost
+
+
+size_t QuantizedBoundingVolumeHierarchy::getMemoryBytes() const
+{
+	return WideBoundingVolumeHierarchy<8>::getMemoryBytes() + quantizedNodes.capacity() * sizeof(QuantizedNode);
+
+} // end getMemoryBytes
+
+
+void QuantizedBoundingVolumeHierarchy::buildStructure(std::vector<Primitive> & primitives, ThreadPool * threadPool)
+{
+	BoundingVolumeHierarchy::buildStructure(primitives, threadPool);
+
+	quantizedNodes.clear();
+
+	if (nodes.empty() == false) {
+
+		EncodeChild root = { nodes[0].bounds, (nodes[0].count > 0) ? -1 : 0, nodes[0].first, nodes[0].count };
+
+		std::vector<EncodeChild> children;
+		if (isInterior(root)) {
+			gatherChildren(root, children);
+		}
+		else {
+			children.push_back(root);
+		}
+
+		std::vector<int> leafOrder;
+		leafOrder.reserve(surfaceOrder.size());
+
+		quantizedNodes.push_back(QuantizedNode());
+		encodeNode(0, children, surfaceOrder, leafOrder);
+
+		surfaceOrder.swap(leafOrder);
+	}
+
+	// Only the compressed nodes are traversed and refit
+	std::vector<Node>().swap(nodes);
+	std::vector<WideNode>().swap(wideNodes);
+	quantizedNodes.shrink_to_fit();
+
+} // end buildStructure
+
+
+void QuantizedBoundingVolumeHierarchy::refitStructure(const std::vector<AABB> & bounds, ThreadPool * threadPool)
+{
+	if (quantizedNodes.empty() == false) {
+		refitQuantizedNode(bounds, 0, 0, ((int)surfaceOrder.size() >= PARALLEL_REFIT_SIZE) ? threadPool : nullptr);
+	}
+
+} // end refitStructure
+
+
+AABB QuantizedBoundingVolumeHierarchy::refitQuantizedNode(const std::vector<AABB> & bounds, int index, int depth,
+	ThreadPool * threadPool)
+{
+	QuantizedNode & node = quantizedNodes[index];
+	AABB boxes[WIDTH];
+	int child = node.childBase;
+	int leaf = node.leafBase;
+
+	// Every child writes only its own subtree and its own lane
+	bool parallel = threadPool != nullptr && depth < PARALLEL_REFIT_DEPTH;
+	TaskGroup subtrees;
+
+	for (int lane = 0; lane < WIDTH; lane++) {
+
+		if (node.count[lane] == INTERIOR_LANE) {
+
+			int childIndex = child++;
+			AABB & box = boxes[lane];
+
+			if (parallel) {
+				threadPool->submit([this, &bounds, &box, childIndex, depth, threadPool] {
+					box = refitQuantizedNode(bounds, childIndex, depth + 1, threadPool); }, subtrees);
+			}
+			else {
+				box = refitQuantizedNode(bounds, childIndex, depth + 1, threadPool);
+			}
+		}
+		else if (node.count[lane] != EMPTY_LANE) {
+
+			for (int j = leaf; j < leaf + node.count[lane]; j++) {
+				boxes[lane].expand(bounds[surfaceOrder[j]]);
+			}
+			leaf += node.count[lane];
+		}
+	}
+
+	if (parallel) {
+		threadPool->wait(subtrees);
+	}
+
+	AABB box;
+
+	for (int lane = 0; lane < WIDTH; lane++) {
+		if (node.count[lane] != EMPTY_LANE) {
+			box.expand(boxes[lane]);
+		}
+	}
+
+	quantize(node, boxes);
+
+	return box;
+
+} // end refitQuantizedNode
+
+
+bool QuantizedBoundingVolumeHierarchy::isInterior(const EncodeChild & child)
+{
+	return child.node >= 0 || child.count > MAX_LEAF_COUNT;
+
+} // end isInterior
+
+
+void QuantizedBoundingVolumeHierarchy::gatherChildren(const EncodeChild & parent, std::vector<EncodeChild> & children) const
+{
+	children.clear();
+
+	// Leaves too big for a lane are divided evenly. Pieces that are still
+	// too big are divided again one level down.
+	if (parent.node < 0) {
+
+		for (int i = 0; i < WIDTH; i++) {
+			int begin = parent.first + (int)((long long)parent.count * i / WIDTH);
+			int end = parent.first + (int)((long long)parent.count * (i + 1) / WIDTH);
+			children.push_back({ parent.bounds, -1, begin, end - begin });
+		}
+		return;
+	}
+
+	auto makeChild = [this](int nodeIndex) {
+		const Node & node = nodes[nodeIndex];
+		return EncodeChild{ node.bounds, (node.count > 0) ? -1 : nodeIndex, node.first, node.count };
+	};
+
+	children.push_back(makeChild(parent.node + 1));
+	children.push_back(makeChild(nodes[parent.node].first));
+
+	// Open the largest interior binary node until the node is full
+	while ((int)children.size() < WIDTH) {
+
+		int largest = -1;
+		double largestArea = -1.0;
+
+		for (int i = 0; i < (int)children.size(); i++) {
+			if (children[i].node >= 0 && children[i].bounds.getSurfaceArea() > largestArea) {
+				largest = i;
+				largestArea = children[i].bounds.getSurfaceArea();
+			}
+		}
+
+		if (largest < 0) {
+			break;
+		}
+
+		int opened = children[largest].node;
+		children[largest] = makeChild(opened + 1);
+		children.push_back(makeChild(nodes[opened].first));
+	}
+
+} // end gatherChildren
+
+
+void QuantizedBoundingVolumeHierarchy::encodeNode(int nodeIndex, const std::vector<EncodeChild> & children,
+	const std::vector<int> & order, std::vector<int> & leafOrder)
+{
+	QuantizedNode node;
+	AABB boxes[WIDTH];
+	int interiorCount = 0;
+
+	node.leafBase = (int)leafOrder.size();
+
+	for (int lane = 0; lane < WIDTH; lane++) {
+
+		if (lane >= (int)children.size()) {
+			node.count[lane] = EMPTY_LANE;
+			continue;
+		}
+
+		const EncodeChild & child = children[lane];
+		boxes[lane] = child.bounds;
+
+		if (isInterior(child)) {
+			node.count[lane] = INTERIOR_LANE;
+			interiorCount++;
+		}
+		else {
+			node.count[lane] = (uint8_t)child.count;
+			leafOrder.insert(leafOrder.end(), order.begin() + child.first, order.begin() + child.first + child.count);
+		}
+	}
+
+	quantize(node, boxes);
+
+	// Interior children are allocated together, then encoded one by one
+	node.childBase = (int)quantizedNodes.size();
+	quantizedNodes.resize(quantizedNodes.size() + interiorCount);
+	quantizedNodes[nodeIndex] = node;
+
+	int childIndex = node.childBase;
+	std::vector<EncodeChild> grandchildren;
+
+	for (int lane = 0; lane < (int)children.size(); lane++) {
+
+		if (isInterior(children[lane])) {
+			gatherChildren(children[lane], grandchildren);
+			encodeNode(childIndex++, grandchildren, order, leafOrder);
+		}
+	}
+
+} // end encodeNode
+
+
+void QuantizedBoundingVolumeHierarchy::quantize(QuantizedNode & node, const AABB(&boxes)[WIDTH])
+{
+	AABB box;
+
+	for (int lane = 0; lane < WIDTH; lane++) {
+		if (node.count[lane] != EMPTY_LANE) {
+			box.expand(boxes[lane]);
+		}
+	}
+
+	for (int axis = 0; axis < 3; axis++) {
+
+		double low = box.minimum[axis];
+		double high = box.maximum[axis];
+		double magnitude = glm::max(std::abs(low), std::abs(high));
+
+		// The spacing must let MAX_OFFSET - 1 steps cover the box, leaving
+		// one step for the start of the grid to be rounded down, and must
+		// be at least 2^-22 of the largest coordinate so that every grid
+		// point fits in the 24 bits of a float significand
+		int exponent = MIN_EXPONENT;
+		int power;
+
+		if (high > low) {
+			std::frexp((high - low) / (MAX_OFFSET - 1), &power);
+			exponent = glm::max(exponent, power);
+		}
+
+		if (magnitude > 0.0) {
+			std::frexp(magnitude, &power);
+			exponent = glm::max(exponent, power - 22);
+		}
+
+		exponent = glm::min(exponent, MAX_EXPONENT);
+
+		double scale = std::ldexp(1.0, exponent);
+		double origin = std::floor(low / scale) * scale;
+
+		node.origin[axis] = (float)origin;
+		node.exponent[axis] = (int8_t)exponent;
+
+		for (int lane = 0; lane < WIDTH; lane++) {
+
+			// Empty lanes get a box whose low side is above its high side,
+			// which no ray hits
+			if (node.count[lane] == EMPTY_LANE) {
+				node.bounds[axis][lane] = MAX_OFFSET;
+				node.bounds[axis + 3][lane] = 0;
+				continue;
+			}
+
+			double lowOffset = std::floor((boxes[lane].minimum[axis] - origin) / scale);
+			double highOffset = std::ceil((boxes[lane].maximum[axis] - origin) / scale);
+
+			node.bounds[axis][lane] = (uint8_t)glm::clamp(lowOffset, 0.0, (double)MAX_OFFSET);
+			node.bounds[axis + 3][lane] = (uint8_t)glm::clamp(highOffset, 0.0, (double)MAX_OFFSET);
+		}
+	}
+
+} // end quantize
+
+
+void QuantizedBoundingVolumeHierarchy::decode(const QuantizedNode & node, float(&bounds)[6][WIDTH])
+{
+	for (int row = 0; row < 6; row++) {
+
+		int axis = row % 3;
+		float origin = node.origin[axis];
+		float scale = getScale(node.exponent[axis]);
+
+#if defined(QUANTIZED_BVH_SSE)
+		// Widen the eight offsets to 32 bit integers, four at a time
+		__m128i zero = _mm_setzero_si128();
+		__m128i offsets = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)node.bounds[row]), zero);
+
+		__m128 low = _mm_cvtepi32_ps(_mm_unpacklo_epi16(offsets, zero));
+		__m128 high = _mm_cvtepi32_ps(_mm_unpackhi_epi16(offsets, zero));
+
+		_mm_storeu_ps(&bounds[row][0], _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(low, _mm_set1_ps(scale))));
+		_mm_storeu_ps(&bounds[row][4], _mm_add_ps(_mm_set1_ps(origin), _mm_mul_ps(high, _mm_set1_ps(scale))));
+#else
+		for (int lane = 0; lane < WIDTH; lane++) {
+			bounds[row][lane] = origin + node.bounds[row][lane] * scale;
+		}
+#endif
+	}
+
+} // end decode
+
+
+void QuantizedBoundingVolumeHierarchy::traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const
+{
+	if (quantizedNodes.empty()) {
+		return;
+	}
+
+	SlabRay slabRay;
+	prepareRay(ray, slabRay);
+
+	// Nodes waiting to be visited and the distances at which the ray enters them
+	struct StackEntry
+	{
+		int node;
+		float entryDistance;
+	};
+
+	StackEntry stack[MAX_DEPTH * WIDTH];
+	int stackSize = 0;
+
+	stack[stackSize++] = { 0, 0.0f };
+
+	while (stackSize > 0) {
+
+		StackEntry entry = stack[--stackSize];
+
+		// The closest hit may have moved closer since the node was pushed
+		if (entry.entryDistance > closestHit.t) {
+			continue;
+		}
+
+		const QuantizedNode & node = quantizedNodes[entry.node];
+
+		float bounds[6][WIDTH];
+		decode(node, bounds);
+
+		float entryDistances[WIDTH];
+		float maxDistance = (closestHit.t < FLT_MAX) ? roundUp(closestHit.t) : FLT_MAX;
+		int mask = intersectChildren(bounds, slabRay, maxDistance, entryDistances);
+
+		// Find where the subtree or surfaces of each child are stored, and
+		// order the children that were hit by entry distance
+		int location[WIDTH];
+		int child = node.childBase;
+		int leaf = node.leafBase;
+
+		int order[WIDTH];
+		int hitCount = 0;
+
+		for (int lane = 0; lane < WIDTH; lane++) {
+
+			if (node.count[lane] == EMPTY_LANE) {
+				continue;
+			}
+
+			if (node.count[lane] == INTERIOR_LANE) {
+				location[lane] = child++;
+			}
+			else {
+				location[lane] = leaf;
+				leaf += node.count[lane];
+			}
+
+			if ((mask & (1 << lane)) == 0) {
+				continue;
+			}
+
+			int position = hitCount++;
+			while (position > 0 && entryDistances[order[position - 1]] > entryDistances[lane]) {
+				order[position] = order[position - 1];
+				position--;
+			}
+			order[position] = lane;
+		}
+
+		// Test leaves nearest first. Push interior children farthest first
+		// so that the nearest is visited next.
+		for (int i = 0; i < hitCount; i++) {
+
+			int lane = order[i];
+
+			if (node.count[lane] != INTERIOR_LANE) {
+				for (int j = location[lane]; j < location[lane] + node.count[lane]; j++) {
+					testSurface(ray, surfaceOrder[j], closestHit, closestSurface);
+				}
+			}
+		}
+
+		for (int i = hitCount - 1; i >= 0; i--) {
+
+			int lane = order[i];
+
+			if (node.count[lane] == INTERIOR_LANE) {
+				stack[stackSize++] = { location[lane], entryDistances[lane] };
+			}
+		}
+	}
+
+} // end traverse
+
+
+int QuantizedBoundingVolumeHierarchy::traverseOccluded(const Ray & ray, double maxDistance) const
+{
+	if (quantizedNodes.empty()) {
+		return -1;
+	}
+
+	SlabRay slabRay;
+	prepareRay(ray, slabRay);
+
+	float range = (maxDistance < FLT_MAX) ? roundUp(maxDistance) : FLT_MAX;
+
+	// Any blocker will do, so the children are not ordered
+	int stack[MAX_DEPTH * WIDTH];
+	int stackSize = 0;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+
+		const QuantizedNode & node = quantizedNodes[stack[--stackSize]];
+
+		float bounds[6][WIDTH];
+		decode(node, bounds);
+
+		float entryDistances[WIDTH];
+		int mask = intersectChildren(bounds, slabRay, range, entryDistances);
+
+		int child = node.childBase;
+		int leaf = node.leafBase;
+
+		for (int lane = 0; lane < WIDTH; lane++) {
+
+			if (node.count[lane] == EMPTY_LANE) {
+				continue;
+			}
+
+			if (node.count[lane] == INTERIOR_LANE) {
+				if (mask & (1 << lane)) {
+					stack[stackSize++] = child;
+				}
+				child++;
+				continue;
+			}
+
+			if (mask & (1 << lane)) {
+				for (int j = leaf; j < leaf + node.count[lane]; j++) {
+					if (surfaces[surfaceOrder[j]]->isOccluding(ray, maxDistance)) {
+						return surfaceOrder[j];
+					}
+				}
+			}
+			leaf += node.count[lane];
+		}
+	}
+
+	return -1;
+
+} // end traverseOccluded
@@ -0,0 +1,156 @@
+#pragma once
+
+#include "WideBoundingVolumeHierarchy.h"
+
+#include <cstdint>
+
+/**
+* Eight-wide bounding volume hierarchy with compressed nodes for scenes
+* whose structure would otherwise take as much memory as the surfaces.
+* Each node stores the boxes of its children as 8 bit offsets on a grid
+* that spans the box of the node, in 80 bytes where an 8-wide node of
+* floats takes 256 and two levels of binary nodes of doubles take 392.
+* The interior children of a node are stored next to each other, as are
+* the surfaces of its leaves, so a node needs one index for each instead
+* of one per child.
+*
+* The grid of each axis has a spacing that is a power of two and starts at
+* a multiple of the spacing. The spacing is chosen large enough that every
+* grid point is exactly a float, so decoding is exact, and offsets are
+* rounded outward when encoded. A decoded box therefore always contains
+* the box it was encoded from.
+*
+* The tree is built like the 8-wide hierarchy. The binary and the wide
+* nodes are freed once the compressed nodes are encoded, and refits update
+* the compressed nodes directly from the leaves up.
+*/
+class QuantizedBoundingVolumeHierarchy : public WideBoundingVolumeHierarchy<8>
+{
+public:
+
+	/**
+	* Constructor.
+	* @param buildMethod - algorithm that builds the binary tree
+	*/
+	QuantizedBoundingVolumeHierarchy(BuildMethod buildMethod = BuildMethod::SWEEP_SAH);
+
+	virtual AcceleratorType getType() const { return AcceleratorType::QUANTIZED_BVH; }
+
+	virtual const char * getName() const { return "quantized 8-wide BVH"; }
+
+	virtual double getCost() const;
+
+	virtual size_t getMemoryBytes() const;
+
+protected:
+
+	// Number of children of a node
+	static const int WIDTH = 8;
+
+	// Values of QuantizedNode::count for lanes without a child and for
+	// interior children. Leaves hold 1 to MAX_LEAF_COUNT surfaces.
+	static const uint8_t EMPTY_LANE = 0;
+	static const uint8_t INTERIOR_LANE = 255;
+	static const int MAX_LEAF_COUNT = 254;
+
+	/**
+	* Node of the compressed tree.
+	*/
+	struct QuantizedNode
+	{
+		// First grid point of each axis
+		float origin[3];
+
+		// Spacing of the grid of each axis as a power of two
+		int8_t exponent[3];
+
+		// Low x, y, and z and high x, y, and z grid offsets of the box of
+		// each child
+		uint8_t bounds[6][WIDTH];
+
+		// Kind of each child or the number of surfaces in its leaf
+		uint8_t count[WIDTH];
+
+		// Index in quantizedNodes of the first interior child. The others
+		// follow in lane order.
+		int childBase;
+
+		// Index in surfaceOrder of the first surface of the first leaf. The
+		// surfaces of the other leaves follow in lane order.
+		int leafBase;
+	};
+
+	/**
+	* Child of a node while the tree is encoded.
+	*/
+	struct EncodeChild
+	{
+		AABB bounds;
+
+		// Interior binary node, or -1 for a range of surfaceOrder
+		int node;
+
+		// Range of surfaceOrder of a leaf
+		int first;
+		int count;
+	};
+
+	virtual void buildStructure(std::vector<Primitive> & primitives, ThreadPool * threadPool);
+
+	virtual void refitStructure(const std::vector<AABB> & bounds, ThreadPool * threadPool);
+
+	virtual std::shared_ptr<Accelerator> clone() const { return std::make_shared<QuantizedBoundingVolumeHierarchy>(*this); }
+
+	virtual void traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const;
+
+	virtual int traverseOccluded(const Ray & ray, double maxDistance) const;
+
+	/**
+	* Returns true if a child of a node being encoded becomes an interior
+	* child: a binary interior node or a leaf too big for one lane.
+	*/
+	static bool isInterior(const EncodeChild & child);
+
+	/**
+	* Finds the children of the node that takes the place of a child being
+	* encoded. Binary nodes are opened largest first, as in the 8-wide
+	* hierarchy. Leaves that are too big are divided into smaller ones.
+	*/
+	void gatherChildren(const EncodeChild & parent, std::vector<EncodeChild> & children) const;
+
+	/**
+	* Fills in a node from its children and encodes its subtrees.
+	* @param nodeIndex - index in quantizedNodes of the node, already allocated
+	* @param order - surfaceOrder of the binary tree
+	* @param leafOrder - surfaces of the leaves in the order of the new tree
+	*/
+	void encodeNode(int nodeIndex, const std::vector<EncodeChild> & children,
+		const std::vector<int> & order, std::vector<int> & leafOrder);
+
+	/**
+	* Sets the grid of a node and the offsets of the boxes of its children.
+	* @param boxes - box of each lane. Ignored for empty lanes.
+	*/
+	static void quantize(QuantizedNode & node, const AABB(&boxes)[WIDTH]);
+
+	/**
+	* Recomputes the boxes of the children of a node and of its subtrees
+	* from the boxes of the surfaces. The interior children of the top
+	* levels of a large tree are refit as separate tasks.
+	* @param index - index in quantizedNodes of the node
+	* @param depth - depth of the node in the tree
+	* @returns box of the node
+	*/
+	AABB refitQuantizedNode(const std::vector<AABB> & bounds, int index, int depth, ThreadPool * threadPool);
+
+	/**
+	* Finds the boxes of the children of a node from their offsets.
+	* @param bounds - set to the minimum x, y, and z and maximum x, y, and z
+	* of each box
+	*/
+	static void decode(const QuantizedNode & node, float(&bounds)[6][WIDTH]);
+
+	// Nodes of the compressed tree. The root is the first node.
+	std::vector<QuantizedNode> quantizedNodes;
+
+}; // end QuantizedBoundingVolumeHierarchy class
@@ -0,0 +1,40 @@
+#include "Random.h"
+
+
+Random::Random(uint32_t x, uint32_t y, uint32_t sample, uint32_t bounce, uint32_t seed)
+{
+	// Hash the indices in one at a time so that swapping two of them gives
+	// a different sequence
+	state = hash(seed);
+	state = hash(state ^ (((uint64_t)x << 32) | y));
+	state = hash(state ^ (((uint64_t)sample << 32) | bounce));
+
+} // end Random constructor
+
+
+uint64_t Random::nextBits()
+{
+	// SplitMix64: a Weyl sequence passed through a hash
+	state += 0x9E3779B97F4A7C15ull;
+
+	return hash(state);
+
+} // end nextBits
+
+
+double Random::nextDouble()
+{
+	// The top 53 bits fill the mantissa of a double exactly
+	return (nextBits() >> 11) * (1.0 / 9007199254740992.0);
+
+} // end nextDouble
+
+
+uint64_t Random::hash(uint64_t value)
+{
+	value = (value ^ (value >> 30)) * 0xBF58476D1CE4E5B9ull;
+	value = (value ^ (value >> 27)) * 0x94D049BB133111EBull;
+
+	return value ^ (value >> 31);
+
+} // end hash
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+* Random number generator whose sequence is determined entirely by the
+* indices it is constructed with. Every random decision made for a sample
+* creates its own generator from the pixel, sample, and bounce indices, so
+* the decision does not depend on which thread or process makes it or on
+* the order in which pixels are rendered.
+*/
+class Random
+{
+public:
+
+	/**
+	* Constructor. Starts the sequence for one sample of a pixel.
+	* @param x - column of the pixel
+	* @param y - row of the pixel
+	* @param sample - index of the sample within the pixel
+	* @param bounce - number of bounces the path has taken
+	* @param seed - seed that selects a different set of sequences
+	*/
+	Random(uint32_t x, uint32_t y, uint32_t sample, uint32_t bounce, uint32_t seed = 0);
+
+	/**
+	* Returns the next 64 random bits of the sequence.
+	*/
+	uint64_t nextBits();
+
+	/**
+	* Returns the next number of the sequence uniformly distributed in [0, 1).
+	*/
+	double nextDouble();
+
+	/**
+	* Scrambles the bits of a value. Different inputs give uncorrelated outputs.
+	* @param value - value to scramble
+	* @returns scrambled value
+	*/
+	static uint64_t hash(uint64_t value);
+
+protected:
+
+	// Position in the sequence
+	uint64_t state;
+
+}; // end Random class
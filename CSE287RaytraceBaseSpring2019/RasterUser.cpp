@@ -10,17 +10,75 @@ FrameBuffer frameBuffer(WINDOW_WIDTH, WINDOW_HEIGHT);
 // Raytracer
 RayTracer rayTrace(frameBuffer, BLACK );
 
-// Vector holding all the surfaces in the scene
-SurfaceVector surfaces;
+// Current snapshot of the surfaces and light sources. Edits publish a new
+// snapshot while frames finish with the one they started with.
+SceneStore scene;
 
-// Vector holding all the light sources in the scene
-LightVector lights;
+// Kind of accelerator the scene is built with. Set with --accelerator.
+AcceleratorType acceleratorType = AcceleratorType::BVH;
 
-// Light sources in the same scene
-shared_ptr<LightSource> ambientLight;
-shared_ptr<PositionalLight> lightPos;
-shared_ptr<DirectionalLight> lightDir;
-shared_ptr<SpotLight> spotLight;
+// Number of instances of a shared object that are placed behind the scene.
+// Set with --instances.
+int instanceCount = 0;
+
+// Positions of the objects that are edited in the surface and light lists.
+// The ball orbits while frames are rendered continuously.
+const size_t ORBITING_BALL = 0;
+const size_t POSITIONAL_LIGHT = 0;
+const size_t DIRECTIONAL_LIGHT = 1;
+const size_t AMBIENT_LIGHT = 2;
+const size_t SPOT_LIGHT = 3;
+
+// Publishes a copy of the scene in which one light has been edited
+static void editLight(size_t index, std::function<void(LightSource &)> edit);
+
+// Number of continuous frames that have been started
+int animationFrame = 0;
+
+// Moves the objects in the scene to their positions for the next frame
+static void advanceAnimation();
+
+// Logs where each render worker ran, which memory it placed, and how often
+// the shadow rays were blocked by the occluder they tested first
+static void printWorkerStatistics();
+
+// Logs the build time and cost of the accelerator of the current scene
+static void printAcceleratorStatistics();
+
+// Logs the memory and trace time of every accelerator for the current scene.
+// The frame in flight must be stopped first, since it would slow the rays.
+static void printAcceleratorReport();
+
+// Renders frames with worker processes when started with --processes
+std::unique_ptr<DistributedRenderer> distributedRenderer;
+
+// Renders frames on a background thread so the window stays responsive.
+// A completed frame is handed to the display by swapping the color buffers,
+// after which the next frame renders into the other buffer.
+AsyncRenderer renderer([](const CancellationToken & cancelToken) {
+
+	if (renderer.isContinuous()) {
+		advanceAnimation();
+	}
+
+	std::shared_ptr<const Scene> snapshot = scene.getSnapshot();
+
+	bool completed = (distributedRenderer != nullptr) ?
+		distributedRenderer->render(snapshot, &cancelToken) :
+		rayTrace.raytraceScene(snapshot, &cancelToken);
+
+	if (completed) {
+		frameBuffer.swapColorBuffers();
+	}
+
+	return completed;
+});
+
+// Number of completed frames that have been presented in the window
+unsigned int presentedFrames = 0;
+
+// Time at which the program started, for measuring the time to the first frame
+std::chrono::steady_clock::time_point programStart = std::chrono::steady_clock::now();
 
 //***********************************
 
@@ -29,22 +87,23 @@ shared_ptr<SpotLight> spotLight;
 */
 static void RenderSceneCB()
 {
-	int frameStartTime = glutGet( GLUT_ELAPSED_TIME ); // Get start time
-
-	// Clear the color buffer
-	//frameBuffer.clearColorAndDepthBuffers( ); // Not necessary for ray tracing
+	// Display the latest completed frame. The render thread may already be
+	// tracing the next one into the back buffer.
+	frameBuffer.showColorBuffer();
 
-	// Ray trace the scene to determine the color of all the pixels in the scene
-	rayTrace.raytraceScene( surfaces, lights);
+	// Display time required to render each scene once it completes.
+	unsigned int completedFrames = renderer.getCompletedFrames();
 
-	// Display the color buffer
-	frameBuffer.showColorBuffer();
+	if (completedFrames != presentedFrames) {
 
-	// Calculate and display time required to render scene.
-	int frameEndTime = glutGet( GLUT_ELAPSED_TIME ); // Get end time
-	float totalTimeSec = (frameEndTime - frameStartTime) / 1000.0f;
+		if (presentedFrames == 0) {
+			std::cout << "Time to first frame: " << std::chrono::duration<double>(
+				std::chrono::steady_clock::now() - programStart).count() << " sec." << std::endl;
+		}
 
-	std::cout << "Render time: " << totalTimeSec << " sec." << std::endl;
+		presentedFrames = completedFrames;
+		std::cout << "Render time: " << renderer.getLastFrameSeconds() << " sec." << std::endl;
+	}
 
 } // end RenderSceneCB
 
@@ -54,6 +113,16 @@ static void RenderSceneCB()
 // resized.
 static void ResizeCB(int width, int height)
 {
+	// The first frame is started when the scene is built. Let it finish if
+	// the window came up at the size it was rendered for.
+	if (width == frameBuffer.getWindowWidth() && height == frameBuffer.getWindowHeight()) {
+		glutPostRedisplay();
+		return;
+	}
+
+	// Stop the frame in flight before reallocating the memory it renders into
+	renderer.cancel();
+
 	// Size the color buffer to match the window size.
 	frameBuffer.setFrameBufferSize( width, height );
 
@@ -61,6 +130,8 @@ static void ResizeCB(int width, int height)
 
 	rayTrace.calculatePerspectiveViewingParameters( 45.0 );
 
+	renderer.requestFrame();
+
 	// Signal the operating system to re-render the window
 	glutPostRedisplay();
 
@@ -72,54 +143,113 @@ static void ResizeCB(int width, int height)
 // program. Allows lights to be individually turned on and off.
 static void KeyboardCB(unsigned char key, int x, int y)
 {
+	// Scene edits publish a new snapshot and never touch the one the frame
+	// in flight uses, so that frame finishes and the edit shows in the next
+	// one. Ray tracer settings are not part of the snapshot, so the frame is
+	// stopped before they change and restarted below.
+	bool frameChanged = true;
+
 	switch(key) {
 
 	case('f'): case('F') : // 'f' key to toggle full screen
+		// The resize that follows restarts the frame
 		glutFullScreenToggle();
+		frameChanged = false;
 		break;
 	case(27): // Escape key
 		glutLeaveMainLoop();
+		frameChanged = false;
 		break;
-	case('0') :
-		rayTrace.setRecursionDepth( 0 );
-		break;
-	case('1') :
-		rayTrace.setRecursionDepth( 1 );
-		break;
-	case('2') :
-		rayTrace.setRecursionDepth( 2 );
-		break;
-	case('3') :
-		rayTrace.setRecursionDepth( 3 );
-		break;
-	case('4') :
-		rayTrace.setRecursionDepth( 4 );
+	case('0') : case('1') : case('2') : case('3') : case('4') :
+		renderer.cancel();
+		rayTrace.setRecursionDepth( key - '0' );
 		break;
 	case('a'):
-		ambientLight->enabled = (ambientLight->enabled) ? false : true;
+		editLight(AMBIENT_LIGHT, [](LightSource & light) { light.enabled = (light.enabled) ? false : true; });
 		break;
 	case('p'):
-		lightPos->enabled = (lightPos->enabled) ? false : true;
+		editLight(POSITIONAL_LIGHT, [](LightSource & light) { light.enabled = (light.enabled) ? false : true; });
 		break;
 	case('d'):
-		lightDir->enabled = (lightDir->enabled) ? false : true;
+		editLight(DIRECTIONAL_LIGHT, [](LightSource & light) { light.enabled = (light.enabled) ? false : true; });
 		break;
 	case('s'):
-		spotLight->enabled = (spotLight->enabled) ? false : true;
+		editLight(SPOT_LIGHT, [](LightSource & light) { light.enabled = (light.enabled) ? false : true; });
 		break;
-	case('m'):
-		ambientLight->day = true;
-		lightPos->day = true;
-		lightDir->day = true;
-		rayTrace.day = true;
+	case('r'): // Toggle continuous rendering of the animation
+		renderer.setContinuous(renderer.isContinuous() == false);
+		frameChanged = false;
+		break;
+	case('w'): // Toggle between the wavefront and recursive integrators
+		renderer.cancel();
+		rayTrace.renderWavefront = (rayTrace.renderWavefront) ? false : true;
+		break;
+	case('c'): // Log the render time of every tile of the last frame
+		renderer.cancel();
+		for (const TileCost & tileCost : rayTrace.getTileCosts()) {
+			std::cout << "Tile (" << tileCost.tile.x << ", " << tileCost.tile.y << ") "
+				<< tileCost.tile.width << "x" << tileCost.tile.height << ": "
+				<< tileCost.seconds * 1000.0 << " ms" << std::endl;
+		}
 		break;
-	case('n'):
-		ambientLight->day = false;
-		lightPos->day = false;
-		lightDir->day = false;
-		rayTrace.day = false;
+	case('b'): // Cycle through the accelerators and their builders
+		scene.edit([](Scene & next) {
+			switch (next.getAcceleratorType()) {
+			case AcceleratorType::LINEAR:
+				next.setAcceleratorType(AcceleratorType::BVH);
+				break;
+			case AcceleratorType::BVH:
+				next.setAcceleratorType(AcceleratorType::BINNED_BVH);
+				break;
+			case AcceleratorType::BINNED_BVH:
+				next.setAcceleratorType(AcceleratorType::MORTON_BVH);
+				break;
+			case AcceleratorType::MORTON_BVH:
+				next.setAcceleratorType(AcceleratorType::SPLIT_BVH);
+				break;
+			case AcceleratorType::SPLIT_BVH:
+				next.setAcceleratorType(AcceleratorType::WIDE4_BVH);
+				break;
+			case AcceleratorType::WIDE4_BVH:
+				next.setAcceleratorType(AcceleratorType::WIDE8_BVH);
+				break;
+			case AcceleratorType::WIDE8_BVH:
+				next.setAcceleratorType(AcceleratorType::QUANTIZED_BVH);
+				break;
+			case AcceleratorType::QUANTIZED_BVH:
+				next.setAcceleratorType(AcceleratorType::GRID);
+				break;
+			case AcceleratorType::GRID:
+				next.setAcceleratorType(AcceleratorType::TWO_LEVEL_GRID);
+				break;
+			default:
+				next.setAcceleratorType(AcceleratorType::LINEAR);
+				break;
+			}
+		}, rayTrace.getThreadPool().get());
+		printAcceleratorStatistics();
+		break;
+	case('k'): // Compare the memory and trace time of the accelerators
+		// Stop the frame so the timed rays have the cores to themselves
+		renderer.cancel();
+		printAcceleratorReport();
+		break;
+	case('l'): // Log the placement of the render workers, their memory, and the shadow rays
+		printWorkerStatistics();
+		frameChanged = false;
+		break;
+	case('m'): case('n'):
+		scene.edit([key](Scene & next) {
+			for (size_t light : { AMBIENT_LIGHT, POSITIONAL_LIGHT, DIRECTIONAL_LIGHT }) {
+				std::shared_ptr<LightSource> edited = next.getLights()[light]->clone();
+				edited->day = (key == 'm');
+				next.setLight(light, edited);
+			}
+			next.setDay(key == 'm');
+		});
 		break;
 	case('o'):
+		renderer.cancel();
 		if (rayTrace.renderPerspectiveView == true) {
 			rayTrace.renderPerspectiveView = false;
 		}
@@ -130,6 +260,10 @@ static void KeyboardCB(unsigned char key, int x, int y)
 		std::cout << key << " key pressed." << std::endl;
 	}
 
+	if (frameChanged) {
+		renderer.queueFrame();
+	}
+
 	glutPostRedisplay();
 
 } // end KeyboardCB
@@ -138,6 +272,8 @@ static void KeyboardCB(unsigned char key, int x, int y)
 // Responds to presses of the arrow keys
 static void SpecialKeysCB(int key, int x, int y)
 {
+	renderer.cancel();
+
 	switch(key) {
 	
 	case(GLUT_KEY_RIGHT):
@@ -150,76 +286,446 @@ static void SpecialKeysCB(int key, int x, int y)
 		std::cout << key << " key pressed." << std::endl;
 	}
 
+	renderer.requestFrame();
+
 	glutPostRedisplay();
 
 } // end SpecialKeysCB
 
 
-void buildScene()
+// Adds the tasks that create the objects and light sources to a task graph.
+// Returns the task that publishes the scene once every object exists.
+int buildScene(TaskGraph & sceneGraph)
 {
 	// Initialize random seed - used to create random colors
 	srand((unsigned int)time(NULL));
-	Material redMat(RED);
-	redMat.emissive = 0.3 * RED;
-
-	std::vector<dvec3> planeVec;
-	planeVec.push_back(dvec3(10.0, 10.0, -18.0));
-	planeVec.push_back(dvec3(10.0, 10.0, -19.0));
-	planeVec.push_back(dvec3(0.0, 10.0, -18.0));
-
-	std::vector<dvec3> planeVec2;
-	planeVec2.push_back(dvec3(-10.0, -10.0, -18.0));
-	planeVec2.push_back(dvec3(-10.0, -10.0, -19.0));
-	planeVec2.push_back(dvec3(0.0, -10.0, -18.0));
-
-	std::vector<dvec3> polyVec;
-	polyVec.push_back(dvec3(-3.5, 2.0, -10.0));
-	polyVec.push_back(dvec3(-4.0, 0.0, -10.0));
-	polyVec.push_back(dvec3(-3.0, 0.0, -10.0));
-
-	shared_ptr<Sphere> redBall = make_shared<Sphere>(dvec3(0.0, -1.0, -4.0 ), 0.7, redMat);
-	shared_ptr<Sphere> blueBall = make_shared<Sphere>(dvec3(1.0, 0.0, -3.0), 0.4, BLUE);
-	shared_ptr<Sphere> grayBall = make_shared<Sphere>(dvec3(1.0, 0.5, -7.0), 1.5, DARK_GRAY);
-	shared_ptr<Plane> plane = make_shared<Plane>(dvec3(0,-3, 0), dvec3(0,1,0), MAGENTA * 0.5);
-//	shared_ptr<Plane> bluePlane = make_shared<Plane>(planeVec2, YELLOW);
-	shared_ptr<ConvexPolygon> magentaPolygon = make_shared<ConvexPolygon>(polyVec, RED);
-	shared_ptr<Ellipsoid> cyanEllipse = make_shared<Ellipsoid>(dvec3(-2.0, -2.0, -6.0), CYAN);
-	shared_ptr<Cylinder> greenCylinder = make_shared<Cylinder>(dvec3(3.3, 2.0, -9.0), GREEN);
-
-	//surfaces.push_back(redBall);
-	surfaces.push_back(blueBall);
-	surfaces.push_back(grayBall);
-	surfaces.push_back(magentaPolygon);
-	surfaces.push_back(cyanEllipse);
-	surfaces.push_back(plane);
-//	surfaces.push_back(bluePlane);
-	surfaces.push_back(greenCylinder);
-
-	ambientLight = make_shared<LightSource>(WHITE);
-	ambientLight->ambientLightColor = color(0.15, 0.15, 0.15, 1.0);
-	lightPos = make_shared<PositionalLight>(dvec3(-10.0, 10.0, 10.0), color(1.0, 1.0, 1.0, 1));
-	lightDir = make_shared<DirectionalLight>(dvec3(1, 1, 1), color(0.75, 0.75, 0.75, 1));
-	spotLight = make_shared<SpotLight>(dvec3(0, 0, 0), dvec3(0, 0, -10.0), glm::cos(glm::radians(15.0f)), color(1.0, 1.0, 1.0, 1));
-
-	lights.push_back(lightPos);
-	lights.push_back(lightDir);
-	lights.push_back(ambientLight);
-	lights.push_back(spotLight);
-}
+
+	// Each object is created by its own task into a fixed slot so that the
+	// lists are in the same order however the tasks are scheduled.
+	shared_ptr<SurfaceVector> surfaces = make_shared<SurfaceVector>(6);
+	shared_ptr<LightVector> lights = make_shared<LightVector>(4);
+	shared_ptr<SurfaceVector> instances = make_shared<SurfaceVector>();
+
+	std::vector<int> sceneTasks;
+
+	//Material redMat(RED);
+	//redMat.emissive = 0.3 * RED;
+	//shared_ptr<Sphere> redBall = make_shared<Sphere>(dvec3(0.0, -1.0, -4.0 ), 0.7, redMat);
+
+	sceneTasks.push_back(sceneGraph.addTask([surfaces] {
+		(*surfaces)[ORBITING_BALL] = make_shared<Sphere>(dvec3(1.0, 0.0, -3.0), 0.4, BLUE);
+	}));
+
+	sceneTasks.push_back(sceneGraph.addTask([surfaces] {
+		(*surfaces)[1] = make_shared<Sphere>(dvec3(1.0, 0.5, -7.0), 1.5, DARK_GRAY);
+	}));
+
+	sceneTasks.push_back(sceneGraph.addTask([surfaces] {
+		std::vector<dvec3> polyVec;
+		polyVec.push_back(dvec3(-3.5, 2.0, -10.0));
+		polyVec.push_back(dvec3(-4.0, 0.0, -10.0));
+		polyVec.push_back(dvec3(-3.0, 0.0, -10.0));
+
+		(*surfaces)[2] = make_shared<ConvexPolygon>(polyVec, RED);
+	}));
+
+	sceneTasks.push_back(sceneGraph.addTask([surfaces] {
+		(*surfaces)[3] = make_shared<Ellipsoid>(dvec3(-2.0, -2.0, -6.0), CYAN);
+	}));
+
+	sceneTasks.push_back(sceneGraph.addTask([surfaces] {
+		(*surfaces)[4] = make_shared<Plane>(dvec3(0,-3, 0), dvec3(0,1,0), MAGENTA * 0.5);
+	}));
+
+	//std::vector<dvec3> planeVec2;
+	//planeVec2.push_back(dvec3(-10.0, -10.0, -18.0));
+	//planeVec2.push_back(dvec3(-10.0, -10.0, -19.0));
+	//planeVec2.push_back(dvec3(0.0, -10.0, -18.0));
+	//shared_ptr<Plane> bluePlane = make_shared<Plane>(planeVec2, YELLOW);
+
+	sceneTasks.push_back(sceneGraph.addTask([surfaces] {
+		(*surfaces)[5] = make_shared<Cylinder>(dvec3(3.3, 2.0, -9.0), GREEN);
+	}));
+
+	// Rows of copies of one object on the floor behind the other surfaces.
+	// The copies share the object and differ only in their transformations.
+	sceneTasks.push_back(sceneGraph.addTask([instances] {
+
+		if (instanceCount <= 0) {
+			return;
+		}
+
+		SurfaceVector objectSurfaces;
+		objectSurfaces.push_back(make_shared<Sphere>(dvec3(0.0, 0.5, 0.0), 0.5, YELLOW));
+		objectSurfaces.push_back(make_shared<ConvexPolygon>(std::vector<dvec3>{
+			dvec3(-0.5, 0.0, 0.5), dvec3(0.5, 0.0, 0.5), dvec3(0.0, 1.5, -0.5) }, LIGHT_BLUE));
+
+		std::shared_ptr<const Accelerator> object = Instance::createObject(objectSurfaces);
+		int columns = (int)glm::ceil(glm::sqrt((double)instanceCount));
+
+		for (int i = 0; i < instanceCount; i++) {
+
+			dvec3 position(-10.0 + 20.0 * (i % columns) / columns, -3.0, -12.0 - 20.0 * (i / columns) / columns);
+			dmat4 transform = glm::translate(position) * glm::rotate(0.7 * i, dvec3(0.0, 1.0, 0.0)) *
+				glm::scale(dvec3(0.5 + 0.25 * (i % 3)));
+
+			instances->push_back(make_shared<Instance>(object, transform));
+		}
+	}));
+
+	sceneTasks.push_back(sceneGraph.addTask([lights] {
+		(*lights)[POSITIONAL_LIGHT] = make_shared<PositionalLight>(dvec3(-10.0, 10.0, 10.0), color(1.0, 1.0, 1.0, 1));
+	}));
+
+	sceneTasks.push_back(sceneGraph.addTask([lights] {
+		(*lights)[DIRECTIONAL_LIGHT] = make_shared<DirectionalLight>(dvec3(1, 1, 1), color(0.75, 0.75, 0.75, 1));
+	}));
+
+	sceneTasks.push_back(sceneGraph.addTask([lights] {
+		shared_ptr<LightSource> ambientLight = make_shared<LightSource>(WHITE);
+		ambientLight->ambientLightColor = color(0.15, 0.15, 0.15, 1.0);
+		(*lights)[AMBIENT_LIGHT] = ambientLight;
+	}));
+
+	sceneTasks.push_back(sceneGraph.addTask([lights] {
+		(*lights)[SPOT_LIGHT] = make_shared<SpotLight>(dvec3(0, 0, 0), dvec3(0, 0, -10.0), glm::cos(glm::radians(15.0f)), color(1.0, 1.0, 1.0, 1));
+	}));
+
+	// Any surface can hide or shadow any pixel, so nothing can be rendered
+	// correctly until every object exists. The accelerator is built over
+	// the surfaces by this task with the help of the render threads.
+	return sceneGraph.addTask([surfaces, lights, instances] {
+		surfaces->insert(surfaces->end(), instances->begin(), instances->end());
+		scene.publish(make_shared<Scene>(*surfaces, *lights, true, acceleratorType, rayTrace.getThreadPool().get()));
+		printAcceleratorStatistics();
+	}, sceneTasks);
+
+} // end buildScene
+
+
+// Called by the render thread before each continuous frame. Publishes a
+// scene in which a copy of the orbiting ball has moved.
+static void advanceAnimation()
+{
+	double angle = glm::radians(5.0 * animationFrame++);
+
+	scene.edit([angle](Scene & next) {
+		shared_ptr<Sphere> orbitingBall = make_shared<Sphere>(*std::static_pointer_cast<Sphere>(next.getSurfaces()[ORBITING_BALL]));
+		orbitingBall->center = dvec3(1.0 + 0.5 * glm::cos(angle), 0.0, -3.0 + 0.5 * glm::sin(angle));
+		next.setSurface(ORBITING_BALL, orbitingBall);
+	}, rayTrace.getThreadPool().get());
+
+} // end advanceAnimation
+
+
+static void editLight(size_t index, std::function<void(LightSource &)> edit)
+{
+	scene.edit([index, &edit](Scene & next) {
+		std::shared_ptr<LightSource> light = next.getLights()[index]->clone();
+		edit(*light);
+		next.setLight(index, light);
+	});
+
+} // end editLight
+
+
+static void printWorkerStatistics()
+{
+	std::vector<WorkerStatistics> statistics = rayTrace.getThreadPool()->getWorkerStatistics();
+	const std::vector<size_t> & touchedBytes = rayTrace.getFirstTouchedBytes();
+
+	for (size_t i = 0; i < statistics.size(); i++) {
+
+		const WorkerStatistics & worker = statistics[i];
+
+		std::cout << "Worker " << i << ": ";
+
+		if (worker.core < 0) {
+			std::cout << "not pinned";
+		}
+		else {
+			std::cout << "core " << worker.core << (worker.pinned ? " (pinned)" : " (pinning failed)");
+		}
+
+		std::cout << ", " << worker.tasksRun << " tasks, " << worker.tasksStolen << " stolen, "
+			<< worker.tasksOffCore << " off core";
+
+		if (i < touchedBytes.size()) {
+			std::cout << ", first touched " << touchedBytes[i] / 1024 << " KB";
+		}
+
+		std::cout << std::endl;
+	}
+
+	std::cout << "Frame buffer huge pages: " << (frameBuffer.usesHugePages() ? "yes" : "no") << std::endl;
+
+	OccluderCacheStatistics occluders = OccluderCache::getStatistics();
+
+	std::cout << "Shadow rays: " << occluders.lookups << ", " << occluders.occluded << " blocked, "
+		<< occluders.hits << " by the cached occluder";
+
+	if (occluders.occluded > 0) {
+		std::cout << " (" << 100.0 * occluders.hits / occluders.occluded << "%)";
+	}
+
+	std::cout << std::endl;
+
+} // end printWorkerStatistics
+
+
+static void printAcceleratorStatistics()
+{
+	const Accelerator & accelerator = scene.getSnapshot()->getAccelerator();
+
+	std::cout << "Accelerator: " << accelerator.getName() << ((accelerator.getRefitCount() > 0) ? ", refit in " : ", built in ")
+		<< accelerator.getBuildSeconds() * 1000.0 << " ms, SAH cost " << accelerator.getCost();
+
+	if (accelerator.getRefitCount() > 0) {
+		std::cout << " after " << accelerator.getRefitCount() << " refits";
+	}
+
+	std::cout << std::endl;
+
+	std::string statistics = accelerator.getStatistics();
+
+	if (statistics.empty() == false) {
+		std::cout << "  " << statistics << std::endl;
+	}
+
+} // end printAcceleratorStatistics
+
+
+static void printAcceleratorReport()
+{
+	std::shared_ptr<const Scene> current = scene.getSnapshot();
+	double baseBytes = 0.0;
+	double baseSeconds = 0.0;
+
+	// Compared to the binary hierarchy with uncompressed nodes
+	for (AcceleratorType type : { AcceleratorType::BVH, AcceleratorType::SPLIT_BVH,
+		AcceleratorType::WIDE4_BVH, AcceleratorType::WIDE8_BVH, AcceleratorType::QUANTIZED_BVH,
+		AcceleratorType::GRID, AcceleratorType::TWO_LEVEL_GRID }) {
+
+		Scene copy(*current);
+		copy.setAcceleratorType(type);
+		copy.buildAccelerator(rayTrace.getThreadPool().get());
+
+		const Accelerator & accelerator = copy.getAccelerator();
+		double bytes = (double)accelerator.getMemoryBytes();
+		double seconds = rayTrace.timeViewRays(accelerator);
+
+		if (type == AcceleratorType::BVH) {
+			baseBytes = bytes;
+			baseSeconds = seconds;
+		}
+
+		std::cout << accelerator.getName() << ": " << bytes / 1024.0 << " KB (" << 100.0 * bytes / baseBytes
+			<< "%), view rays in " << seconds * 1000.0 << " ms (" << seconds / baseSeconds << "x)" << std::endl;
+
+		std::string statistics = accelerator.getStatistics();
+
+		if (statistics.empty() == false) {
+			std::cout << "  " << statistics << std::endl;
+		}
+	}
+
+} // end printAcceleratorReport
 
 
 // Register as the "idle" function to have the screen continously
 // repainted. Due to software rendering, the frame rate will not
-// be fast enough to support motion simulation
+// be fast enough to support motion simulation. Repaints whenever
+// the render thread has swapped in a newly completed frame.
 static void animate()  
 {
-	glutPostRedisplay();
+	if (renderer.getCompletedFrames() != presentedFrames) {
+		glutPostRedisplay();
+	}
+	else {
+		std::this_thread::sleep_for(std::chrono::milliseconds(5));
+	}
 
 } // end animate
 
 
 int main(int argc, char** argv)
 {
+	// Keyframe file and output of a sequence rendered without a window
+	string keyframePath;
+	string sequencePath;
+	int sequenceFrames = 48;
+	int framesInFlight = 0;
+
+	// File of stored calibrations. Empty unless calibration was requested.
+	string calibrationPath;
+
+	// Command line arguments that configure the ray tracer. Arguments meant
+	// for GLUT are skipped.
+	for (int i = 1; i < argc; i++) {
+
+		string argument = argv[i];
+
+		if (argument == "--threads" && i + 1 < argc) {
+			rayTrace.setThreadCount(atoi(argv[++i]));
+		}
+		else if (argument == "--tile-size" && i + 1 < argc) {
+			rayTrace.setTileSize(atoi(argv[++i]));
+		}
+		else if (argument == "--pin-threads") {
+			rayTrace.setThreadPinning(true);
+		}
+		else if (argument == "--accelerator" && i + 1 < argc) {
+			string name = argv[++i];
+			if (name == "linear") {
+				acceleratorType = AcceleratorType::LINEAR;
+			}
+			else if (name == "binned") {
+				acceleratorType = AcceleratorType::BINNED_BVH;
+			}
+			else if (name == "morton") {
+				acceleratorType = AcceleratorType::MORTON_BVH;
+			}
+			else if (name == "split") {
+				acceleratorType = AcceleratorType::SPLIT_BVH;
+			}
+			else if (name == "wide4") {
+				acceleratorType = AcceleratorType::WIDE4_BVH;
+			}
+			else if (name == "wide8") {
+				acceleratorType = AcceleratorType::WIDE8_BVH;
+			}
+			else if (name == "quantized") {
+				acceleratorType = AcceleratorType::QUANTIZED_BVH;
+			}
+			else if (name == "grid") {
+				acceleratorType = AcceleratorType::GRID;
+			}
+			else if (name == "grid2") {
+				acceleratorType = AcceleratorType::TWO_LEVEL_GRID;
+			}
+			else {
+				acceleratorType = AcceleratorType::BVH;
+			}
+		}
+		else if (argument == "--serial") {
+			rayTrace.renderTiled = false;
+		}
+		else if (argument == "--wavefront") {
+			rayTrace.renderWavefront = true;
+		}
+		else if (argument == "--samples" && i + 1 < argc) {
+			rayTrace.setSamplesPerPixel(atoi(argv[++i]));
+		}
+		else if (argument == "--packet-size" && i + 1 < argc) {
+			rayTrace.packetSize = atoi(argv[++i]);
+		}
+		else if (argument == "--no-binning") {
+			rayTrace.binViewRays = false;
+		}
+		else if (argument == "--instances" && i + 1 < argc) {
+			instanceCount = atoi(argv[++i]);
+		}
+		else if (argument == "--seed" && i + 1 < argc) {
+			rayTrace.setRandomSeed((uint32_t)strtoul(argv[++i], nullptr, 10));
+		}
+		else if (argument == "--processes" && i + 1 < argc) {
+			distributedRenderer.reset(new DistributedRenderer(rayTrace, frameBuffer, atoi(argv[++i])));
+		}
+		else if (argument == "--sequence" && i + 2 < argc) {
+			keyframePath = argv[++i];
+			sequencePath = argv[++i];
+		}
+		else if (argument == "--frames" && i + 1 < argc) {
+			sequenceFrames = atoi(argv[++i]);
+		}
+		else if (argument == "--frames-in-flight" && i + 1 < argc) {
+			framesInFlight = atoi(argv[++i]);
+		}
+		else if (argument == "--calibrate") {
+			calibrationPath = "calibration.txt";
+		}
+		else if (argument == "--calibration-file" && i + 1 < argc) {
+			calibrationPath = argv[++i];
+		}
+	}
+
+	// Render the sequence to files and exit without creating a window
+	if (sequencePath.empty() == false) {
+
+		std::vector<Keyframe> keyframes;
+
+		if (SequenceRenderer::loadKeyframes(keyframePath, keyframes) == false) {
+			return 1;
+		}
+
+		{
+			TaskGraph sceneGraph(rayTrace.getThreadPool());
+			buildScene(sceneGraph);
+			sceneGraph.run();
+			sceneGraph.wait();
+		}
+
+		// Calibrate with the view of the first keyframe. The frame buffer
+		// has the size of the frames of the sequence.
+		if (calibrationPath.empty() == false) {
+			rayTrace.setCameraFrame(keyframes[0].position, keyframes[0].viewingDirection, keyframes[0].up);
+			rayTrace.calculatePerspectiveViewingParameters(45.0);
+			Calibrator(rayTrace, frameBuffer).calibrate(scene.getSnapshot(), calibrationPath);
+		}
+
+		SequenceFormat format = (sequencePath.size() > 4 &&
+			sequencePath.compare(sequencePath.size() - 4, 4, ".ppm") == 0) ?
+			SequenceFormat::PPM : SequenceFormat::Y4M;
+
+		SequenceRenderer sequenceRenderer(rayTrace, WINDOW_WIDTH, WINDOW_HEIGHT);
+		sequenceRenderer.setFramesInFlight(framesInFlight);
+
+		auto startTime = std::chrono::steady_clock::now();
+
+		bool succeeded = sequenceRenderer.render(keyframes, sequenceFrames, scene.getSnapshot(), sequencePath, format);
+
+		std::cout << "Rendered " << sequenceFrames << " frames in "
+			<< std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count()
+			<< " sec. with up to " << sequenceRenderer.getFramesInFlight() << " frames in flight." << std::endl;
+
+		if (rayTrace.getThreadPinning()) {
+			printWorkerStatistics();
+		}
+
+		return succeeded ? 0 : 1;
+	}
+
+	rayTrace.setCameraFrame( dvec3( 0, 0, 0 ), dvec3( 0, 0, -1 ), dvec3( 0, 1, 0 ) );
+	rayTrace.calculatePerspectiveViewingParameters( 45.0 );
+
+	// The tasks of the scene graph read the ray tracer and the frame buffer,
+	// so both are configured before it runs.
+
+	// Set red, green, blue, and alpha to which the color buffer is cleared.
+	frameBuffer.setClearColor(color(0,0,0,1));
+
+	// Set the color to which pixels will be cleared if there is no intersection.
+	// TODO
+	rayTrace.setDefaultColor(BLACK);
+
+	// Create the objects and light sources on the render threads and start
+	// the first frame as soon as they exist, while the window is created on
+	// this thread.
+	std::unique_ptr<TaskGraph> sceneGraph(new TaskGraph(rayTrace.getThreadPool()));
+	int sceneReady = buildScene(*sceneGraph);
+
+	// Tune the ray tracer before the first frame. Replacing its thread pool
+	// here is safe because the graph keeps the pool it runs on alive until
+	// the graph is destroyed.
+	if (calibrationPath.empty() == false) {
+		sceneReady = sceneGraph->addTask([&calibrationPath] {
+			Calibrator(rayTrace, frameBuffer).calibrate(scene.getSnapshot(), calibrationPath);
+		}, { sceneReady });
+	}
+
+	sceneGraph->addTask([] { renderer.requestFrame(); }, { sceneReady });
+	sceneGraph->run();
+
 	// freeGlut and Window initialization ***********************
 
     // Pass any applicable command line arguments to GLUT. These arguments
@@ -242,22 +748,17 @@ int main(int argc, char** argv)
 	// Request that the window be made full screen
 	//glutFullScreenToggle();
 
-	// Set red, green, blue, and alpha to which the color buffer is cleared.
-	frameBuffer.setClearColor(color(0,0,0,1));
-
-	// Set the color to which pixels will be cleared if there is no intersection.
-	// TODO
-	rayTrace.setDefaultColor(BLACK);
-
 	// Callback for window redisplay
 	glutDisplayFunc(RenderSceneCB);		
 	glutReshapeFunc(ResizeCB);
 	glutKeyboardFunc(KeyboardCB);
 	glutSpecialFunc(SpecialKeysCB);
-	//glutIdleFunc( RenderSceneCB );
+	glutIdleFunc( animate );
 
-	// Create the objects and light sources.
-	buildScene();
+	// The callbacks read the scene. Destroying the graph stops the workers
+	// of the pool that calibration replaced.
+	sceneGraph->wait();
+	sceneGraph.reset();
 
 	// Enter the GLUT main loop. Control will not return until the window is closed.
     glutMainLoop();
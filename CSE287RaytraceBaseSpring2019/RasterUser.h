@@ -2,12 +2,20 @@
 
 
 #include <time.h> 
+#include <chrono>
 #include "RayTracer.h"
+#include "AsyncRenderer.h"
+#include "DistributedRenderer.h"
+#include "SequenceRenderer.h"
+#include "TaskGraph.h"
+#include "Calibrator.h"
+#include "Scene.h"
 #include "Sphere.h"
 #include "Plane.h"
 #include "ConvexPolygon.h"
 #include "Ellipsoid.h"
 #include "Cylinder.h"
+#include "Instance.h"
 
 /**
 * Acts as the display function for the window. 
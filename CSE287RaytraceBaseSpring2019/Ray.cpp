@@ -1,6 +1,7 @@
 #include "Ray.h"
+#include "Accelerator.h"
 
-HitRecord Ray::findIntersection(SurfaceVector & surfaces) {
+HitRecord Ray::findIntersection(const SurfaceVector & surfaces) {
 	HitRecord nearestHit;
 	Ray r;
 	r.direct = this->direct;
@@ -14,4 +15,12 @@ HitRecord Ray::findIntersection(SurfaceVector & surfaces) {
 		}
 	}
 	return nearestHit;
-}
\ No newline at end of file
+}
+
+HitRecord Ray::findIntersection(const Accelerator & accelerator) {
+	return accelerator.findClosestIntersection(*this);
+}
+
+bool Ray::isOccluded(const Accelerator & accelerator, double maxDistance) {
+	return accelerator.isOccluded(*this, maxDistance);
+}
@@ -16,6 +16,20 @@ struct Ray
 	{
 	}
 
-	HitRecord findIntersection(SurfaceVector & surfaces);
+	/**
+	* Finds the closest intersection by testing every surface in a list.
+	*/
+	HitRecord findIntersection(const SurfaceVector & surfaces);
+
+	/**
+	* Finds the closest intersection using the accelerator of a scene.
+	*/
+	HitRecord findIntersection(const class Accelerator & accelerator);
+
+	/**
+	* Checks whether any surface in the scene of an accelerator is
+	* intersected closer than maxDistance. Used for shadow rays.
+	*/
+	bool isOccluded(const class Accelerator & accelerator, double maxDistance);
 
 };
@@ -0,0 +1,127 @@
+#pragma once
+
+#include "Ray.h"
+
+#include <cmath>
+
+/**
+* Up to MAX_SIZE rays that traverse an accelerator together. Stored as a
+* structure of arrays like RayQueue, so that a kernel that processes the
+* same component of every ray walks contiguous memory and can be compiled
+* to SIMD instructions. Rays are enabled with a mask in which bit i stands
+* for ray i.
+*
+* Camera rays of neighboring pixels are coherent: perspective rays share
+* the eye as their origin and orthographic rays share their direction.
+* A packet of them visits nearly the same nodes, so each node is fetched
+* and tested once for the whole packet, and terms that depend only on the
+* shared origin or direction are computed once per surface.
+*/
+struct RayPacket
+{
+	// Largest number of rays in a packet. Masks are ints.
+	static const int MAX_SIZE = 16;
+
+	RayPacket()
+	{
+		clear();
+	}
+
+	/**
+	* Removes every ray.
+	*/
+	void clear()
+	{
+		size = 0;
+		sharedOrigin = true;
+		sharedDirection = true;
+	}
+
+	/**
+	* Appends a ray to the packet. Its direction is stored as is.
+	*/
+	void push(const Ray & ray)
+	{
+		originX[size] = ray.origin.x;
+		originY[size] = ray.origin.y;
+		originZ[size] = ray.origin.z;
+		directionX[size] = ray.direct.x;
+		directionY[size] = ray.direct.y;
+		directionZ[size] = ray.direct.z;
+		inverseDirectionX[size] = getInverse(ray.direct.x);
+		inverseDirectionY[size] = getInverse(ray.direct.y);
+		inverseDirectionZ[size] = getInverse(ray.direct.z);
+
+		if (size > 0) {
+			sharedOrigin = sharedOrigin && ray.origin == getOrigin(0);
+			sharedDirection = sharedDirection && ray.direct == getDirection(0);
+		}
+
+		size++;
+	}
+
+	/**
+	* Returns the mask that enables every ray of the packet.
+	*/
+	int getMask() const { return (1 << size) - 1; }
+
+	/**
+	* Returns the origin of a ray.
+	*/
+	dvec3 getOrigin(int lane) const { return dvec3(originX[lane], originY[lane], originZ[lane]); }
+
+	/**
+	* Returns the direction of a ray.
+	*/
+	dvec3 getDirection(int lane) const { return dvec3(directionX[lane], directionY[lane], directionZ[lane]); }
+
+	/**
+	* Returns a ray in the form the surfaces intersect. The direction is not
+	* normalized again.
+	*/
+	Ray getRay(int lane) const
+	{
+		Ray ray;
+		ray.origin = getOrigin(lane);
+		ray.direct = getDirection(lane);
+		return ray;
+	}
+
+	/**
+	* Returns one divided by a component of a direction. Components too
+	* small to invert are replaced by a tiny value of the same sign, so that
+	* slab tests never multiply zero by infinity.
+	*/
+	static double getInverse(double component)
+	{
+		if (std::abs(component) < 1e-20) {
+			component = (component < 0.0) ? -1e-20 : 1e-20;
+		}
+
+		return 1.0 / component;
+	}
+
+	// Number of rays in the packet
+	int size;
+
+	// True if every ray has the origin of the first
+	bool sharedOrigin;
+
+	// True if every ray has the direction of the first
+	bool sharedDirection;
+
+	// Components of the ray origins
+	double originX[MAX_SIZE];
+	double originY[MAX_SIZE];
+	double originZ[MAX_SIZE];
+
+	// Components of the ray directions
+	double directionX[MAX_SIZE];
+	double directionY[MAX_SIZE];
+	double directionZ[MAX_SIZE];
+
+	// One divided by each component of the ray directions
+	double inverseDirectionX[MAX_SIZE];
+	double inverseDirectionY[MAX_SIZE];
+	double inverseDirectionZ[MAX_SIZE];
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "Ray.h"
+
+/**
+* Batch of rays stored as a structure of arrays, so that a stage of the
+* wavefront pipeline that reads one component of every ray walks
+* contiguous memory. Each ray carries the index of the path (pixel) it
+* belongs to and the distance beyond which its hits are ignored.
+*/
+struct RayQueue
+{
+	/**
+	* Removes every ray. Keeps the allocated memory.
+	*/
+	void clear()
+	{
+		originX.clear();
+		originY.clear();
+		originZ.clear();
+		directionX.clear();
+		directionY.clear();
+		directionZ.clear();
+		path.clear();
+		maxDistance.clear();
+	}
+
+	/**
+	* Appends a ray to the queue.
+	* @param ray - ray to append. Its direction is stored as is.
+	* @param rayPath - index of the path the ray belongs to
+	* @param rayMaxDistance - distance beyond which hits are ignored
+	*/
+	void push(const Ray & ray, int rayPath, double rayMaxDistance = FLT_MAX)
+	{
+		originX.push_back(ray.origin.x);
+		originY.push_back(ray.origin.y);
+		originZ.push_back(ray.origin.z);
+		directionX.push_back(ray.direct.x);
+		directionY.push_back(ray.direct.y);
+		directionZ.push_back(ray.direct.z);
+		path.push_back(rayPath);
+		maxDistance.push_back(rayMaxDistance);
+	}
+
+	/**
+	* Returns the number of rays in the queue.
+	*/
+	size_t size() const { return path.size(); }
+
+	/**
+	* Returns the origin of a ray.
+	*/
+	dvec3 getOrigin(size_t i) const { return dvec3(originX[i], originY[i], originZ[i]); }
+
+	/**
+	* Returns the direction of a ray.
+	*/
+	dvec3 getDirection(size_t i) const { return dvec3(directionX[i], directionY[i], directionZ[i]); }
+
+	/**
+	* Returns a ray in the form the surfaces intersect. The direction is not
+	* normalized again.
+	*/
+	Ray getRay(size_t i) const
+	{
+		Ray ray;
+		ray.origin = getOrigin(i);
+		ray.direct = getDirection(i);
+		return ray;
+	}
+
+	// Components of the ray origins
+	std::vector<double> originX;
+	std::vector<double> originY;
+	std::vector<double> originZ;
+
+	// Components of the ray directions
+	std::vector<double> directionX;
+	std::vector<double> directionY;
+	std::vector<double> directionZ;
+
+	// Path that each ray extends
+	std::vector<int> path;
+
+	// Distance beyond which hits are ignored
+	std::vector<double> maxDistance;
+};
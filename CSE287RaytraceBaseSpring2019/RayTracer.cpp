@@ -1,16 +1,60 @@
 #include "RayTracer.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <chrono>
 
 
 RayTracer::RayTracer(FrameBuffer & cBuffer, color defaultColor )
-:colorBuffer(cBuffer), defaultColor(defaultColor), recursionDepth(2)
+:colorBuffer(cBuffer), defaultColor(defaultColor), recursionDepth(3),
+threadPool(make_shared<ThreadPool>())
 {
 	
 }
 
 
+RayTracer::RayTracer(FrameBuffer & cBuffer, const RayTracer & settings)
+:colorBuffer(cBuffer), defaultColor(settings.defaultColor),
+eye(settings.eye), u(settings.u), v(settings.v), w(settings.w),
+rightLimit(settings.rightLimit), leftLimit(settings.leftLimit),
+topLimit(settings.topLimit), bottomLimit(settings.bottomLimit),
+nx((double)cBuffer.getWindowWidth()), ny((double)cBuffer.getWindowHeight()),
+distToPlane(settings.distToPlane), recursionDepth(settings.recursionDepth), tileSize(settings.tileSize),
+samplesPerPixel(settings.samplesPerPixel), randomSeed(settings.randomSeed),
+threadPool(settings.threadPool)
+{
+	renderPerspectiveView = settings.renderPerspectiveView;
+	renderTiled = settings.renderTiled;
+	costAwareScheduling = settings.costAwareScheduling;
+	renderWavefront = settings.renderWavefront;
+	packetSize = settings.packetSize;
+	binViewRays = settings.binViewRays;
+
+} // end RayTracer constructor
+
+
+void RayTracer::setThreadCount(int threadCount)
+{
+	threadPool = make_shared<ThreadPool>(threadCount, threadPool->isPinned());
+
+} // end setThreadCount
+
+
+void RayTracer::setThreadPinning(bool pinned)
+{
+	threadPool = make_shared<ThreadPool>(threadPool->getThreadCount(), pinned);
+
+	// The new workers may sit on other cores than the ones that touched
+	// the frame buffer
+	touchedAllocation = 0;
+	firstTouchedBytes.clear();
+
+} // end setThreadPinning
+
+
 void RayTracer::setCameraFrame(const dvec3 & viewPosition, const dvec3 & viewingDirection, dvec3 up)
 {
-	// TODO
+	eye = viewPosition;
 	w = glm::normalize(-viewingDirection);
 	u = glm::normalize(glm::cross(up, w));
 	v = glm::normalize(glm::cross(w, u));
@@ -57,28 +101,592 @@ void RayTracer::calculateOrthographicViewingParameters(const double & viewPlaneH
 } // end calculateOrthographicViewingParameters
 
 
-void RayTracer::raytraceScene(const SurfaceVector & surfaces, const LightVector & lights)
+bool RayTracer::raytraceScene(std::shared_ptr<const Scene> scene,
+	const CancellationToken * cancelToken)
 {
-	this->surfacesInScene = surfaces;
-	this->lightsInScene = lights;
+	prepareFrame(scene);
 
-	// Iterate through each and every pixel in the rendering window
-	// TODO
-	for (int y = 0; y < colorBuffer.getWindowHeight(); y++) {
-		for (int x = 0; x < colorBuffer.getWindowWidth(); x++) {
-			if (renderPerspectiveView == true) {
-				Ray r = getPerspectiveViewRay(x, y);
-				color c = traceIndividualRay(r, 3);
-				colorBuffer.setPixel(x, y, c);
+	return renderFrame(cancelToken);
+
+} // end raytraceScene
+
+
+void RayTracer::prepareFrame(std::shared_ptr<const Scene> scene)
+{
+	// Held until the next frame, so edits published meanwhile cannot
+	// change or free anything this frame reads
+	this->scene = scene;
+
+	if (binViewRays == true) {
+
+		ViewProjection projection = { eye, u, v, w, leftLimit, rightLimit, bottomLimit, topLimit,
+			distToPlane, (int)nx, (int)ny, renderPerspectiveView };
+
+		screenBinning.build(scene->getSurfaces(), scene->getAccelerator(), projection);
+	}
+	else {
+		screenBinning.clear();
+	}
+
+} // end prepareFrame
+
+
+bool RayTracer::renderFrame(const CancellationToken * cancelToken)
+{
+	if (renderTiled == false) {
+
+		// Iterate through each and every pixel in the rendering window
+		for (const Tile & tile : createTiles()) {
+
+			if (cancelToken != nullptr && cancelToken->isCancelled()) {
+				return false;
+			}
+			renderTile(tile);
+		}
+		return true;
+	}
+
+	std::vector<Tile> tiles = createTiles();
+	std::vector<TileTask> tasks = scheduleTiles(tiles);
+	std::vector<double> taskSeconds(tasks.size(), 0.0);
+
+	bool pinned = threadPool->isPinned();
+
+	if (pinned) {
+		touchFrameBuffer();
+	}
+
+	// Every tile is a separate task. Tasks are spread round robin over the
+	// worker queues, or go to the worker whose memory they write when the
+	// workers are pinned, and idle workers steal from busy ones.
+	TaskGroup frameTasks;
+
+	for (size_t i = 0; i < tasks.size(); i++) {
+
+		auto task = [this, &tasks, &taskSeconds, cancelToken, i] {
+
+			if (cancelToken != nullptr && cancelToken->isCancelled()) {
+				return;
+			}
+
+			auto startTime = std::chrono::steady_clock::now();
+			renderTile(tasks[i].tile);
+			taskSeconds[i] = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+		};
+
+		if (pinned) {
+			threadPool->submit(task, frameTasks, getHomeWorker(tasks[i].tile));
+		}
+		else {
+			threadPool->submit(task, frameTasks);
+		}
+	}
+
+	threadPool->wait(frameTasks);
+
+	// Costs of a partial frame would mislead the schedule of the next one
+	if (cancelToken != nullptr && cancelToken->isCancelled()) {
+		return false;
+	}
+
+	// Charge the time of every task to the tile it came from
+	tileCosts.clear();
+	for (const Tile & tile : tiles) {
+		tileCosts.push_back({ tile, 0.0 });
+	}
+	for (size_t i = 0; i < tasks.size(); i++) {
+		tileCosts[tasks[i].parentTile].seconds += taskSeconds[i];
+	}
+
+	return true;
+
+} // end renderFrame
+
+
+std::vector<Tile> RayTracer::createTiles()
+{
+	std::vector<Tile> tiles;
+
+	// Region of the window to cover, clipped to the window
+	int left = 0;
+	int bottom = 0;
+	int right = colorBuffer.getWindowWidth();
+	int top = colorBuffer.getWindowHeight();
+
+	if (cropWindowSet) {
+		left = glm::max(left, cropWindow.x);
+		bottom = glm::max(bottom, cropWindow.y);
+		right = glm::min(right, cropWindow.x + cropWindow.width);
+		top = glm::min(top, cropWindow.y + cropWindow.height);
+	}
+
+	for (int y = bottom; y < top; y += tileSize) {
+		for (int x = left; x < right; x += tileSize) {
+
+			Tile tile;
+			tile.x = x;
+			tile.y = y;
+			tile.width = glm::min(tileSize, right - x);
+			tile.height = glm::min(tileSize, top - y);
+			tiles.push_back(tile);
+		}
+	}
+
+	return tiles;
+
+} // end createTiles
+
+
+std::vector<RayTracer::TileTask> RayTracer::scheduleTiles(const std::vector<Tile> & tiles)
+{
+	std::vector<TileTask> tasks;
+
+	// Costs are only reusable if the previous frame used the same tiles
+	bool haveCosts = costAwareScheduling && tileCosts.size() == tiles.size();
+	for (size_t i = 0; haveCosts && i < tiles.size(); i++) {
+		const Tile & previous = tileCosts[i].tile;
+		haveCosts = previous.x == tiles[i].x && previous.y == tiles[i].y &&
+			previous.width == tiles[i].width && previous.height == tiles[i].height;
+	}
+
+	if (haveCosts == false) {
+		for (size_t i = 0; i < tiles.size(); i++) {
+			tasks.push_back({ tiles[i], (int)i, 0.0 });
+		}
+		return tasks;
+	}
+
+	double totalCost = 0.0;
+	for (const TileCost & tileCost : tileCosts) {
+		totalCost += tileCost.seconds;
+	}
+
+	// Aim for several tasks per thread so that the last tasks of the frame
+	// are short enough to balance out.
+	double targetCost = totalCost / (4.0 * threadPool->getThreadCount());
+	const int minimumSize = 4;
+
+	for (size_t i = 0; i < tiles.size(); i++) {
+
+		std::vector<TileTask> pending = { { tiles[i], (int)i, tileCosts[i].seconds } };
+
+		while (pending.empty() == false) {
+
+			TileTask task = pending.back();
+			pending.pop_back();
+
+			bool splitWidth = task.tile.width >= task.tile.height;
+			int length = splitWidth ? task.tile.width : task.tile.height;
+
+			if (task.estimatedCost <= targetCost || length < 2 * minimumSize) {
+				tasks.push_back(task);
+				continue;
+			}
+
+			// Split the longer side in half and assume the cost is spread
+			// evenly over the pixels of the tile.
+			TileTask first = task;
+			TileTask second = task;
+
+			if (splitWidth) {
+				first.tile.width = length / 2;
+				second.tile.x += first.tile.width;
+				second.tile.width = length - first.tile.width;
 			}
 			else {
-				Ray r = getOrthoViewRay(x, y);
-				color c = traceIndividualRay(r, 3);
-				colorBuffer.setPixel(x, y, c);
+				first.tile.height = length / 2;
+				second.tile.y += first.tile.height;
+				second.tile.height = length - first.tile.height;
 			}
+
+			first.estimatedCost = task.estimatedCost * ((double)(length / 2) / length);
+			second.estimatedCost = task.estimatedCost - first.estimatedCost;
+
+			pending.push_back(first);
+			pending.push_back(second);
 		}
 	}
-} // end raytraceScene
+
+	// Workers take tasks from the back of their queues, so submitting the
+	// cheapest tasks first makes every worker start with its longest tasks
+	// and leaves the cheap ones at the front for thieves at the end of the frame.
+	std::stable_sort(tasks.begin(), tasks.end(), [](const TileTask & a, const TileTask & b) {
+		return a.estimatedCost < b.estimatedCost; });
+
+	return tasks;
+
+} // end scheduleTiles
+
+
+int RayTracer::getHomeWorker(const Tile & tile)
+{
+	int height = glm::max(colorBuffer.getWindowHeight(), 1);
+
+	return glm::clamp(tile.y * threadPool->getThreadCount() / height, 0, threadPool->getThreadCount() - 1);
+
+} // end getHomeWorker
+
+
+void RayTracer::touchFrameBuffer()
+{
+	if (touchedAllocation == colorBuffer.getAllocationCount() &&
+		(int)firstTouchedBytes.size() == threadPool->getThreadCount()) {
+		return;
+	}
+
+	int workerCount = threadPool->getThreadCount();
+	int height = colorBuffer.getWindowHeight();
+
+	firstTouchedBytes.assign(workerCount, 0);
+
+	// Worker i owns the rows for which getHomeWorker returns i
+	threadPool->runOnEveryWorker([this, workerCount, height](int workerIndex) {
+
+		int firstRow = (workerIndex * height + workerCount - 1) / workerCount;
+		int lastRow = ((workerIndex + 1) * height + workerCount - 1) / workerCount;
+
+		firstTouchedBytes[workerIndex] += colorBuffer.touchRows(firstRow, lastRow);
+	});
+
+	touchedAllocation = colorBuffer.getAllocationCount();
+
+} // end touchFrameBuffer
+
+
+void RayTracer::renderTile(const Tile & tile)
+{
+	if (renderWavefront == true) {
+		renderTileWavefront(tile);
+		return;
+	}
+
+	if (packetSize > 1) {
+		renderTilePackets(tile);
+		return;
+	}
+
+	for (int y = tile.y; y < tile.y + tile.height; y++) {
+		for (int x = tile.x; x < tile.x + tile.width; x++) {
+
+			Ray r = getViewRay(x, y, 0);
+			color c = traceViewRay(r, x, y);
+
+			// Sum in sample order so the rounding is the same every time
+			for (int sample = 1; sample < samplesPerPixel; sample++) {
+				r = getViewRay(x, y, sample);
+				c += traceViewRay(r, x, y);
+			}
+
+			if (samplesPerPixel > 1) {
+				c /= (double)samplesPerPixel;
+			}
+
+			colorBuffer.setPixel(x, y, c);
+		}
+	}
+
+} // end renderTile
+
+
+void RayTracer::renderTilePackets(const Tile & tile)
+{
+	// Blocks as close to square as the packet size allows
+	int size = glm::clamp(packetSize, 1, (int)RayPacket::MAX_SIZE);
+	int blockWidth = 1;
+
+	while (blockWidth * blockWidth < size) {
+		blockWidth *= 2;
+	}
+
+	int blockHeight = glm::max(size / blockWidth, 1);
+
+	RayPacket packet;
+	HitRecord hits[RayPacket::MAX_SIZE];
+	color colors[RayPacket::MAX_SIZE];
+
+	for (int blockY = tile.y; blockY < tile.y + tile.height; blockY += blockHeight) {
+		for (int blockX = tile.x; blockX < tile.x + tile.width; blockX += blockWidth) {
+
+			// Blocks at the edges of the tile are cut short
+			int endX = glm::min(blockX + blockWidth, tile.x + tile.width);
+			int endY = glm::min(blockY + blockHeight, tile.y + tile.height);
+
+			for (int sample = 0; sample < samplesPerPixel; sample++) {
+
+				packet.clear();
+
+				for (int y = blockY; y < endY; y++) {
+					for (int x = blockX; x < endX; x++) {
+						packet.push(getViewRay(x, y, sample));
+					}
+				}
+
+				// Bins are rectangles, so a block whose corners share a bin
+				// lies within it
+				int bin = screenBinning.getBin(blockX, blockY);
+
+				if (bin >= 0 && bin == screenBinning.getBin(endX - 1, endY - 1)) {
+					screenBinning.findClosestIntersections(packet, bin, hits);
+				}
+				else {
+					scene->getAccelerator().findClosestIntersections(packet, hits);
+				}
+
+				// Sum in sample order so the rounding is the same as in renderTile
+				for (int lane = 0; lane < packet.size; lane++) {
+
+					color c = shadeHit(packet.getRay(lane), hits[lane], glm::max(recursionDepth, 0));
+					colors[lane] = (sample == 0) ? c : colors[lane] + c;
+				}
+			}
+
+			int lane = 0;
+
+			for (int y = blockY; y < endY; y++) {
+				for (int x = blockX; x < endX; x++) {
+
+					color c = colors[lane++];
+
+					if (samplesPerPixel > 1) {
+						c /= (double)samplesPerPixel;
+					}
+
+					colorBuffer.setPixel(x, y, c);
+				}
+			}
+		}
+	}
+
+} // end renderTilePackets
+
+
+color RayTracer::traceViewRay(Ray & viewRay, int x, int y)
+{
+	int bin = screenBinning.getBin(x, y);
+
+	if (bin < 0) {
+		return traceIndividualRay(viewRay, glm::max(recursionDepth, 0));
+	}
+
+	HitRecord nearestHit = screenBinning.findClosestIntersection(viewRay, bin);
+
+	return shadeHit(viewRay, nearestHit, glm::max(recursionDepth, 0));
+
+} // end traceViewRay
+
+
+void RayTracer::renderTileWavefront(const Tile & tile)
+{
+	// Same depth as the recursion in renderTile
+	const int maxBounce = glm::max(recursionDepth, 0);
+	const int bounceCount = maxBounce + 1;
+
+	// Every sample of every pixel is a separate path. The samples of a
+	// pixel are adjacent.
+	int pathCount = tile.width * tile.height * samplesPerPixel;
+
+	// Light gathered by every path at each of its bounces, and the number
+	// of bounces each path has
+	std::vector<color> bounceLight((size_t)pathCount * bounceCount);
+	std::vector<int> pathLength(pathCount, 0);
+
+	RayQueue rays;
+	RayQueue nextRays;
+	RayQueue shadowRays;
+	std::vector<HitRecord> hits;
+	std::vector<char> occluded;
+	std::vector<int> shadowRayIndex;
+
+	// Generate the camera rays
+	for (int y = tile.y; y < tile.y + tile.height; y++) {
+		for (int x = tile.x; x < tile.x + tile.width; x++) {
+
+			int pixel = (y - tile.y) * tile.width + (x - tile.x);
+
+			for (int sample = 0; sample < samplesPerPixel; sample++) {
+				rays.push(getViewRay(x, y, sample), pixel * samplesPerPixel + sample);
+			}
+		}
+	}
+
+	for (int bounce = 0; bounce < bounceCount && rays.size() > 0; bounce++) {
+
+		// Only the camera rays are coherent
+		if (bounce == 0) {
+			intersectViewRays(rays, tile, hits);
+		}
+		else {
+			intersectQueue(rays, hits);
+		}
+
+		// Rays that leave the scene end their paths with the background
+		for (size_t i = 0; i < rays.size(); i++) {
+
+			int path = rays.path[i];
+			pathLength[path] = bounce + 1;
+
+			if (hits[i].t < FLT_MAX) {
+				bounceLight[path * bounceCount + bounce] = hits[i].material.emissive;
+			}
+			else if (scene->isDay()) {
+				bounceLight[path * bounceCount + bounce] = LIGHT_BLUE;
+			}
+			else {
+				bounceLight[path * bounceCount + bounce] = 0.5 * LIGHT_BLUE;
+			}
+		}
+
+		// Shadow rays of every light for every hit. shadowRayIndex holds the
+		// index in shadowRays of the ray for each light and hit, or -1.
+		shadowRays.clear();
+		const LightVector & lights = scene->getLights();
+		shadowRayIndex.assign(lights.size() * rays.size(), -1);
+
+		for (size_t light = 0; light < lights.size(); light++) {
+			for (size_t i = 0; i < rays.size(); i++) {
+
+				Ray shadowRay;
+				double maxDistance;
+
+				if (hits[i].t < FLT_MAX && lights[light]->getShadowRay(hits[i], shadowRay, maxDistance)) {
+					shadowRayIndex[light * rays.size() + i] = (int)shadowRays.size();
+					shadowRays.push(shadowRay, (int)light, maxDistance);
+				}
+			}
+		}
+
+		occludeQueue(shadowRays, occluded);
+
+		// Shade one light at a time. Every hit adds the lights in list order.
+		for (size_t light = 0; light < lights.size(); light++) {
+			for (size_t i = 0; i < rays.size(); i++) {
+
+				if (hits[i].t < FLT_MAX) {
+
+					int shadowRay = shadowRayIndex[light * rays.size() + i];
+					bool inShadow = shadowRay >= 0 && occluded[shadowRay] != 0;
+
+					bounceLight[rays.path[i] * bounceCount + bounce] +=
+						lights[light]->shade(-rays.getDirection(i), hits[i], inShadow);
+				}
+			}
+		}
+
+		// Reflection rays form the next batch
+		nextRays.clear();
+
+		for (size_t i = 0; i < rays.size() && bounce < maxBounce; i++) {
+
+			if (hits[i].t < FLT_MAX) {
+				Ray reflection(hits[i].interceptPoint + hits[i].surfaceNormal * EPSILON, glm::reflect(rays.getDirection(i), hits[i].surfaceNormal));
+				nextRays.push(reflection, rays.path[i]);
+			}
+		}
+
+		std::swap(rays, nextRays);
+	}
+
+	// Combine the bounces from the last one back, as the recursion unwinds,
+	// and average the samples of each pixel in the order renderTile does
+	for (int pixel = 0; pixel < tile.width * tile.height; pixel++) {
+
+		color pixelColor;
+
+		for (int sample = 0; sample < samplesPerPixel; sample++) {
+
+			int path = pixel * samplesPerPixel + sample;
+			const color * light = &bounceLight[path * bounceCount];
+			color c = light[pathLength[path] - 1];
+
+			for (int bounce = pathLength[path] - 2; bounce >= 0; bounce--) {
+				c = light[bounce] + 0.2 * c;
+			}
+
+			pixelColor = (sample == 0) ? c : pixelColor + c;
+		}
+
+		if (samplesPerPixel > 1) {
+			pixelColor /= (double)samplesPerPixel;
+		}
+
+		colorBuffer.setPixel(tile.x + pixel % tile.width, tile.y + pixel / tile.width, pixelColor);
+	}
+
+} // end renderTileWavefront
+
+
+void RayTracer::intersectQueue(const RayQueue & rays, std::vector<HitRecord> & hits)
+{
+	hits.resize(rays.size());
+
+	const Accelerator & accelerator = scene->getAccelerator();
+
+	for (size_t i = 0; i < rays.size(); i++) {
+		hits[i] = accelerator.findClosestIntersection(rays.getRay(i));
+	}
+
+} // end intersectQueue
+
+
+void RayTracer::intersectViewRays(const RayQueue & rays, const Tile & tile, std::vector<HitRecord> & hits)
+{
+	hits.resize(rays.size());
+
+	const Accelerator & accelerator = scene->getAccelerator();
+
+	int size = glm::clamp(packetSize, 1, (int)RayPacket::MAX_SIZE);
+	RayPacket packet;
+
+	auto getRayBin = [this, &rays, &tile](size_t i) {
+		int pixel = rays.path[i] / samplesPerPixel;
+		return screenBinning.getBin(tile.x + pixel % tile.width, tile.y + pixel / tile.width);
+	};
+
+	for (size_t first = 0; first < rays.size(); first += size) {
+
+		// Bin of the pixels of every ray of the packet, or -1 if they do not
+		// share one
+		int bin = getRayBin(first);
+		packet.clear();
+
+		for (size_t i = first; i < rays.size() && i < first + size; i++) {
+
+			packet.push(rays.getRay(i));
+
+			if (getRayBin(i) != bin) {
+				bin = -1;
+			}
+		}
+
+		if (bin >= 0) {
+			screenBinning.findClosestIntersections(packet, bin, &hits[first]);
+		}
+		else if (packet.size == 1) {
+			hits[first] = accelerator.findClosestIntersection(rays.getRay(first));
+		}
+		else {
+			accelerator.findClosestIntersections(packet, &hits[first]);
+		}
+	}
+
+} // end intersectViewRays
+
+
+void RayTracer::occludeQueue(const RayQueue & rays, std::vector<char> & occluded)
+{
+	occluded.resize(rays.size());
+
+	const Accelerator & accelerator = scene->getAccelerator();
+
+	OccluderCache & cache = OccluderCache::getThreadCache();
+
+	// The path of a shadow ray is the light it was traced toward
+	for (size_t i = 0; i < rays.size(); i++) {
+		occluded[i] = cache.isOccluded(accelerator, rays.path[i], rays.getRay(i), rays.maxDistance[i]);
+	}
+
+} // end occludeQueue
 
 
 
@@ -89,14 +697,23 @@ color RayTracer::traceIndividualRay(/*const*/ Ray & viewRay, int recursionLevel)
 	
 	HitRecord nearestHit;
 	
-	nearestHit = viewRay.findIntersection(surfacesInScene);
+	nearestHit = viewRay.findIntersection(scene->getAccelerator());
+
+	return shadeHit(viewRay, nearestHit, recursionLevel);
 
+} // end traceRay
+
+
+color RayTracer::shadeHit(const Ray & viewRay, HitRecord & nearestHit, int recursionLevel)
+{
 	if (nearestHit.t < FLT_MAX) {
 		
 		color totalLight = nearestHit.material.emissive;
 		
-		for( auto light : lightsInScene ) {
-			totalLight += light->illuminate( -viewRay.direct, nearestHit, surfacesInScene );
+		const LightVector & lights = scene->getLights();
+
+		for( size_t light = 0; light < lights.size(); light++ ) {
+			totalLight += lights[light]->illuminate( -viewRay.direct, nearestHit, scene->getAccelerator(), (int)light );
 
 		}
 
@@ -113,7 +730,7 @@ color RayTracer::traceIndividualRay(/*const*/ Ray & viewRay, int recursionLevel)
 		return totalLight;
 	}
 	else {
-		if (day) {
+		if (scene->isDay()) {
 			return LIGHT_BLUE;
 		}
 		else {
@@ -122,14 +739,59 @@ color RayTracer::traceIndividualRay(/*const*/ Ray & viewRay, int recursionLevel)
 	}
 	
 
-} // end traceRay
+} // end shadeHit
+
+
+double RayTracer::timeViewRays(const Accelerator & accelerator)
+{
+	auto startTime = std::chrono::steady_clock::now();
+
+	for (int y = 0; y < colorBuffer.getWindowHeight(); y++) {
+		for (int x = 0; x < colorBuffer.getWindowWidth(); x++) {
+			accelerator.findClosestIntersection(getViewRay(x, y, 0));
+		}
+	}
+
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+} // end timeViewRays
+
+
+Ray RayTracer::getViewRay(const int x, const int y, const int sample)
+{
+	dvec2 offset(0.5, 0.5);
+
+	if (samplesPerPixel > 1) {
+
+		// Largest square grid of strata that the samples fill. Samples past
+		// the first strataPerSide squared start over at the first stratum.
+		int strataPerSide = (int)glm::sqrt((double)samplesPerPixel);
+		while ((strataPerSide + 1) * (strataPerSide + 1) <= samplesPerPixel) {
+			strataPerSide++;
+		}
+		int stratum = sample % (strataPerSide * strataPerSide);
+
+		Random random(x, y, sample, 0, randomSeed);
+
+		offset.x = (stratum % strataPerSide + random.nextDouble()) / strataPerSide;
+		offset.y = (stratum / strataPerSide + random.nextDouble()) / strataPerSide;
+	}
+
+	if (renderPerspectiveView == true) {
+		return getPerspectiveViewRay(x, y, offset);
+	}
+	else {
+		return getOrthoViewRay(x, y, offset);
+	}
+
+} // end getViewRay
 
 
-Ray RayTracer::getOrthoViewRay( const int x, const int y)
+Ray RayTracer::getOrthoViewRay( const int x, const int y, const dvec2 & offset)
 {
 	Ray orthoViewRay;
 
-	dvec2 uv = getImagePlaneCoordinates(x, y);
+	dvec2 uv = getImagePlaneCoordinates(x, y, offset);
 	
 	orthoViewRay.origin = eye + uv.x * u + uv.y * v;
 	orthoViewRay.direct = glm::normalize( -w );
@@ -139,28 +801,28 @@ Ray RayTracer::getOrthoViewRay( const int x, const int y)
 } // end getOrthoViewRay
 
 
-Ray RayTracer::getPerspectiveViewRay(const int x, const int y)
+Ray RayTracer::getPerspectiveViewRay(const int x, const int y, const dvec2 & offset)
 {
 	Ray perspectiveViewRay;
 
 	// TODO
 	perspectiveViewRay.origin = eye;
 
-	dvec2 uv = getImagePlaneCoordinates(x, y);
+	dvec2 uv = getImagePlaneCoordinates(x, y, offset);
 	perspectiveViewRay.direct = glm::normalize(-distToPlane * w + uv.x * u + uv.y * v);
 	return perspectiveViewRay;
 
 } // end getPerspectiveViewRay
 
 
-dvec2 RayTracer::getImagePlaneCoordinates(const int x, const int y)
+dvec2 RayTracer::getImagePlaneCoordinates(const int x, const int y, const dvec2 & offset)
 {
 
 	dvec2 uv;
 	// TODO
 
-	uv.x = leftLimit + (rightLimit - leftLimit) * ((x + 0.5) / nx);
-	uv.y = bottomLimit + (topLimit - bottomLimit) * ((y + 0.5) / ny);
+	uv.x = leftLimit + (rightLimit - leftLimit) * ((x + offset.x) / nx);
+	uv.y = bottomLimit + (topLimit - bottomLimit) * ((y + offset.y) / ny);
 
 	return uv;
 }
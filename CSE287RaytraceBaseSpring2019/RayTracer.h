@@ -1,10 +1,23 @@
 #pragma once
 
 #include "FrameBuffer.h"
+#include "ThreadPool.h"
 #include "Lights.h"
 #include "HitRecord.h"
 #include "Surface.h"
+#include "Scene.h"
 #include "Ray.h"
+#include "RayQueue.h"
+#include "ScreenBinning.h"
+
+/**
+* Time in seconds that was required to render a tile.
+*/
+struct TileCost
+{
+	Tile tile;
+	double seconds;
+};
 
 /**
 * Class that supports simple ray tracing of a scene containing a number of object 
@@ -22,14 +35,45 @@ class RayTracer
 	*/
 	RayTracer(FrameBuffer & cBuffer, color defaultColor = color(0.0, 0.0, 0.0, 1.0));
 
+	/**
+	* Constructor. Renders into a different color buffer with the settings,
+	* camera frame, and thread pool of an existing ray tracer. The projection
+	* plane is copied as well and divided among the pixels of the new color
+	* buffer, so a smaller buffer renders the same view at a lower resolution.
+	* @param color buffer to which the ray tracer will be render.
+	* @param settings - ray tracer whose settings are copied
+	*/
+	RayTracer(FrameBuffer & cBuffer, const RayTracer & settings);
+
 	/**
 	* Ray traces a scene containing a number of surfaces and light sources. Sets every
 	* pixel in the rendering window. Pixels that are not associated with a ray/surface
 	* intersection are set to a default color.
-	* @param surfaces - list of the surfaces in the scene
-	* @param lights - list of the light sources in the scene
+	* @param scene - snapshot of the scene. It is kept alive until the next frame starts.
+	* @param cancelToken - optional token that is checked before each tile is
+	* rendered. Tiles that have not started when it is cancelled are skipped.
+	* @returns true if every tile was rendered, false if the frame was cancelled
+	*/
+	bool raytraceScene(std::shared_ptr<const Scene> scene,
+		const CancellationToken * cancelToken = nullptr);
+
+	/**
+	* Holds a snapshot of the scene for the next frames and sorts its
+	* surfaces into the bins of the window. raytraceScene does this itself.
+	* It is only needed before renderFrame.
+	* @param scene - snapshot of the scene. It is kept alive until the next
+	* call.
+	*/
+	void prepareFrame(std::shared_ptr<const Scene> scene);
+
+	/**
+	* Ray traces the scene of the most recent prepareFrame or raytraceScene
+	* into the rendering window. Renders the crop windows of one frame
+	* without sorting the surfaces into bins again for each of them.
+	* @param cancelToken - as for raytraceScene
+	* @returns true if every tile was rendered, false if the frame was cancelled
 	*/
-	void raytraceScene(const SurfaceVector & surfaces, const LightVector & lights);
+	bool renderFrame(const CancellationToken * cancelToken = nullptr);
 
 	/**
 	* Sets the w, u, and v orthonormal basis vectors associated with the coordinate
@@ -73,9 +117,132 @@ class RayTracer
 	*/
 	void setRecursionDepth( int recursionDepth ) { this->recursionDepth = recursionDepth; }
 
+	/**
+	* Returns the number of reflected bounces traced for each view ray.
+	*/
+	int getRecursionDepth() const { return recursionDepth; }
+
+	/**
+	* Sets the number of worker threads used to render tiles. Replaces the
+	* current thread pool.
+	* @param threadCount - number of worker threads. Values of zero or less
+	* use one thread for every hardware thread.
+	*/
+	void setThreadCount( int threadCount );
+
+	/**
+	* Returns the number of worker threads used to render tiles.
+	*/
+	int getThreadCount() { return threadPool->getThreadCount(); }
+
+	/**
+	* Selects whether the worker threads are pinned to cores. When they are,
+	* every worker owns a band of rows of the window, first touches the
+	* memory of its band, and is the first choice to render the tiles that
+	* start in it. Replaces the current thread pool.
+	* @param pinned - true to pin the workers
+	*/
+	void setThreadPinning( bool pinned );
+
+	/**
+	* Returns true if the worker threads are pinned to cores.
+	*/
+	bool getThreadPinning() const { return threadPool->isPinned(); }
+
+	/**
+	* Returns the number of bytes of the frame buffer that each worker
+	* touched first, indexed by worker. Empty unless the workers are pinned.
+	*/
+	const std::vector<size_t> & getFirstTouchedBytes() const { return firstTouchedBytes; }
+
+	/**
+	* Sets the number of view rays traced for every pixel. The pixel is set to
+	* their average, which is summed in sample order so that it does not
+	* depend on the thread that renders the pixel.
+	* @param samplesPerPixel - number of samples. Values less than one are
+	* treated as one.
+	*/
+	void setSamplesPerPixel( int samplesPerPixel ) { this->samplesPerPixel = glm::max( samplesPerPixel, 1 ); }
+
+	/**
+	* Sets the seed that is combined with the pixel, sample, and bounce
+	* indices to seed every random decision. Rendering the same scene with
+	* the same seed gives the same image with any number of threads.
+	* @param randomSeed - seed of the random sequences
+	*/
+	void setRandomSeed( uint32_t randomSeed ) { this->randomSeed = randomSeed; }
+
+	/**
+	* Returns the thread pool used to render tiles.
+	*/
+	std::shared_ptr<ThreadPool> getThreadPool() const { return threadPool; }
+
+	/**
+	* Returns the width and height of the tiles rendered by the thread pool.
+	*/
+	int getTileSize() const { return tileSize; }
+
+	/**
+	* Sets the width and height in pixels of the square tiles into which the
+	* window is divided for multithreaded rendering.
+	* @param tileSize - width and height of a tile in pixels
+	*/
+	void setTileSize( int tileSize ) { this->tileSize = glm::max( tileSize, 1 ); }
+
+	/**
+	* Restricts rendering to a crop window of the image plane. Only pixels
+	* inside the crop are traced and the rest of the color buffer is left
+	* untouched. The crop covers the sub-rectangle of the projection plane
+	* that getImagePlaneCoordinates returns for its pixels.
+	* @param crop - block of pixels to render
+	*/
+	void setCropWindow( const Tile & crop ) { cropWindow = crop; cropWindowSet = true; }
+
+	/**
+	* Removes the crop window so that the whole rendering window is traced.
+	*/
+	void clearCropWindow() { cropWindowSet = false; }
+
+	/**
+	* Returns the time in seconds that each tile took to render during the
+	* most recent tiled frame. Empty until a tiled frame has been rendered.
+	*/
+	const std::vector<TileCost> & getTileCosts() { return tileCosts; }
+
+	/**
+	* Returns the time in seconds it takes to find the closest hit of the
+	* view ray through the center of every pixel, on the calling thread.
+	* Nothing is shaded, so only the accelerator is timed.
+	* @param accelerator - accelerator to trace the rays through
+	*/
+	double timeViewRays( const Accelerator & accelerator );
+
 	// True to generate rays for perspective viewing. False for orthographic viewing.
 	bool renderPerspectiveView = true;
-	bool day = true;
+
+	// True to split the window into tiles that are rendered by the thread pool.
+	// False to render every pixel serially on the calling thread.
+	bool renderTiled = true;
+
+	// True to use the tile costs of the previous frame to schedule tiles
+	// longest first and to subdivide expensive tiles.
+	bool costAwareScheduling = true;
+
+	// True to trace the rays of each tile in stages, one batch of rays at a
+	// time, rather than depth first with traceIndividualRay. Both produce
+	// the same image.
+	bool renderWavefront = false;
+
+	// Number of camera rays of neighboring pixels that traverse the scene
+	// together as a RayPacket: 4, 8, or 16. 1 traces every camera ray on
+	// its own. Reflection and shadow rays are always traced on their own.
+	int packetSize = 8;
+
+	// True to sort the surfaces into bins of the window before every frame,
+	// so that view rays are tested only against the surfaces that can cover
+	// their pixels instead of traversing the accelerator
+	bool binViewRays = true;
+
 protected:
 
 	/**
@@ -90,6 +257,117 @@ protected:
 	* @returns color for the point of intersection
 	*/
 	color traceIndividualRay( /*const*/ Ray & viewRay, int recursionLevel = 0);
+
+	/**
+	* Returns the color that traceIndividualRay returns for a ray whose
+	* closest hit has already been found.
+	* @param viewRay - ray being traced
+	* @param nearestHit - closest hit of the ray
+	*/
+	color shadeHit( const Ray & viewRay, HitRecord & nearestHit, int recursionLevel );
+
+	/**
+	* Traces the camera rays of every pixel in a tile as packets of
+	* packetSize rays, each from a block of neighboring pixels, and sets the
+	* pixels to the colors renderTile would give them.
+	* @param tile - block of pixels to render
+	*/
+	void renderTilePackets( const Tile & tile );
+
+	/**
+	* Traces the view ray of a pixel as traceIndividualRay does. Tests the
+	* ray against the surfaces of the bin of the pixel if it has one.
+	* @param viewRay - view ray of the pixel
+	* @param x column of the pixel
+	* @param y row of the pixel
+	*/
+	color traceViewRay( Ray & viewRay, int x, int y );
+
+	/**
+	* Traces a view ray for every pixel in a tile and sets the corresponding
+	* pixels in the color buffer. Tiles rendered concurrently never share 
+	* pixels.
+	* @param tile - block of pixels to render
+	*/
+	void renderTile( const Tile & tile );
+
+	/**
+	* Renders a tile with the wavefront pipeline. The camera rays of the
+	* tile are generated as one batch. Each bounce then intersects the whole
+	* batch, traces the shadow rays of every hit for every light as a second
+	* batch, shades the hits, and emits the reflection rays that form the
+	* batch of the next bounce. The light gathered at each bounce is combined
+	* at the end in the order traceIndividualRay would combine it.
+	* @param tile - block of pixels to render
+	*/
+	void renderTileWavefront( const Tile & tile );
+
+	/**
+	* Finds the closest hit of every ray in a queue. Each ray traverses the
+	* accelerator of the scene.
+	* @param rays - rays to intersect
+	* @param hits - resized to the queue and set to the closest hit of each ray
+	*/
+	void intersectQueue( const RayQueue & rays, std::vector<HitRecord> & hits );
+
+	/**
+	* Finds the closest hit of every view ray of a tile. Rays that are next
+	* to each other in the queue are traced together as packets of
+	* packetSize rays, against the surfaces of their bin if they share one.
+	* @param rays - view rays of the tile. The path of a ray is its pixel
+	* in the tile times samplesPerPixel plus its sample.
+	* @param tile - block of pixels the rays belong to
+	* @param hits - resized to the queue and set to the closest hit of each ray
+	*/
+	void intersectViewRays( const RayQueue & rays, const Tile & tile, std::vector<HitRecord> & hits );
+
+	/**
+	* Determines which rays in a queue hit a surface closer than their
+	* maximum distance.
+	* @param rays - shadow rays to trace. The path of each ray is the
+	* position of its light in the light list.
+	* @param occluded - resized to the queue. Set to 1 for blocked rays.
+	*/
+	void occludeQueue( const RayQueue & rays, std::vector<char> & occluded );
+
+	/**
+	* Divides the rendering window, or the crop window if one is set, into 
+	* tiles of tileSize by tileSize pixels. Tiles on the top and right edges
+	* may be smaller.
+	* @returns list of tiles that covers the window
+	*/
+	std::vector<Tile> createTiles();
+
+	/**
+	* Block of pixels that is rendered as a single task, along with the tile
+	* from createTiles that contains it.
+	*/
+	struct TileTask
+	{
+		Tile tile;
+		int parentTile;
+		double estimatedCost;
+	};
+
+	/**
+	* Creates the tasks for a frame. When the costs of the previous frame are
+	* known, tiles that cost more than their share of the frame are split in
+	* half until they do not and the tasks are ordered by estimated cost.
+	* @param tiles - tiles returned by createTiles
+	* @returns tasks that together cover every tile
+	*/
+	std::vector<TileTask> scheduleTiles( const std::vector<Tile> & tiles );
+
+	/**
+	* Returns the worker that owns the band of rows in which a tile starts.
+	*/
+	int getHomeWorker( const Tile & tile );
+
+	/**
+	* Has every worker touch the pages of the frame buffer that hold its band
+	* of rows, unless they were touched since the buffer was last allocated.
+	*/
+	void touchFrameBuffer();
 	
 	/**
 	* Sets the rayOrigin and rayDirection data members of the class based on row and
@@ -98,8 +376,9 @@ protected:
 	* in the scene. The ray is caluclated for a orthographic projection.
 	* @param x column of a pixel in the rendering window
 	* @param y row of a pixel in the rendering window
+	* @param offset position within the pixel. (0.5, 0.5) is the center.
 	*/
-	Ray getOrthoViewRay( const int x, const int y);
+	Ray getOrthoViewRay( const int x, const int y, const dvec2 & offset = dvec2(0.5, 0.5));
 
 	/**
 	* Sets the rayOrigin and rayDirection data members of the class based on row and 
@@ -108,17 +387,30 @@ protected:
 	* in the scene. The ray is caluclated for a perspective projection.
 	* @param x column of a pixel in the rendering window
 	* @param y row of a pixel in the rendering window
+	* @param offset position within the pixel. (0.5, 0.5) is the center.
 	*/
-	Ray getPerspectiveViewRay( const int x, const int y);
+	Ray getPerspectiveViewRay( const int x, const int y, const dvec2 & offset = dvec2(0.5, 0.5));
+
+	/**
+	* Returns the view ray for one sample of a pixel. A single sample goes
+	* through the center of the pixel. Several samples are jittered within
+	* a grid of strata that covers the pixel, using random numbers seeded
+	* by the pixel and sample indices.
+	* @param x column of a pixel in the rendering window
+	* @param y row of a pixel in the rendering window
+	* @param sample index of the sample within the pixel
+	*/
+	Ray getViewRay( const int x, const int y, const int sample );
 
 	/**
 	* Finds the projection plane coordinates, u and v, for the pixel identified
 	* by the input arguments.
 	* @param x column of a pixel in the rendering window
 	* @param y row of a pixel in the rendering window
+	* @param offset position within the pixel. (0.5, 0.5) is the center.
 	* @returns two dimensional vector containing the projection plane coordinates
 	*/
-	dvec2 getImagePlaneCoordinates(const int x, const int y);
+	dvec2 getImagePlaneCoordinates(const int x, const int y, const dvec2 & offset = dvec2(0.5, 0.5));
 
 	// Alias for an object controls memory that stores a rgba color value f
 	// or every pixel.
@@ -149,17 +441,43 @@ protected:
 	// Distance from the viewpoint to the projection plane
 	double distToPlane;
 
-	// List of the surfaces in the scene that is being ray traced
-	SurfaceVector surfacesInScene;
+	// Snapshot of the scene that is being ray traced
+	std::shared_ptr<const Scene> scene;
 
-	// List of the light sources in the scene that is being ray traced
-	LightVector lightsInScene;
+	// Surfaces that the view rays of each bin of the window can hit. Built
+	// for every frame if binViewRays is true.
+	ScreenBinning screenBinning;
 	
 	
 
 	// Max recursion depth
 	int recursionDepth;
 
+	// Width and height of the tiles rendered by the thread pool
+	int tileSize = 32;
+
+	// Number of view rays traced for every pixel
+	int samplesPerPixel = 1;
+
+	// Seed combined with the pixel, sample, and bounce of each random decision
+	uint32_t randomSeed = 0;
+
+	// Block of pixels to which rendering is restricted if cropWindowSet is true
+	Tile cropWindow;
+	bool cropWindowSet = false;
+
+	// Persistent worker threads that render tiles
+	std::shared_ptr<ThreadPool> threadPool;
+
+	// Render time of every tile during the most recent tiled frame
+	std::vector<TileCost> tileCosts;
+
+	// Allocation of the frame buffer that was touched by the pinned workers
+	unsigned int touchedAllocation = 0;
+
+	// Bytes of the frame buffer first touched by each worker
+	std::vector<size_t> firstTouchedBytes;
+
 };
 
 
@@ -0,0 +1,107 @@
+#include "Scene.h"
+
+std::atomic<unsigned int> Scene::nextVersion(1);
+
+
+Scene::Scene(const SurfaceVector & surfaces, const LightVector & lights, bool day,
+	AcceleratorType acceleratorType, ThreadPool * threadPool)
+	: surfaces(surfaces), lights(lights), day(day), acceleratorType(acceleratorType),
+	version(nextVersion++)
+{
+	buildAccelerator(threadPool);
+
+} // end Scene constructor
+
+
+Scene::Scene(const Scene & other)
+	: surfaces(other.surfaces), lights(other.lights), day(other.day),
+	acceleratorType(other.acceleratorType), accelerator(other.accelerator),
+	previousAccelerator(other.previousAccelerator), version(nextVersion++)
+{
+
+} // end Scene copy constructor
+
+
+void Scene::setSurface(size_t index, std::shared_ptr<Surface> surface)
+{
+	surfaces[index] = surface;
+
+	if (accelerator) {
+		previousAccelerator = accelerator;
+		accelerator.reset();
+	}
+
+} // end setSurface
+
+
+void Scene::setAcceleratorType(AcceleratorType type)
+{
+	if (type != acceleratorType) {
+		acceleratorType = type;
+		accelerator.reset();
+		previousAccelerator.reset();
+	}
+
+} // end setAcceleratorType
+
+
+void Scene::buildAccelerator(ThreadPool * threadPool)
+{
+	if (accelerator) {
+		return;
+	}
+
+	if (previousAccelerator) {
+
+		std::shared_ptr<Accelerator> refitted = previousAccelerator->refit(surfaces, threadPool);
+		previousAccelerator.reset();
+
+		if (refitted && refitted->needsRebuild() == false) {
+			accelerator = refitted;
+			return;
+		}
+	}
+
+	std::shared_ptr<Accelerator> built = Accelerator::create(acceleratorType);
+	built->build(surfaces, threadPool);
+
+	accelerator = built;
+
+} // end buildAccelerator
+
+
+std::shared_ptr<const Scene> SceneStore::getSnapshot()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	return current;
+
+} // end getSnapshot
+
+
+void SceneStore::publish(std::shared_ptr<const Scene> scene)
+{
+	std::lock_guard<std::mutex> editLock(editMutex);
+	std::lock_guard<std::mutex> lock(mutex);
+
+	current = scene;
+
+} // end publish
+
+
+void SceneStore::edit(std::function<void(Scene &)> change, ThreadPool * threadPool)
+{
+	std::lock_guard<std::mutex> editLock(editMutex);
+
+	// The snapshot is only replaced under editMutex, so it cannot change
+	// while the copy is built. Frames that hold it keep it alive after it is
+	// replaced.
+	std::shared_ptr<Scene> next = std::make_shared<Scene>(*getSnapshot());
+	change(*next);
+	next->buildAccelerator(threadPool);
+
+	std::lock_guard<std::mutex> lock(mutex);
+
+	current = next;
+
+} // end edit
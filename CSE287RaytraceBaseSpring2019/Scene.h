@@ -0,0 +1,188 @@
+#pragma once
+
+#include "Defines.h"
+#include "Surface.h"
+#include "Lights.h"
+#include "Accelerator.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+
+/**
+* Surfaces and light sources of a scene at one point in time. A scene is
+* shared as a std::shared_ptr<const Scene>, a snapshot that nothing can
+* change. A frame keeps the snapshot it started with alive until it ends,
+* no matter how many edits are made in the meantime.
+*
+* Edits are made to a copy. Copying a scene copies the lists of pointers,
+* not the objects, so a copy shares every object it does not replace. An
+* object is edited by replacing it with an edited copy of itself.
+*
+* Every scene, including every copy, has a version number that no other
+* scene has. Later scenes have higher numbers.
+*
+* Rays are traced through an Accelerator built over the surfaces. A copy
+* shares the accelerator of the scene it was copied from until one of its
+* surfaces is replaced. buildAccelerator then has to be called before the
+* scene is rendered. It refits the old accelerator to the moved surfaces
+* and builds a new one only if refitting is not possible or has made the
+* structure too slow.
+*/
+class Scene
+{
+public:
+
+	/**
+	* Constructor.
+	* @param surfaces - list of the surfaces in the scene
+	* @param lights - list of the light sources in the scene
+	* @param day - false to render the scene at night
+	* @param acceleratorType - kind of accelerator to build over the surfaces
+	* @param threadPool - pool that builds the accelerator, or nullptr to
+	* build it on the calling thread
+	*/
+	Scene(const SurfaceVector & surfaces, const LightVector & lights, bool day = true,
+		AcceleratorType acceleratorType = AcceleratorType::BVH, ThreadPool * threadPool = nullptr);
+
+	/**
+	* Copy constructor. The copy shares the objects of the scene and gets a
+	* new version number.
+	*/
+	Scene(const Scene & other);
+
+	/**
+	* Returns the list of the surfaces in the scene.
+	*/
+	const SurfaceVector & getSurfaces() const { return surfaces; }
+
+	/**
+	* Returns the list of the light sources in the scene.
+	*/
+	const LightVector & getLights() const { return lights; }
+
+	/**
+	* Returns true for day and false for night. Sets the background color.
+	*/
+	bool isDay() const { return day; }
+
+	/**
+	* Returns the version number of the scene.
+	*/
+	unsigned int getVersion() const { return version; }
+
+	/**
+	* Returns the accelerator built over the surfaces.
+	*/
+	const Accelerator & getAccelerator() const { return *accelerator; }
+
+	/**
+	* Returns the kind of accelerator the scene is built with.
+	*/
+	AcceleratorType getAcceleratorType() const { return acceleratorType; }
+
+	/**
+	* Replaces a surface.
+	* @param index - position of the surface in the surface list
+	* @param surface - surface that takes its place
+	*/
+	void setSurface(size_t index, std::shared_ptr<Surface> surface);
+
+	/**
+	* Replaces a light source.
+	* @param index - position of the light in the light list
+	* @param light - light that takes its place
+	*/
+	void setLight(size_t index, std::shared_ptr<LightSource> light) { lights[index] = light; }
+
+	/**
+	* Selects day or night.
+	*/
+	void setDay(bool day) { this->day = day; }
+
+	/**
+	* Selects the kind of accelerator to build over the surfaces. The
+	* linear accelerator is there to validate the others.
+	*/
+	void setAcceleratorType(AcceleratorType type);
+
+	/**
+	* Builds the accelerator over the surfaces unless it is up to date.
+	* @param threadPool - pool for the parallel parts of the build, or
+	* nullptr to build on the calling thread
+	*/
+	void buildAccelerator(ThreadPool * threadPool = nullptr);
+
+protected:
+
+	// List of the surfaces in the scene
+	SurfaceVector surfaces;
+
+	// List of the light sources in the scene
+	LightVector lights;
+
+	// False to render the scene at night
+	bool day;
+
+	// Kind of accelerator built over the surfaces
+	AcceleratorType acceleratorType;
+
+	// Structure that rays are traced through. Empty after a surface is
+	// replaced until buildAccelerator is called.
+	std::shared_ptr<const Accelerator> accelerator;
+
+	// Accelerator of the surfaces before they were replaced. Refit by
+	// buildAccelerator.
+	std::shared_ptr<const Accelerator> previousAccelerator;
+
+	// Version number of the scene
+	unsigned int version;
+
+	// Version number of the next scene that is created
+	static std::atomic<unsigned int> nextVersion;
+
+}; // end Scene class
+
+
+/**
+* Holds the current snapshot of a scene that is edited while frames of it
+* are rendered. Frames take the current snapshot when they start. Edits
+* publish a new snapshot and never change one that a frame may be using.
+*/
+class SceneStore
+{
+public:
+
+	/**
+	* Returns the current snapshot. Empty until a scene is published.
+	*/
+	std::shared_ptr<const Scene> getSnapshot();
+
+	/**
+	* Makes a scene the current snapshot.
+	*/
+	void publish(std::shared_ptr<const Scene> scene);
+
+	/**
+	* Copies the current snapshot, changes the copy, rebuilds its accelerator
+	* if needed, and publishes it. Edits made at the same time from different
+	* threads are applied one after the other. Frames keep taking the
+	* current snapshot while the accelerator is rebuilt.
+	* @param change - function that edits the copy
+	* @param threadPool - pool that rebuilds the accelerator, or nullptr
+	*/
+	void edit(std::function<void(Scene &)> change, ThreadPool * threadPool = nullptr);
+
+protected:
+
+	// Guards current
+	std::mutex mutex;
+
+	// Serializes edits and publishing. Held while an edit rebuilds its
+	// accelerator, so it is never taken while mutex is held.
+	std::mutex editMutex;
+
+	// Current snapshot
+	std::shared_ptr<const Scene> current;
+
+}; // end SceneStore class
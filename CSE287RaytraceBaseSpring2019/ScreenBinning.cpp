@@ -0,0 +1,224 @@
+#include "ScreenBinning.h"
+
+
+void ScreenBinning::build(const SurfaceVector & surfaces, const Accelerator & accelerator,
+	const ViewProjection & projection)
+{
+	this->surfaces = &surfaces;
+	this->projection = projection;
+
+	binSize = glm::max(binSize, 1);
+	columns = (projection.width + binSize - 1) / binSize;
+	rows = (projection.height + binSize - 1) / binSize;
+
+	int binCount = columns * rows;
+
+	// Pixels each surface may cover. Empty for the surfaces that no view ray
+	// can hit.
+	std::vector<glm::ivec2> low(surfaces.size(), glm::ivec2(0));
+	std::vector<glm::ivec2> high(surfaces.size(), glm::ivec2(-1));
+
+	for (size_t i = 0; i < surfaces.size(); i++) {
+
+		AABB box;
+
+		if (surfaces[i]->getBoundingBox(box) == false) {
+			high[i] = glm::ivec2(projection.width - 1, projection.height - 1);
+			continue;
+		}
+
+		// Padded like the boxes of the accelerator, so that hits that round
+		// to just outside the box are kept
+		if (box.isEmpty() == false) {
+			box.minimum -= dvec3(EPSILON);
+			box.maximum += dvec3(EPSILON);
+			projectBox(box, low[i], high[i]);
+		}
+	}
+
+	// Count the surfaces of each bin, then list them in a second pass at the
+	// offsets that the counts add up to
+	std::vector<int> counts(binCount, 0);
+
+	for (size_t i = 0; i < surfaces.size(); i++) {
+		for (int row = low[i].y / binSize; row <= high[i].y / binSize && high[i].y >= 0; row++) {
+			for (int column = low[i].x / binSize; column <= high[i].x / binSize && high[i].x >= 0; column++) {
+				counts[row * columns + column]++;
+			}
+		}
+	}
+
+	// A list is only worth testing if it is shorter than the traversal the
+	// accelerator is predicted to cost
+	double maxCount = accelerator.getCost();
+
+	dropped.assign(binCount, 0);
+	binStart.assign(binCount + 1, 0);
+
+	for (int bin = 0; bin < binCount; bin++) {
+
+		dropped[bin] = counts[bin] > maxCount;
+		binStart[bin + 1] = binStart[bin] + (dropped[bin] ? 0 : counts[bin]);
+	}
+
+	binSurfaces.resize(binStart[binCount]);
+	std::vector<int> next(binStart.begin(), binStart.end() - 1);
+
+	for (size_t i = 0; i < surfaces.size(); i++) {
+		for (int row = low[i].y / binSize; row <= high[i].y / binSize && high[i].y >= 0; row++) {
+			for (int column = low[i].x / binSize; column <= high[i].x / binSize && high[i].x >= 0; column++) {
+
+				int bin = row * columns + column;
+
+				if (dropped[bin] == false) {
+					binSurfaces[next[bin]++] = (int)i;
+				}
+			}
+		}
+	}
+
+} // end build
+
+
+void ScreenBinning::clear()
+{
+	surfaces = nullptr;
+	columns = 0;
+	rows = 0;
+	binStart.clear();
+	binSurfaces.clear();
+	dropped.clear();
+
+} // end clear
+
+
+int ScreenBinning::getBin(int x, int y) const
+{
+	if (x < 0 || y < 0 || x >= columns * binSize || y >= rows * binSize) {
+		return -1;
+	}
+
+	int bin = (y / binSize) * columns + x / binSize;
+
+	return dropped[bin] ? -1 : bin;
+
+} // end getBin
+
+
+HitRecord ScreenBinning::findClosestIntersection(const Ray & ray, int bin) const
+{
+	HitRecord closestHit;
+
+	// The lists are in list order, so of several surfaces hit at the same
+	// distance the first one is kept, as in the accelerator
+	for (int i = binStart[bin]; i < binStart[bin + 1]; i++) {
+
+		HitRecord hit = (*surfaces)[binSurfaces[i]]->findClosestIntersection(ray);
+
+		if (hit.t < closestHit.t) {
+			closestHit = hit;
+		}
+	}
+
+	return closestHit;
+
+} // end findClosestIntersection
+
+
+void ScreenBinning::findClosestIntersections(const RayPacket & packet, int bin, HitRecord hits[]) const
+{
+	for (int lane = 0; lane < packet.size; lane++) {
+		hits[lane] = HitRecord();
+	}
+
+	double distances[RayPacket::MAX_SIZE];
+
+	for (int i = binStart[bin]; i < binStart[bin + 1]; i++) {
+
+		Surface & surface = *(*surfaces)[binSurfaces[i]];
+		surface.findDistances(packet, packet.getMask(), distances);
+
+		// A distance is never larger than the t of the hit
+		for (int lane = 0; lane < packet.size; lane++) {
+
+			if (distances[lane] < hits[lane].t) {
+
+				HitRecord hit = surface.findClosestIntersection(packet.getRay(lane));
+
+				if (hit.t < hits[lane].t) {
+					hits[lane] = hit;
+				}
+			}
+		}
+	}
+
+} // end findClosestIntersections
+
+
+bool ScreenBinning::projectBox(const AABB & box, glm::ivec2 & low, glm::ivec2 & high) const
+{
+	dvec2 minimum(DBL_MAX);
+	dvec2 maximum(-DBL_MAX);
+	int behind = 0;
+
+	for (int corner = 0; corner < 8; corner++) {
+
+		dvec3 point((corner & 1) ? box.maximum.x : box.minimum.x,
+			(corner & 2) ? box.maximum.y : box.minimum.y,
+			(corner & 4) ? box.maximum.z : box.minimum.z);
+
+		dvec3 offset = point - projection.eye;
+		double depth = -glm::dot(offset, projection.w);
+		dvec2 plane(glm::dot(offset, projection.u), glm::dot(offset, projection.v));
+
+		if (projection.perspective) {
+
+			// View rays start at the eye and go forward
+			if (depth <= 0.0) {
+				behind++;
+				continue;
+			}
+			plane *= projection.distToPlane / depth;
+		}
+		else if (depth < 0.0) {
+
+			// View rays start on the plane through the eye
+			behind++;
+		}
+
+		minimum = glm::min(minimum, plane);
+		maximum = glm::max(maximum, plane);
+	}
+
+	if (behind == 8) {
+		return false;
+	}
+
+	// A box around the eye of a perspective camera may cover any pixel
+	if (projection.perspective && behind > 0) {
+		low = glm::ivec2(0);
+		high = glm::ivec2(projection.width - 1, projection.height - 1);
+		return true;
+	}
+
+	// Pixel coordinates, as getImagePlaneCoordinates maps them, widened by a
+	// pixel on every side for the samples that are offset within a pixel and
+	// for rounding
+	dvec2 scale(projection.width / (projection.rightLimit - projection.leftLimit),
+		projection.height / (projection.topLimit - projection.bottomLimit));
+	dvec2 origin(projection.leftLimit, projection.bottomLimit);
+
+	dvec2 lowPixel = glm::floor((minimum - origin) * scale) - 1.0;
+	dvec2 highPixel = glm::floor((maximum - origin) * scale) + 1.0;
+
+	if (lowPixel.x >= projection.width || lowPixel.y >= projection.height ||
+		highPixel.x < 0.0 || highPixel.y < 0.0) {
+		return false;
+	}
+
+	low = glm::ivec2(glm::max(lowPixel, dvec2(0.0)));
+	high = glm::ivec2(glm::min(highPixel, dvec2(projection.width - 1, projection.height - 1)));
+
+	return true;
+
+} // end projectBox
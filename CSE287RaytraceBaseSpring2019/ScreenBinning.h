@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Accelerator.h"
+
+/**
+* Camera of a frame, with the parameters RayTracer generates its view rays
+* from.
+*/
+struct ViewProjection
+{
+	dvec3 eye; // position of the viewpoint
+	dvec3 u; // "right" relative to the viewing direction
+	dvec3 v; // "up" relative to the viewing direction
+	dvec3 w; // camera looks in the negative w direction
+
+	// Extent of the projection plane along u and v
+	double leftLimit;
+	double rightLimit;
+	double bottomLimit;
+	double topLimit;
+
+	// Distance from the viewpoint to the projection plane
+	double distToPlane;
+
+	// Size of the rendering window in pixels
+	int width;
+	int height;
+
+	// True for perspective viewing. False for orthographic viewing.
+	bool perspective;
+};
+
+/**
+* Lists, for every bin of binSize by binSize pixels of the window, the
+* surfaces that the view rays of its pixels can hit. The list of a bin is
+* found by projecting the box of every surface onto the window. Surfaces
+* without bounds are in every list. Surfaces behind the viewpoint or
+* outside the window are in none.
+*
+* The view rays of a pixel are tested against the list of its bin instead
+* of traversing the accelerator, which saves the traversal for the many
+* surfaces that cannot cover the pixel. Lists longer than the cost that
+* the surface area heuristic predicts for the accelerator are dropped, and
+* the view rays of their bins traverse the accelerator instead. Either way
+* every ray gets the hit the accelerator would give it.
+*
+* Built for one frame. Only valid for the view rays of its camera and for
+* the surfaces it was built over.
+*/
+class ScreenBinning
+{
+public:
+
+	/**
+	* Sorts the surfaces into the bins of a camera.
+	* @param surfaces - surfaces of the scene. Must outlive the binning.
+	* @param accelerator - accelerator built over the surfaces
+	* @param projection - camera of the frame
+	*/
+	void build(const SurfaceVector & surfaces, const Accelerator & accelerator,
+		const ViewProjection & projection);
+
+	/**
+	* Removes every bin, so that every view ray traverses the accelerator.
+	*/
+	void clear();
+
+	/**
+	* Returns the bin of a pixel, or -1 if the view rays of the pixel have to
+	* traverse the accelerator.
+	*/
+	int getBin(int x, int y) const;
+
+	/**
+	* Finds the closest intersection of a view ray with the surfaces of the
+	* bin of its pixel.
+	* @param bin - bin returned by getBin for the pixel of the ray
+	*/
+	HitRecord findClosestIntersection(const Ray & ray, int bin) const;
+
+	/**
+	* Finds the closest intersection of every view ray of a packet with the
+	* surfaces of a bin. The pixels of every ray must be in the bin.
+	* @param hits - set to the closest hit of each ray of the packet
+	*/
+	void findClosestIntersections(const RayPacket & packet, int bin, HitRecord hits[]) const;
+
+	// Width and height of a bin in pixels
+	int binSize = 16;
+
+protected:
+
+	/**
+	* Finds the pixels that the view rays that may hit a box go through.
+	* @param box - box of a surface
+	* @param low - set to the column and row of the bottom left pixel
+	* @param high - set to the column and row of the top right pixel
+	* @returns false if no view ray can hit the box
+	*/
+	bool projectBox(const AABB & box, glm::ivec2 & low, glm::ivec2 & high) const;
+
+	// Surfaces the bins were built over
+	const SurfaceVector * surfaces = nullptr;
+
+	// Camera of the frame
+	ViewProjection projection;
+
+	// Number of bins across and up the window
+	int columns = 0;
+	int rows = 0;
+
+	// Offset in binSurfaces of the list of every bin, and one past the last.
+	// Indexed by row * columns + column.
+	std::vector<int> binStart;
+
+	// Indices in surfaces of the surfaces of every bin, in list order
+	std::vector<int> binSurfaces;
+
+	// True for the bins whose lists were too long to keep
+	std::vector<char> dropped;
+
+}; // end ScreenBinning class
@@ -0,0 +1,338 @@
+#include "SequenceRenderer.h"
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+
+
+SequenceRenderer::SequenceRenderer(const RayTracer & rayTracer, int width, int height)
+	: rayTracer(rayTracer), width(glm::max(width, 1)), height(glm::max(height, 1))
+{
+
+} // end SequenceRenderer constructor
+
+
+int SequenceRenderer::getFramesInFlight()
+{
+	if (framesInFlight > 0) {
+		return framesInFlight;
+	}
+
+	int threadCount = rayTracer.getThreadPool()->getThreadCount();
+
+	// A serial frame is a single task, so one frame per thread
+	if (rayTracer.renderTiled == false) {
+		return threadCount + 1;
+	}
+
+	int tileSize = rayTracer.getTileSize();
+	int tilesPerFrame = ((width + tileSize - 1) / tileSize) * ((height + tileSize - 1) / tileSize);
+
+	// A frame with several tiles per thread keeps every thread busy until
+	// its last tiles, so a second frame only has to cover that tail. Frames
+	// with fewer tiles cannot occupy the pool alone. One frame more than the
+	// pool can render at once keeps it busy while a frame is written.
+	int framesToFillPool = (4 * threadCount + tilesPerFrame - 1) / tilesPerFrame;
+
+	return glm::min(1 + framesToFillPool, threadCount + 1);
+
+} // end getFramesInFlight
+
+
+bool SequenceRenderer::render(const std::vector<Keyframe> & keyframes, int frameCount,
+	std::shared_ptr<const Scene> scene,
+	const std::string & path, SequenceFormat format)
+{
+	if (keyframes.empty() || frameCount <= 0) {
+		return false;
+	}
+
+	std::ofstream video;
+
+	if (format == SequenceFormat::Y4M) {
+
+		video.open(path, std::ios::binary);
+
+		if (video.is_open() == false) {
+			std::cerr << "Unable to open " << path << " for writing." << std::endl;
+			return false;
+		}
+
+		video << "YUV4MPEG2 W" << width << " H" << height << " F" << frameRate
+			<< ":1 Ip A1:1 C444\n";
+	}
+
+	// PPM images are numbered before the extension
+	std::string prefix = path;
+	if (prefix.size() > 4 && prefix.compare(prefix.size() - 4, 4, ".ppm") == 0) {
+		prefix.erase(prefix.size() - 4);
+	}
+
+	std::shared_ptr<ThreadPool> threadPool = rayTracer.getThreadPool();
+	int maxFramesInFlight = getFramesInFlight();
+
+	double startTime = keyframes.front().time;
+	double duration = keyframes.back().time - startTime;
+
+	// Completed frames that are waiting for an earlier frame to be written
+	std::map<int, std::unique_ptr<FrameBuffer>> reorderBuffer;
+	std::mutex reorderMutex;
+	std::condition_variable frameCompletedCondition;
+
+	TaskGroup frameGroup;
+	int nextFrameToStart = 0;
+	int nextFrameToWrite = 0;
+	bool succeeded = true;
+
+	while (nextFrameToWrite < frameCount) {
+
+		// Start frames until the reorder buffer is full
+		while (nextFrameToStart < frameCount && nextFrameToStart < nextFrameToWrite + maxFramesInFlight) {
+
+			int frame = nextFrameToStart++;
+			double time = (frameCount > 1) ? startTime + duration * frame / (frameCount - 1) : startTime;
+			Keyframe keyframe = interpolate(keyframes, time);
+
+			threadPool->submit([this, frame, keyframe, scene,
+				&reorderBuffer, &reorderMutex, &frameCompletedCondition]() {
+
+				std::unique_ptr<FrameBuffer> frameBuffer = renderFrame(keyframe, scene);
+
+				std::lock_guard<std::mutex> lock(reorderMutex);
+				reorderBuffer[frame] = std::move(frameBuffer);
+				frameCompletedCondition.notify_one();
+
+			}, frameGroup);
+		}
+
+		std::unique_ptr<FrameBuffer> frameBuffer;
+		{
+			std::unique_lock<std::mutex> lock(reorderMutex);
+			frameCompletedCondition.wait(lock, [&] { return reorderBuffer.count(nextFrameToWrite) > 0; });
+
+			frameBuffer = std::move(reorderBuffer[nextFrameToWrite]);
+			reorderBuffer.erase(nextFrameToWrite);
+		}
+
+		// Write while the pool renders the frames that follow
+		if (format == SequenceFormat::Y4M) {
+			writeY4MFrame(video, *frameBuffer);
+			succeeded = video.good();
+		}
+		else {
+			std::ostringstream imagePath;
+			imagePath << prefix << "_";
+			imagePath.width(4);
+			imagePath.fill('0');
+			imagePath << nextFrameToWrite << ".ppm";
+
+			std::ofstream image(imagePath.str(), std::ios::binary);
+			writePPMFrame(image, *frameBuffer);
+			succeeded = image.good();
+		}
+
+		if (succeeded == false) {
+			std::cerr << "Unable to write frame " << nextFrameToWrite << " of " << path << "." << std::endl;
+			break;
+		}
+
+		nextFrameToWrite++;
+	}
+
+	// Let the frames that were started before a failed write finish. They
+	// refer to locals of this function.
+	threadPool->wait(frameGroup);
+
+	return succeeded;
+
+} // end render
+
+
+Keyframe SequenceRenderer::interpolate(const std::vector<Keyframe> & keyframes, double time)
+{
+	if (time <= keyframes.front().time) {
+		return keyframes.front();
+	}
+	if (time >= keyframes.back().time) {
+		return keyframes.back();
+	}
+
+	// First keyframe after time. The one before it is at or before time.
+	auto next = std::upper_bound(keyframes.begin(), keyframes.end(), time,
+		[](double t, const Keyframe & keyframe) { return t < keyframe.time; });
+	const Keyframe & from = *(next - 1);
+	const Keyframe & to = *next;
+
+	double s = (time - from.time) / (to.time - from.time);
+
+	Keyframe keyframe;
+	keyframe.time = time;
+	keyframe.position = glm::mix(from.position, to.position, s);
+	keyframe.viewingDirection = glm::normalize(glm::mix(from.viewingDirection, to.viewingDirection, s));
+	keyframe.up = glm::normalize(glm::mix(from.up, to.up, s));
+
+	// A light that only one of the keyframes positions stays where that
+	// keyframe puts it
+	size_t lightCount = glm::max(from.lightPositions.size(), to.lightPositions.size());
+
+	for (size_t i = 0; i < lightCount; i++) {
+
+		if (i >= from.lightPositions.size()) {
+			keyframe.lightPositions.push_back(to.lightPositions[i]);
+		}
+		else if (i >= to.lightPositions.size()) {
+			keyframe.lightPositions.push_back(from.lightPositions[i]);
+		}
+		else {
+			keyframe.lightPositions.push_back(glm::mix(from.lightPositions[i], to.lightPositions[i], s));
+		}
+	}
+
+	return keyframe;
+
+} // end interpolate
+
+
+std::unique_ptr<FrameBuffer> SequenceRenderer::renderFrame(const Keyframe & keyframe,
+	std::shared_ptr<const Scene> scene)
+{
+	std::unique_ptr<FrameBuffer> frameBuffer(new FrameBuffer(width, height));
+
+	RayTracer frameTracer(*frameBuffer, rayTracer);
+	frameTracer.setCameraFrame(keyframe.position, keyframe.viewingDirection, keyframe.up);
+
+	if (frameTracer.renderPerspectiveView) {
+		frameTracer.calculatePerspectiveViewingParameters(verticalFieldOfView);
+	}
+	else {
+		frameTracer.calculateOrthographicViewingParameters(viewPlaneHeight);
+	}
+
+	// Frames rendered at the same time place the lights differently, so
+	// each frame edits its own copy of the scene and of the lights it moves
+	std::shared_ptr<Scene> frameScene = std::make_shared<Scene>(*scene);
+	size_t positionedLights = 0;
+
+	for (size_t i = 0; i < scene->getLights().size(); i++) {
+
+		if (std::dynamic_pointer_cast<PositionalLight>(scene->getLights()[i]) == nullptr) {
+			continue;
+		}
+
+		if (positionedLights < keyframe.lightPositions.size()) {
+
+			std::shared_ptr<LightSource> frameLight = scene->getLights()[i]->clone();
+			std::static_pointer_cast<PositionalLight>(frameLight)->lightPosition = keyframe.lightPositions[positionedLights];
+			frameScene->setLight(i, frameLight);
+		}
+		positionedLights++;
+	}
+
+	// Called on a pool thread, so the wait for the tiles of the frame helps
+	// render them and the tiles of other frames
+	frameTracer.raytraceScene(frameScene);
+
+	return frameBuffer;
+
+} // end renderFrame
+
+
+void SequenceRenderer::writeY4MFrame(std::ostream & out, FrameBuffer & frame)
+{
+	std::vector<unsigned char> planes((size_t)width * height * 3);
+	unsigned char * yPlane = planes.data();
+	unsigned char * cbPlane = yPlane + (size_t)width * height;
+	unsigned char * crPlane = cbPlane + (size_t)width * height;
+
+	// Images are stored top row first. The frame buffer origin is the lower
+	// left hand corner.
+	for (int row = 0; row < height; row++) {
+		for (int x = 0; x < width; x++) {
+
+			color c = frame.getPixel(x, height - 1 - row);
+			size_t i = (size_t)row * width + x;
+
+			yPlane[i] = (unsigned char)glm::clamp(16.0 + 65.481 * c.r + 128.553 * c.g + 24.966 * c.b + 0.5, 0.0, 255.0);
+			cbPlane[i] = (unsigned char)glm::clamp(128.0 - 37.797 * c.r - 74.203 * c.g + 112.0 * c.b + 0.5, 0.0, 255.0);
+			crPlane[i] = (unsigned char)glm::clamp(128.0 + 112.0 * c.r - 93.786 * c.g - 18.214 * c.b + 0.5, 0.0, 255.0);
+		}
+	}
+
+	out << "FRAME\n";
+	out.write((const char *)planes.data(), planes.size());
+
+} // end writeY4MFrame
+
+
+void SequenceRenderer::writePPMFrame(std::ostream & out, FrameBuffer & frame)
+{
+	std::vector<unsigned char> pixels((size_t)width * height * 3);
+
+	for (int row = 0; row < height; row++) {
+		for (int x = 0; x < width; x++) {
+
+			color c = frame.getPixel(x, height - 1 - row);
+			size_t i = ((size_t)row * width + x) * 3;
+
+			pixels[i] = (unsigned char)(c.r * 255.0 + 0.5);
+			pixels[i + 1] = (unsigned char)(c.g * 255.0 + 0.5);
+			pixels[i + 2] = (unsigned char)(c.b * 255.0 + 0.5);
+		}
+	}
+
+	out << "P6\n" << width << " " << height << "\n255\n";
+	out.write((const char *)pixels.data(), pixels.size());
+
+} // end writePPMFrame
+
+
+bool SequenceRenderer::loadKeyframes(const std::string & path, std::vector<Keyframe> & keyframes)
+{
+	std::ifstream file(path);
+
+	if (file.is_open() == false) {
+		std::cerr << "Unable to open keyframe file " << path << "." << std::endl;
+		return false;
+	}
+
+	keyframes.clear();
+	std::string line;
+	int lineNumber = 0;
+
+	while (std::getline(file, line)) {
+
+		lineNumber++;
+
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#') {
+			continue;
+		}
+
+		std::istringstream values(line);
+		Keyframe keyframe;
+
+		values >> keyframe.time
+			>> keyframe.position.x >> keyframe.position.y >> keyframe.position.z
+			>> keyframe.viewingDirection.x >> keyframe.viewingDirection.y >> keyframe.viewingDirection.z
+			>> keyframe.up.x >> keyframe.up.y >> keyframe.up.z;
+
+		if (values.fail()) {
+			std::cerr << path << ":" << lineNumber << ": expected time, position, viewing direction, and up vector." << std::endl;
+			continue;
+		}
+
+		dvec3 lightPosition;
+		while (values >> lightPosition.x >> lightPosition.y >> lightPosition.z) {
+			keyframe.lightPositions.push_back(lightPosition);
+		}
+
+		keyframes.push_back(keyframe);
+	}
+
+	std::stable_sort(keyframes.begin(), keyframes.end(),
+		[](const Keyframe & a, const Keyframe & b) { return a.time < b.time; });
+
+	return keyframes.empty() == false;
+
+} // end loadKeyframes
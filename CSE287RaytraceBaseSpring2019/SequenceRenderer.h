@@ -0,0 +1,147 @@
+#pragma once
+
+#include "RayTracer.h"
+
+#include <string>
+
+/**
+* Camera and light positions at a point in time. Frames between two
+* keyframes interpolate them.
+*/
+struct Keyframe
+{
+	// Time of the keyframe in seconds
+	double time;
+
+	// Camera frame, as passed to RayTracer::setCameraFrame
+	dvec3 position;
+	dvec3 viewingDirection;
+	dvec3 up;
+
+	// Positions of the positional and spot lights in the order in which
+	// they appear in the light list. Lights past the end keep the position
+	// they have in the scene.
+	std::vector<dvec3> lightPositions;
+};
+
+/**
+* File formats in which a sequence can be written.
+*/
+enum class SequenceFormat
+{
+	Y4M, // a single YUV4MPEG2 stream with 4:4:4 chroma
+	PPM // one binary PPM image per frame
+};
+
+/**
+* Renders an animation defined by a list of keyframes without opening a
+* window. Frames are rendered on the thread pool of a ray tracer, several
+* at once, so that threads left idle while the last tiles of one frame
+* finish can start on the next one.
+*
+* Frames can complete out of order. Completed frames wait in a reorder
+* buffer until every earlier frame has been written, and no frame is
+* started more than getFramesInFlight frames ahead of the oldest frame
+* that has not been written. Memory use therefore does not depend on the
+* length of the sequence.
+*/
+class SequenceRenderer
+{
+public:
+
+	/**
+	* Constructor.
+	* @param rayTracer - ray tracer whose settings and thread pool are used
+	* to render every frame
+	* @param width - width of the frames in pixels
+	* @param height - height of the frames in pixels
+	*/
+	SequenceRenderer(const RayTracer & rayTracer, int width, int height);
+
+	/**
+	* Renders frameCount frames evenly spaced from the first to the last
+	* keyframe and writes them in order.
+	* @param keyframes - keyframes sorted by time
+	* @param frameCount - number of frames to render
+	* @param scene - snapshot of the scene
+	* @param path - file for a Y4M stream. For PPM images the frame number is
+	* added before the extension.
+	* @param format - format of the output
+	* @returns true if every frame was written
+	*/
+	bool render(const std::vector<Keyframe> & keyframes, int frameCount,
+		std::shared_ptr<const Scene> scene,
+		const std::string & path, SequenceFormat format);
+
+	/**
+	* Sets the number of frames that may be rendered at the same time.
+	* Values of zero or less choose the number from the thread count and the
+	* number of tiles in a frame.
+	* @param framesInFlight - maximum number of frames rendered at once
+	*/
+	void setFramesInFlight(int framesInFlight) { this->framesInFlight = framesInFlight; }
+
+	/**
+	* Returns the maximum number of frames that are rendered at once.
+	*/
+	int getFramesInFlight();
+
+	/**
+	* Reads keyframes from a text file. Each line that is not empty or a
+	* comment starting with # holds the time, the camera position, viewing
+	* direction, and up vector, and optionally light positions:
+	*
+	*   time px py pz dx dy dz ux uy uz [lx ly lz ...]
+	*
+	* @param path - keyframe file
+	* @param keyframes - receives the keyframes sorted by time
+	* @returns false if the file cannot be read or has no valid keyframes
+	*/
+	static bool loadKeyframes(const std::string & path, std::vector<Keyframe> & keyframes);
+
+	// Vertical field of view in degrees for perspective frames
+	double verticalFieldOfView = 45.0;
+
+	// Height of the projection plane for orthographic frames
+	double viewPlaneHeight = 10.0;
+
+	// Frames per second written to the Y4M header
+	int frameRate = 24;
+
+protected:
+
+	/**
+	* Returns the camera and light positions at a point in time. Times
+	* outside the keyframes are clamped to the first or last keyframe.
+	*/
+	Keyframe interpolate(const std::vector<Keyframe> & keyframes, double time);
+
+	/**
+	* Renders one frame into a new frame buffer.
+	* @param keyframe - camera and light positions of the frame
+	* @returns frame buffer whose back buffer holds the frame
+	*/
+	std::unique_ptr<FrameBuffer> renderFrame(const Keyframe & keyframe,
+		std::shared_ptr<const Scene> scene);
+
+	/**
+	* Writes a frame to a Y4M stream as 8 bit BT.601 YCbCr.
+	*/
+	void writeY4MFrame(std::ostream & out, FrameBuffer & frame);
+
+	/**
+	* Writes a frame as a binary PPM image.
+	*/
+	void writePPMFrame(std::ostream & out, FrameBuffer & frame);
+
+	// Ray tracer whose settings and thread pool are used
+	const RayTracer & rayTracer;
+
+	// Size of the frames in pixels
+	int width;
+	int height;
+
+	// Maximum number of frames rendered at once. Zero or less for automatic.
+	int framesInFlight = 0;
+
+}; // end SequenceRenderer class
@@ -1,4 +1,5 @@
 #include "Sphere.h"
+#include "RayPacket.h"
 
 
 Sphere::Sphere(const dvec3 & position, double radius, const color & material)
@@ -20,42 +21,9 @@ HitRecord Sphere::findClosestIntersection( const Ray & ray )
 {
 	HitRecord hitRecord;
 
-	// Calculate the discriminant to determine if there are any intersections.
-	double discriminant = pow(glm::dot(ray.direct, ray.origin - center), 2) - dot(ray.direct, ray.direct)*(glm::dot(ray.origin - center, ray.origin - center) - radius * radius);
+	double t = findDistance(ray);
 
-	if( discriminant >= 0 ) {
-
-		double t = FLT_MAX;
-
-		if( discriminant > 0 ) {
-
-			// Two intercepts. Find and return the closest one.
-			double t1 = (glm::dot(-ray.direct, ray.origin - center) - sqrt(discriminant)) / dot(ray.direct, ray.direct);
-			double t2 = (glm::dot(-ray.direct, ray.origin - center) + sqrt(discriminant)) / dot(ray.direct, ray.direct);
-	
-			if (t1 < 0) {
-				t1 = FLT_MAX;
-			}
-			if (t2 < 0) {
-				t2 = FLT_MAX;
-			}
-
-			if (t1 < t2) {
-
-				t = t1;
-			}
-			else {
-
-				t = t2;
-			}
-		}
-		else {
-			// One Intercept. Find and return the t for the single point of intersection.
-			t = glm::dot(-ray.direct, ray.origin - center) / dot(ray.direct, ray.direct);
-			if (t < 0) {
-				t = FLT_MAX;
-			}
-		}
+	if( t < FLT_MAX ) {
 
 		// Set hit record information about the intersetion.
 		hitRecord.t = t;
@@ -79,4 +47,97 @@ HitRecord Sphere::findClosestIntersection( const Ray & ray )
 
 	return hitRecord;
 
-} // end findClosestIntersection
\ No newline at end of file
+} // end findClosestIntersection
+
+/*
+* Checks whether a ray intersects the sphere closer than maxDistance. Shadow
+* rays need no point of intersection, normal, or material.
+*/
+bool Sphere::isOccluding( const Ray & ray, double maxDistance )
+{
+	return findDistance(ray) < maxDistance;
+
+} // end isOccluding
+
+/*
+* Finds the t of every ray of a packet with the arithmetic of findDistance,
+* without branches so that the rays are processed side by side. The mask is
+* ignored since computing a disabled ray costs no more than skipping it.
+* Rays that share an origin share its offset from the center.
+*/
+void Sphere::findDistances( const RayPacket & packet, int, double distances[] )
+{
+	double radiusSquared = radius * radius;
+
+	dvec3 sharedOffset = packet.getOrigin(0) - center;
+	double sharedOffsetTerm = glm::dot(sharedOffset, sharedOffset) - radiusSquared;
+
+	for (int lane = 0; lane < packet.size; lane++) {
+
+		double offsetX = packet.sharedOrigin ? sharedOffset.x : packet.originX[lane] - center.x;
+		double offsetY = packet.sharedOrigin ? sharedOffset.y : packet.originY[lane] - center.y;
+		double offsetZ = packet.sharedOrigin ? sharedOffset.z : packet.originZ[lane] - center.z;
+
+		double offsetTerm = packet.sharedOrigin ? sharedOffsetTerm :
+			(offsetX * offsetX + offsetY * offsetY + offsetZ * offsetZ) - radiusSquared;
+		double b = packet.directionX[lane] * offsetX + packet.directionY[lane] * offsetY + packet.directionZ[lane] * offsetZ;
+		double a = packet.directionX[lane] * packet.directionX[lane] + packet.directionY[lane] * packet.directionY[lane] +
+			packet.directionZ[lane] * packet.directionZ[lane];
+
+		double discriminant = b * b - a * offsetTerm;
+		double root = sqrt(glm::max(discriminant, 0.0));
+
+		double t1 = (-b - root) / a;
+		double t2 = (-b + root) / a;
+		t1 = (t1 < 0) ? FLT_MAX : t1;
+		t2 = (t2 < 0) ? FLT_MAX : t2;
+
+		distances[lane] = (discriminant < 0) ? FLT_MAX : ((t1 < t2) ? t1 : t2);
+	}
+
+} // end findDistances
+
+/*
+* Returns the parameter t of the closest point at which a ray intersects the
+* sphere, or FLT_MAX if there is no intersection.
+*/
+double Sphere::findDistance( const Ray & ray ) const
+{
+	dvec3 offset = ray.origin - center;
+	double offsetTerm = glm::dot(offset, offset) - radius * radius;
+
+	// Roots of dot(d, d) t^2 + 2 b t + offsetTerm = 0 with b = dot(d, offset)
+	double b = glm::dot(ray.direct, offset);
+	double a = glm::dot(ray.direct, ray.direct);
+	double discriminant = b * b - a * offsetTerm;
+
+	if( discriminant < 0 ) {
+		return FLT_MAX;
+	}
+
+	// A single intercept is the case in which both roots are the same
+	double root = sqrt(discriminant);
+	double t1 = (-b - root) / a;
+	double t2 = (-b + root) / a;
+
+	if (t1 < 0) {
+		t1 = FLT_MAX;
+	}
+	if (t2 < 0) {
+		t2 = FLT_MAX;
+	}
+
+	return (t1 < t2) ? t1 : t2;
+
+} // end findDistance
+
+/*
+* Finds the cube that encloses the sphere.
+*/
+bool Sphere::getBoundingBox( AABB & box ) const
+{
+	box = AABB(center - dvec3(radius), center + dvec3(radius));
+
+	return true;
+
+} // end getBoundingBox
@@ -32,6 +32,22 @@ class Sphere : 	public Surface
 	*/
 	virtual HitRecord findClosestIntersection( const Ray & ray );
 
+	/**
+	* Checks whether a ray intersects the sphere closer than maxDistance
+	* without filling in a HitRecord.
+	*/
+	virtual bool isOccluding( const Ray & ray, double maxDistance );
+
+	/**
+	* Finds the exact t of every ray of a packet at once.
+	*/
+	virtual void findDistances( const RayPacket & packet, int mask, double distances[] );
+
+	/**
+	* Finds the cube that encloses the sphere.
+	*/
+	virtual bool getBoundingBox( AABB & box ) const;
+
 	/**
 	* Radius of the sphere
 	*/
@@ -41,5 +57,13 @@ class Sphere : 	public Surface
 	* xyz location of the center of the sphere
 	*/
 	dvec3 center;
+
+	protected:
+
+	/**
+	* Returns the parameter t of the closest point at which a ray intersects
+	* the sphere, or FLT_MAX if there is no intersection.
+	*/
+	double findDistance( const Ray & ray ) const;
 };
 
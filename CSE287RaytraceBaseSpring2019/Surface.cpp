@@ -1,4 +1,5 @@
 #include "Surface.h"
+#include "RayPacket.h"
 
 
 Surface::Surface(const color & diffuseColor)
@@ -17,4 +18,31 @@ HitRecord Surface::findClosestIntersection( const Ray & ray )
 	hitRecord.t = FLT_MAX;
 
 	return hitRecord;
+}
+
+bool Surface::isOccluding( const Ray & ray, double maxDistance )
+{
+	return findClosestIntersection(ray).t < maxDistance;
+}
+
+bool Surface::getClippedBoundingBox( const AABB & clip, AABB & box ) const
+{
+	if (getBoundingBox(box) == false) {
+		box = clip;
+	}
+	else {
+		box.minimum = glm::max(box.minimum, clip.minimum);
+		box.maximum = glm::min(box.maximum, clip.maximum);
+	}
+
+	return box.isEmpty() == false;
+}
+
+void Surface::findDistances( const RayPacket & packet, int mask, double distances[] )
+{
+	for (int lane = 0; lane < packet.size; lane++) {
+		if (mask & (1 << lane)) {
+			distances[lane] = findClosestIntersection(packet.getRay(lane)).t;
+		}
+	}
 }
\ No newline at end of file
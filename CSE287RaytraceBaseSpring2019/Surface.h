@@ -3,6 +3,9 @@
 #include "HitRecord.h"
 #include "Ray.h"
 #include "Material.h"
+#include "AABB.h"
+
+struct RayPacket;
 
 /** 
 * Super class for all implicitly described surfaces in a scene. Support intersection testing
@@ -34,6 +37,48 @@ public:
 	*/
 	virtual HitRecord findClosestIntersection(const struct Ray & ray);
 
+	/**
+	* Checks whether a ray intersects the surface closer than a given distance,
+	* which is all a shadow ray needs to know. Gives the same answer as
+	* comparing the t of findClosestIntersection, which is what it does
+	* unless a sub-class has a cheaper test.
+	* @param ray - ray being checked for intersection
+	* @param maxDistance - intersections at or beyond this distance are ignored
+	* returns true if the ray intersects the surface before maxDistance
+	*/
+	virtual bool isOccluding(const struct Ray & ray, double maxDistance);
+
+	/**
+	* Finds for each ray of a packet that a mask enables a distance that is
+	* no larger than the t findClosestIntersection returns for it, so that
+	* a packet only builds HitRecords for the rays the surface may bring
+	* closer. Kernels of sub-classes process every ray at once and give the
+	* exact t. This one calls findClosestIntersection for each ray.
+	* @param packet - rays being checked for intersection
+	* @param mask - bit i is set if ray i is to be checked
+	* @param distances - set for each enabled ray. FLT_MAX for no intersection.
+	*/
+	virtual void findDistances(const struct RayPacket & packet, int mask, double distances[]);
+
+	/**
+	* Finds a box that contains every point at which a ray can intersect the
+	* surface. Surfaces that extend without limit, such as planes, have none.
+	* @param box - set to the bounds of the surface in world coordinates
+	* returns false if the surface is unbounded, in which case box is unchanged
+	*/
+	virtual bool getBoundingBox(AABB &) const { return false; }
+
+	/**
+	* Finds a box that contains every point of the surface that lies inside
+	* another box. Used by builders that split a surface between nodes. This
+	* one returns the overlap of the bounding box with the other box.
+	* Sub-classes whose shape is known tighten it.
+	* @param clip - part of space that is kept
+	* @param box - set to the bounds of the part of the surface in clip
+	* returns false if no part of the surface lies in clip
+	*/
+	virtual bool getClippedBoundingBox(const AABB & clip, AABB & box) const;
+
 	/**
 	* Color of the surface
 	*/
@@ -0,0 +1,94 @@
+#include "TaskGraph.h"
+
+#include <iostream>
+
+
+TaskGraph::TaskGraph(std::shared_ptr<ThreadPool> threadPool)
+	: threadPool(threadPool)
+{
+
+} // end TaskGraph constructor
+
+
+TaskGraph::~TaskGraph()
+{
+	wait();
+
+} // end TaskGraph destructor
+
+
+int TaskGraph::addTask(std::function<void()> task, const std::vector<int> & dependencies)
+{
+	int node = (int)nodes.size();
+
+	if (running) {
+		std::cerr << "Tasks cannot be added to a task graph that is running." << std::endl;
+		return -1;
+	}
+
+	nodes.emplace_back();
+	nodes.back().task = std::move(task);
+
+	for (int dependency : dependencies) {
+
+		// Only earlier tasks, so there can be no cycles
+		if (dependency >= 0 && dependency < node) {
+			nodes[dependency].dependents.push_back(node);
+			nodes.back().remainingDependencies++;
+		}
+	}
+
+	return node;
+
+} // end addTask
+
+
+void TaskGraph::run()
+{
+	if (running) {
+		return;
+	}
+
+	running = true;
+
+	// Collect the roots before submitting any of them. A root that finishes
+	// right away changes the counts of the tasks after it.
+	std::vector<int> roots;
+
+	for (int node = 0; node < (int)nodes.size(); node++) {
+		if (nodes[node].remainingDependencies == 0) {
+			roots.push_back(node);
+		}
+	}
+
+	for (int node : roots) {
+		submitNode(node);
+	}
+
+} // end run
+
+
+void TaskGraph::wait()
+{
+	threadPool->wait(group);
+
+} // end wait
+
+
+void TaskGraph::submitNode(int node)
+{
+	threadPool->submit([this, node] {
+
+		nodes[node].task();
+
+		// The dependents are submitted before this task counts as finished,
+		// so wait cannot return while any of them is still to run.
+		for (int dependent : nodes[node].dependents) {
+			if (--nodes[dependent].remainingDependencies == 0) {
+				submitNode(dependent);
+			}
+		}
+
+	}, group);
+
+} // end submitNode
@@ -0,0 +1,85 @@
+#pragma once
+
+#include "ThreadPool.h"
+
+/**
+* Set of tasks with dependencies between them that runs on a ThreadPool.
+* A task is submitted to the pool as soon as every task it depends on has
+* finished, so independent chains of work overlap with each other and with
+* whatever the thread that started the graph does in the meantime.
+*
+* Tasks are added before the graph is run and can only depend on tasks
+* that were added before them, which keeps the graph free of cycles.
+*/
+class TaskGraph
+{
+public:
+
+	/**
+	* Constructor.
+	* @param threadPool - pool that runs the tasks
+	*/
+	TaskGraph(std::shared_ptr<ThreadPool> threadPool);
+
+	/**
+	* Waits for the tasks of the graph to finish.
+	*/
+	~TaskGraph();
+
+	/**
+	* Adds a task to the graph.
+	* @param task - function to execute
+	* @param dependencies - tasks that must finish before this one starts
+	* @returns identifier of the task for use as a dependency
+	*/
+	int addTask(std::function<void()> task, const std::vector<int> & dependencies = std::vector<int>());
+
+	/**
+	* Submits the tasks that do not depend on other tasks. Returns without
+	* waiting for them.
+	*/
+	void run();
+
+	/**
+	* Blocks until every task of the graph has finished. Called from a
+	* worker of the pool, the caller runs queued tasks while it waits.
+	*/
+	void wait();
+
+protected:
+
+	/**
+	* Task along with the tasks that wait for it.
+	*/
+	struct Node
+	{
+		Node() : remainingDependencies(0) {}
+
+		std::function<void()> task;
+
+		// Tasks that depend on this one
+		std::vector<int> dependents;
+
+		// Dependencies that have not finished
+		std::atomic<int> remainingDependencies;
+	};
+
+	/**
+	* Submits a task whose dependencies have finished. When it is done, the
+	* dependents that were only waiting for it are submitted.
+	*/
+	void submitNode(int node);
+
+	// Pool that runs the tasks
+	std::shared_ptr<ThreadPool> threadPool;
+
+	// Tasks of the graph. A deque never moves its elements as it grows.
+	std::deque<Node> nodes;
+
+	// Tracks every task of the graph that has been submitted
+	TaskGroup group;
+
+	// True once run has been called
+	bool running = false;
+
+}; // end TaskGraph class
@@ -0,0 +1,331 @@
+#include "ThreadPool.h"
+
+#include <chrono>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Pool and index of the worker that is running on the current thread
+static thread_local const ThreadPool * currentPool = nullptr;
+static thread_local int currentWorkerIndex = -1;
+
+
+ThreadPool::ThreadPool(int threadCount, bool pinWorkers)
+	: queuedTasks(0), nextQueue(0), shuttingDown(false), pinWorkers(pinWorkers)
+{
+	if (threadCount <= 0) {
+		threadCount = getHardwareConcurrency();
+	}
+
+	for (int i = 0; i < threadCount; i++) {
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+
+		if (pinWorkers) {
+			queues.back()->core = i % getHardwareConcurrency();
+		}
+	}
+
+	// Queues must all exist before any worker starts stealing
+	for (int i = 0; i < threadCount; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this, i));
+	}
+
+} // end ThreadPool constructor
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		shuttingDown = true;
+	}
+	workAvailable.notify_all();
+
+	for (auto & worker : workers) {
+		worker.join();
+	}
+
+} // end ThreadPool destructor
+
+
+int ThreadPool::getHardwareConcurrency()
+{
+	int hardwareThreads = (int)std::thread::hardware_concurrency();
+
+	return hardwareThreads > 0 ? hardwareThreads : 1;
+
+} // end getHardwareConcurrency
+
+
+int ThreadPool::getWorkerIndex() const
+{
+	return (currentPool == this) ? currentWorkerIndex : -1;
+
+} // end getWorkerIndex
+
+
+std::vector<WorkerStatistics> ThreadPool::getWorkerStatistics() const
+{
+	std::vector<WorkerStatistics> statistics;
+
+	for (const auto & queue : queues) {
+		statistics.push_back({ queue->core, queue->pinned, queue->tasksRun,
+			queue->tasksStolen, queue->tasksOffCore });
+	}
+
+	return statistics;
+
+} // end getWorkerStatistics
+
+
+bool ThreadPool::pinToCore(int core)
+{
+#ifdef _WIN32
+	if (core >= (int)(8 * sizeof(DWORD_PTR))) {
+		return false;
+	}
+	return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << core) != 0;
+#elif defined(__linux__)
+	cpu_set_t cores;
+	CPU_ZERO(&cores);
+	CPU_SET(core, &cores);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cores), &cores) == 0;
+#else
+	// No portable way to pin a thread
+	return false;
+#endif
+
+} // end pinToCore
+
+
+int ThreadPool::getCurrentCore()
+{
+#ifdef _WIN32
+	return (int)GetCurrentProcessorNumber();
+#elif defined(__linux__)
+	return sched_getcpu();
+#else
+	return -1;
+#endif
+
+} // end getCurrentCore
+
+
+void ThreadPool::submit(std::function<void()> task, TaskGroup & group)
+{
+	int workerIndex = getWorkerIndex();
+
+	if (workerIndex < 0) {
+		workerIndex = (int)(nextQueue++ % queues.size());
+	}
+
+	submit(std::move(task), group, workerIndex);
+
+} // end submit
+
+
+void ThreadPool::submit(std::function<void()> task, TaskGroup & group, int workerIndex)
+{
+	group.pendingTasks++;
+
+	WorkerQueue & queue = *queues[workerIndex % queues.size()];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		Task queuedTask;
+		queuedTask.function = std::move(task);
+		queuedTask.group = &group;
+		queue.tasks.push_back(std::move(queuedTask));
+	}
+
+	queuedTasks++;
+
+	// Lock so that a worker cannot miss the notification between checking
+	// for work and going to sleep.
+	std::lock_guard<std::mutex> lock(sleepMutex);
+	workAvailable.notify_one();
+
+} // end submit
+
+
+void ThreadPool::runOnEveryWorker(std::function<void(int workerIndex)> task)
+{
+	TaskGroup group;
+
+	for (int i = 0; i < (int)queues.size(); i++) {
+
+		group.pendingTasks++;
+
+		WorkerQueue & queue = *queues[i];
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			Task ownTask;
+			ownTask.function = [task, i] { task(i); };
+			ownTask.group = &group;
+			queue.ownTasks.push_back(std::move(ownTask));
+		}
+
+		queue.ownTaskCount++;
+	}
+
+	// Any worker could be the one that was woken, so wake them all
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		workAvailable.notify_all();
+	}
+
+	wait(group);
+
+} // end runOnEveryWorker
+
+
+void ThreadPool::wait(TaskGroup & group)
+{
+	int workerIndex = getWorkerIndex();
+
+	while (group.pendingTasks > 0) {
+
+		Task task;
+
+		// Workers help with queued tasks rather than blocking a thread
+		// the pool may need to finish the group.
+		if (workerIndex >= 0 && (popTask(workerIndex, task) || stealTask(workerIndex, task))) {
+			runTask(task, workerIndex);
+		}
+		else {
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			if (workerIndex >= 0) {
+				groupFinished.wait_for(lock, std::chrono::milliseconds(1), [&] {
+					return group.pendingTasks == 0 || queuedTasks > 0 ||
+						queues[workerIndex]->ownTaskCount > 0; });
+			}
+			else {
+				groupFinished.wait(lock, [&] { return group.pendingTasks == 0; });
+			}
+		}
+	}
+
+} // end wait
+
+
+void ThreadPool::workerLoop(int workerIndex)
+{
+	currentPool = this;
+	currentWorkerIndex = workerIndex;
+
+	WorkerQueue & queue = *queues[workerIndex];
+
+	if (pinWorkers) {
+		queue.pinned = pinToCore(queue.core);
+	}
+
+	while (true) {
+
+		Task task;
+
+		if (popTask(workerIndex, task) || stealTask(workerIndex, task)) {
+			runTask(task, workerIndex);
+		}
+		else {
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			workAvailable.wait(lock, [this, &queue] {
+				return shuttingDown || queuedTasks > 0 || queue.ownTaskCount > 0; });
+
+			if (shuttingDown) {
+				break;
+			}
+		}
+	}
+
+} // end workerLoop
+
+
+bool ThreadPool::popTask(int workerIndex, Task & task)
+{
+	WorkerQueue & queue = *queues[workerIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	// Tasks meant for this worker only come first, since no one else can
+	// run them
+	if (queue.ownTasks.empty() == false) {
+		task = std::move(queue.ownTasks.front());
+		queue.ownTasks.pop_front();
+		queue.ownTaskCount--;
+		return true;
+	}
+
+	if (queue.tasks.empty()) {
+		return false;
+	}
+
+	task = std::move(queue.tasks.back());
+	queue.tasks.pop_back();
+	queuedTasks--;
+
+	return true;
+
+} // end popTask
+
+
+bool ThreadPool::stealTask(int thiefIndex, Task & task)
+{
+	int queueCount = (int)queues.size();
+
+	// Start with the neighbor of the thief so that thieves spread out
+	for (int i = 1; i <= queueCount; i++) {
+
+		int victim = (thiefIndex + i) % queueCount;
+
+		if (victim == thiefIndex) {
+			continue;
+		}
+
+		WorkerQueue & queue = *queues[victim];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (!queue.tasks.empty()) {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+			queuedTasks--;
+
+			if (thiefIndex >= 0) {
+				queues[thiefIndex]->tasksStolen++;
+			}
+			return true;
+		}
+	}
+
+	return false;
+
+} // end stealTask
+
+
+void ThreadPool::runTask(Task & task, int workerIndex)
+{
+	if (workerIndex >= 0) {
+
+		WorkerQueue & queue = *queues[workerIndex];
+		queue.tasksRun++;
+
+		if (queue.pinned) {
+			int core = getCurrentCore();
+			if (core >= 0 && core != queue.core) {
+				queue.tasksOffCore++;
+			}
+		}
+	}
+
+	task.function();
+
+	if (--task.group->pendingTasks == 0) {
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		groupFinished.notify_all();
+	}
+
+} // end runTask
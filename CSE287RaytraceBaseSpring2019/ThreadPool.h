@@ -0,0 +1,250 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+* Counter shared by a batch of tasks that are submitted to a ThreadPool.
+* ThreadPool::wait returns once every task submitted with the group has
+* finished executing.
+*/
+struct TaskGroup
+{
+	TaskGroup() : pendingTasks(0) {}
+
+	// Number of tasks in the group that have not finished
+	std::atomic<int> pendingTasks;
+};
+
+/**
+* Flag that long running work checks periodically to find out whether it
+* should stop early.
+*/
+struct CancellationToken
+{
+	CancellationToken() : cancelled(false) {}
+
+	// Requests that the work using the token stops
+	void cancel() { cancelled = true; }
+
+	// Clears the request so the token can be used for new work
+	void reset() { cancelled = false; }
+
+	// True once cancel has been called
+	bool isCancelled() const { return cancelled; }
+
+	std::atomic<bool> cancelled;
+};
+
+/**
+* Where a worker of a ThreadPool ran and how much work it did.
+*/
+struct WorkerStatistics
+{
+	// Core the worker was pinned to or -1 if pinning was not requested
+	int core;
+
+	// True if the operating system accepted the pinning
+	bool pinned;
+
+	// Tasks run by the worker, including the ones it stole
+	long long tasksRun;
+
+	// Tasks the worker took from the queues of other workers
+	long long tasksStolen;
+
+	// Tasks that started on a core other than the one the worker was
+	// pinned to. Always zero when the core cannot be queried.
+	long long tasksOffCore;
+};
+
+/**
+* Persistent pool of worker threads that executes tasks using work stealing.
+* Every worker owns a double ended queue of tasks. A worker takes tasks from
+* the back of its own queue and, when its queue is empty, steals tasks from
+* the front of the queues that belong to the other workers.
+*/
+class ThreadPool
+{
+public:
+
+	/**
+	* Constructor. Starts the worker threads.
+	* @param threadCount - number of worker threads. Values of zero or less
+	* result in one worker for every hardware thread.
+	* @param pinWorkers - true to pin worker i to core i modulo the number
+	* of hardware threads so that workers stay next to the memory they touch
+	*/
+	ThreadPool(int threadCount = 0, bool pinWorkers = false);
+
+	/**
+	* Stops and joins all worker threads. Tasks that are still queued are
+	* run before the workers stop.
+	*/
+	~ThreadPool();
+
+	/**
+	* Queues a task for execution. Tasks are distributed round robin over the
+	* worker queues unless the caller is itself a worker, in which case the
+	* task is pushed onto the queue of the calling worker.
+	* @param task - function to execute
+	* @param group - group that tracks completion of the task
+	*/
+	void submit(std::function<void()> task, TaskGroup & group);
+
+	/**
+	* Queues a task on the queue of a specific worker. Other workers may still
+	* steal it if they run out of work.
+	* @param task - function to execute
+	* @param group - group that tracks completion of the task
+	* @param workerIndex - index of the worker whose queue receives the task
+	*/
+	void submit(std::function<void()> task, TaskGroup & group, int workerIndex);
+
+	/**
+	* Runs a function once on every worker and blocks until all of them have
+	* returned. Unlike tasks, the calls cannot be stolen, so each one runs on
+	* the thread, and when pinned on the core, of the worker it was meant for.
+	* @param task - function to execute. Receives the index of the worker.
+	*/
+	void runOnEveryWorker(std::function<void(int workerIndex)> task);
+
+	/**
+	* Blocks until all tasks in the group have finished. When called from a
+	* worker thread the caller executes queued tasks while it waits so that
+	* tasks can safely wait on tasks they have submitted.
+	* @param group - group of tasks to wait for
+	*/
+	void wait(TaskGroup & group);
+
+	/**
+	* Returns the number of worker threads in the pool.
+	*/
+	int getThreadCount() const { return (int)workers.size(); }
+
+	/**
+	* Returns the index of the calling thread within this pool or -1 if the
+	* caller is not one of the workers of this pool.
+	*/
+	int getWorkerIndex() const;
+
+	/**
+	* Returns true if the workers were asked to pin themselves to cores.
+	*/
+	bool isPinned() const { return pinWorkers; }
+
+	/**
+	* Returns the statistics of every worker, indexed by worker.
+	*/
+	std::vector<WorkerStatistics> getWorkerStatistics() const;
+
+	/**
+	* Returns the number of hardware threads, never less than one.
+	*/
+	static int getHardwareConcurrency();
+
+protected:
+
+	/**
+	* Function to be executed along with the group that tracks it.
+	*/
+	struct Task
+	{
+		std::function<void()> function;
+		TaskGroup * group = nullptr;
+	};
+
+	/**
+	* Queue of tasks that belongs to a single worker.
+	*/
+	struct WorkerQueue
+	{
+		WorkerQueue() : ownTaskCount(0), core(-1), pinned(false),
+			tasksRun(0), tasksStolen(0), tasksOffCore(0) {}
+
+		std::mutex mutex;
+		std::deque<Task> tasks;
+
+		// Tasks that only this worker may run
+		std::deque<Task> ownTasks;
+		std::atomic<int> ownTaskCount;
+
+		// Statistics of the worker
+		int core;
+		std::atomic<bool> pinned;
+		std::atomic<long long> tasksRun;
+		std::atomic<long long> tasksStolen;
+		std::atomic<long long> tasksOffCore;
+	};
+
+	/**
+	* Main loop of each of the worker threads.
+	* @param workerIndex - index of the worker
+	*/
+	void workerLoop(int workerIndex);
+
+	/**
+	* Pins the calling worker to its core.
+	* @returns true if the operating system accepted the pinning
+	*/
+	bool pinToCore(int core);
+
+	/**
+	* Returns the core the calling thread is running on or -1 if unknown.
+	*/
+	static int getCurrentCore();
+
+	/**
+	* Removes a task from the back of the queue of a worker.
+	* @returns true if a task was found
+	*/
+	bool popTask(int workerIndex, Task & task);
+
+	/**
+	* Removes a task from the front of the queue of any worker other than
+	* the thief.
+	* @param thiefIndex - index of the worker that is looking for work or -1
+	* @returns true if a task was found
+	*/
+	bool stealTask(int thiefIndex, Task & task);
+
+	/**
+	* Executes a task and signals its group when the group has completed.
+	* @param workerIndex - index of the worker that runs the task or -1
+	*/
+	void runTask(Task & task, int workerIndex);
+
+	// One queue for each worker thread
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+
+	// Worker threads
+	std::vector<std::thread> workers;
+
+	// Guards sleeping and waking of workers and waiting threads
+	std::mutex sleepMutex;
+
+	// Signaled when tasks are queued or the pool shuts down
+	std::condition_variable workAvailable;
+
+	// Signaled when a task group completes
+	std::condition_variable groupFinished;
+
+	// Number of tasks that are queued but not yet started
+	std::atomic<int> queuedTasks;
+
+	// Queue that receives the next task submitted from outside the pool
+	std::atomic<unsigned int> nextQueue;
+
+	// Set to stop the worker threads
+	std::atomic<bool> shuttingDown;
+
+	// True if every worker pins itself to a core
+	bool pinWorkers;
+
+}; // end ThreadPool class
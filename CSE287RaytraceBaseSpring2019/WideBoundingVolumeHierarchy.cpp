@@ -0,0 +1,455 @@
+#include "WideBoundingVolumeHierarchy.h"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define WIDE_BVH_SSE
+#include <immintrin.h>
+#endif
+
+// Slab distances are computed in single precision. Scaling the exit
+// distance by this factor keeps rounding from culling a box the ray only
+// just passes through.
+static const float EXIT_SCALE = 1.0f + 4.0f * FLT_EPSILON;
+
+// Direction components smaller than this are replaced by it, so that every
+// component has a finite inverse and no slab distance is ever 0 * infinity
+static const double MIN_DIRECTION = 1.0E-20;
+
+
+template <int WIDTH>
+float WideBoundingVolumeHierarchy<WIDTH>::roundDown(double value)
+{
+	float rounded = (float)value;
+
+	return ((double)rounded > value) ? std::nextafter(rounded, -INFINITY) : rounded;
+
+} // end roundDown
+
+
+template <int WIDTH>
+float WideBoundingVolumeHierarchy<WIDTH>::roundUp(double value)
+{
+	float rounded = (float)value;
+
+	return ((double)rounded < value) ? std::nextafter(rounded, INFINITY) : rounded;
+
+} // end roundUp
+
+
+template <int WIDTH>
+void WideBoundingVolumeHierarchy<WIDTH>::prepareRay(const Ray & ray, SlabRay & slabRay)
+{
+	for (int axis = 0; axis < 3; axis++) {
+
+		double direction = ray.direct[axis];
+		if (std::abs(direction) < MIN_DIRECTION) {
+			direction = (direction < 0.0) ? -MIN_DIRECTION : MIN_DIRECTION;
+		}
+
+		slabRay.origin[axis] = (float)ray.origin[axis];
+		slabRay.inverseDirection[axis] = (float)(1.0 / direction);
+		slabRay.nearPlane[axis] = (direction < 0.0) ? axis + 3 : axis;
+		slabRay.farPlane[axis] = (direction < 0.0) ? axis : axis + 3;
+	}
+
+} // end prepareRay
+
+
+template <int WIDTH>
+int WideBoundingVolumeHierarchy<WIDTH>::intersectChildren(const float(&bounds)[6][WIDTH], const SlabRay & ray,
+	float maxDistance, float * entryDistances)
+{
+	int mask = 0;
+
+#if defined(__AVX__)
+	if (WIDTH % 8 == 0) {
+
+		for (int group = 0; group < WIDTH; group += 8) {
+
+			__m256 entry = _mm256_setzero_ps();
+			__m256 exit = _mm256_set1_ps(maxDistance);
+
+			for (int axis = 0; axis < 3; axis++) {
+
+				__m256 origin = _mm256_set1_ps(ray.origin[axis]);
+				__m256 inverseDirection = _mm256_set1_ps(ray.inverseDirection[axis]);
+
+				entry = _mm256_max_ps(entry, _mm256_mul_ps(_mm256_sub_ps(
+					_mm256_loadu_ps(&bounds[ray.nearPlane[axis]][group]), origin), inverseDirection));
+				exit = _mm256_min_ps(exit, _mm256_mul_ps(_mm256_sub_ps(
+					_mm256_loadu_ps(&bounds[ray.farPlane[axis]][group]), origin), inverseDirection));
+			}
+
+			exit = _mm256_mul_ps(exit, _mm256_set1_ps(EXIT_SCALE));
+
+			mask |= _mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ)) << group;
+			_mm256_storeu_ps(entryDistances + group, entry);
+		}
+
+		return mask;
+	}
+#endif
+
+#if defined(WIDE_BVH_SSE)
+	for (int group = 0; group < WIDTH; group += 4) {
+
+		__m128 entry = _mm_setzero_ps();
+		__m128 exit = _mm_set1_ps(maxDistance);
+
+		for (int axis = 0; axis < 3; axis++) {
+
+			__m128 origin = _mm_set1_ps(ray.origin[axis]);
+			__m128 inverseDirection = _mm_set1_ps(ray.inverseDirection[axis]);
+
+			entry = _mm_max_ps(entry, _mm_mul_ps(_mm_sub_ps(
+				_mm_loadu_ps(&bounds[ray.nearPlane[axis]][group]), origin), inverseDirection));
+			exit = _mm_min_ps(exit, _mm_mul_ps(_mm_sub_ps(
+				_mm_loadu_ps(&bounds[ray.farPlane[axis]][group]), origin), inverseDirection));
+		}
+
+		exit = _mm_mul_ps(exit, _mm_set1_ps(EXIT_SCALE));
+
+		mask |= _mm_movemask_ps(_mm_cmple_ps(entry, exit)) << group;
+		_mm_storeu_ps(entryDistances + group, entry);
+	}
+#else
+	for (int lane = 0; lane < WIDTH; lane++) {
+
+		float entry = 0.0f;
+		float exit = maxDistance;
+
+		for (int axis = 0; axis < 3; axis++) {
+			entry = glm::max(entry, (bounds[ray.nearPlane[axis]][lane] - ray.origin[axis]) * ray.inverseDirection[axis]);
+			exit = glm::min(exit, (bounds[ray.farPlane[axis]][lane] - ray.origin[axis]) * ray.inverseDirection[axis]);
+		}
+
+		if (entry <= exit * EXIT_SCALE) {
+			mask |= 1 << lane;
+		}
+		entryDistances[lane] = entry;
+	}
+#endif
+
+	return mask;
+
+} // end intersectChildren
+
+
+template <int WIDTH>
+WideBoundingVolumeHierarchy<WIDTH>::WideBoundingVolumeHierarchy(BuildMethod buildMethod)
+	: BoundingVolumeHierarchy(buildMethod)
+{
+
+} // end WideBoundingVolumeHierarchy constructor
+
+
+template <int WIDTH>
+AcceleratorType WideBoundingVolumeHierarchy<WIDTH>::getType() const
+{
+	return (WIDTH == 8) ? AcceleratorType::WIDE8_BVH : AcceleratorType::WIDE4_BVH;
+
+} // end getType
+
+
+template <int WIDTH>
+const char * WideBoundingVolumeHierarchy<WIDTH>::getName() const
+{
+	return (WIDTH == 8) ? "8-wide BVH" : "4-wide BVH";
+
+} // end getName
+
+
+template <int WIDTH>
+double WideBoundingVolumeHierarchy<WIDTH>::getCost() const
+{
+	double cost = INTERSECTION_COST * unboundedSurfaces.size();
+
+	if (wideNodes.empty() || nodes[0].bounds.getSurfaceArea() <= 0.0) {
+		return cost + INTERSECTION_COST * surfaceOrder.size();
+	}
+
+	// A ray that reaches a node tests every child box at once, so a node
+	// costs one traversal step
+	double rootArea = nodes[0].bounds.getSurfaceArea();
+
+	for (const WideNode & node : wideNodes) {
+
+		AABB nodeBox;
+
+		for (int lane = 0; lane < WIDTH; lane++) {
+
+			if (node.count[lane] < 0) {
+				continue;
+			}
+
+			AABB childBox(dvec3(node.bounds[0][lane], node.bounds[1][lane], node.bounds[2][lane]),
+				dvec3(node.bounds[3][lane], node.bounds[4][lane], node.bounds[5][lane]));
+			nodeBox.expand(childBox);
+
+			if (node.count[lane] > 0) {
+				cost += INTERSECTION_COST * node.count[lane] * childBox.getSurfaceArea() / rootArea;
+			}
+		}
+
+		cost += TRAVERSAL_COST * nodeBox.getSurfaceArea() / rootArea;
+	}
+
+	return cost;
+
+} // end getCost
+
+
+template <int WIDTH>
+size_t WideBoundingVolumeHierarchy<WIDTH>::getMemoryBytes() const
+{
+	return BoundingVolumeHierarchy::getMemoryBytes() + wideNodes.capacity() * sizeof(WideNode);
+
+} // end getMemoryBytes
+
+
+template <int WIDTH>
+void WideBoundingVolumeHierarchy<WIDTH>::buildStructure(std::vector<Primitive> & primitives, ThreadPool * threadPool)
+{
+	BoundingVolumeHierarchy::buildStructure(primitives, threadPool);
+	collapse();
+
+} // end buildStructure
+
+
+template <int WIDTH>
+void WideBoundingVolumeHierarchy<WIDTH>::refitStructure(const std::vector<AABB> & bounds, ThreadPool * threadPool)
+{
+	BoundingVolumeHierarchy::refitStructure(bounds, threadPool);
+	collapse();
+
+} // end refitStructure
+
+
+template <int WIDTH>
+void WideBoundingVolumeHierarchy<WIDTH>::collapse()
+{
+	wideNodes.clear();
+
+	if (nodes.empty()) {
+		return;
+	}
+
+	wideNodes.reserve(nodes.size() / (WIDTH / 2) + 1);
+	collapseNode(0);
+	wideNodes.shrink_to_fit();
+
+} // end collapse
+
+
+template <int WIDTH>
+int WideBoundingVolumeHierarchy<WIDTH>::collapseNode(int nodeIndex)
+{
+	int wideIndex = (int)wideNodes.size();
+	wideNodes.push_back(WideNode());
+
+	// Binary nodes that become the children of the wide node
+	int children[WIDTH];
+	int childCount = 0;
+
+	if (nodes[nodeIndex].count > 0) {
+		children[childCount++] = nodeIndex;
+	}
+	else {
+		children[childCount++] = nodeIndex + 1;
+		children[childCount++] = nodes[nodeIndex].first;
+	}
+
+	// Open the largest interior child until the node is full
+	while (childCount < WIDTH) {
+
+		int largest = -1;
+		double largestArea = -1.0;
+
+		for (int i = 0; i < childCount; i++) {
+
+			const Node & child = nodes[children[i]];
+
+			if (child.count == 0 && child.bounds.getSurfaceArea() > largestArea) {
+				largest = i;
+				largestArea = child.bounds.getSurfaceArea();
+			}
+		}
+
+		if (largest < 0) {
+			break;
+		}
+
+		int opened = children[largest];
+		children[largest] = opened + 1;
+		children[childCount++] = nodes[opened].first;
+	}
+
+	// Subtrees are appended after the node, so its entry is filled in by
+	// index rather than through a reference that push_back could invalidate
+	for (int lane = 0; lane < WIDTH; lane++) {
+
+		if (lane >= childCount) {
+
+			for (int axis = 0; axis < 3; axis++) {
+				wideNodes[wideIndex].bounds[axis][lane] = INFINITY;
+				wideNodes[wideIndex].bounds[axis + 3][lane] = -INFINITY;
+			}
+			wideNodes[wideIndex].first[lane] = 0;
+			wideNodes[wideIndex].count[lane] = -1;
+			continue;
+		}
+
+		const Node & child = nodes[children[lane]];
+
+		for (int axis = 0; axis < 3; axis++) {
+			wideNodes[wideIndex].bounds[axis][lane] = roundDown(child.bounds.minimum[axis]);
+			wideNodes[wideIndex].bounds[axis + 3][lane] = roundUp(child.bounds.maximum[axis]);
+		}
+
+		if (child.count > 0) {
+			wideNodes[wideIndex].first[lane] = child.first;
+			wideNodes[wideIndex].count[lane] = child.count;
+		}
+		else {
+			int childIndex = collapseNode(children[lane]);
+			wideNodes[wideIndex].first[lane] = childIndex;
+			wideNodes[wideIndex].count[lane] = 0;
+		}
+	}
+
+	return wideIndex;
+
+} // end collapseNode
+
+
+template <int WIDTH>
+void WideBoundingVolumeHierarchy<WIDTH>::traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const
+{
+	if (wideNodes.empty()) {
+		return;
+	}
+
+	SlabRay slabRay;
+	prepareRay(ray, slabRay);
+
+	// Nodes waiting to be visited and the distances at which the ray enters them
+	struct StackEntry
+	{
+		int node;
+		float entryDistance;
+	};
+
+	StackEntry stack[MAX_DEPTH * WIDTH];
+	int stackSize = 0;
+
+	stack[stackSize++] = { 0, 0.0f };
+
+	while (stackSize > 0) {
+
+		StackEntry entry = stack[--stackSize];
+
+		// The closest hit may have moved closer since the node was pushed
+		if (entry.entryDistance > closestHit.t) {
+			continue;
+		}
+
+		const WideNode & node = wideNodes[entry.node];
+
+		float entryDistances[WIDTH];
+		float maxDistance = (closestHit.t < FLT_MAX) ? roundUp(closestHit.t) : FLT_MAX;
+		int mask = intersectChildren(node.bounds, slabRay, maxDistance, entryDistances);
+
+		// Order the children that were hit by entry distance
+		int order[WIDTH];
+		int hitCount = 0;
+
+		for (int lane = 0; lane < WIDTH; lane++) {
+
+			if ((mask & (1 << lane)) == 0) {
+				continue;
+			}
+
+			int position = hitCount++;
+			while (position > 0 && entryDistances[order[position - 1]] > entryDistances[lane]) {
+				order[position] = order[position - 1];
+				position--;
+			}
+			order[position] = lane;
+		}
+
+		// Test leaves nearest first. Push interior children farthest first
+		// so that the nearest is visited next.
+		for (int i = 0; i < hitCount; i++) {
+
+			int lane = order[i];
+
+			for (int j = node.first[lane]; j < node.first[lane] + node.count[lane]; j++) {
+				testSurface(ray, surfaceOrder[j], closestHit, closestSurface);
+			}
+		}
+
+		for (int i = hitCount - 1; i >= 0; i--) {
+
+			int lane = order[i];
+
+			if (node.count[lane] == 0) {
+				stack[stackSize++] = { node.first[lane], entryDistances[lane] };
+			}
+		}
+	}
+
+} // end traverse
+
+
+template <int WIDTH>
+int WideBoundingVolumeHierarchy<WIDTH>::traverseOccluded(const Ray & ray, double maxDistance) const
+{
+	if (wideNodes.empty()) {
+		return -1;
+	}
+
+	SlabRay slabRay;
+	prepareRay(ray, slabRay);
+
+	float range = (maxDistance < FLT_MAX) ? roundUp(maxDistance) : FLT_MAX;
+
+	// Any blocker will do, so the children are not ordered
+	int stack[MAX_DEPTH * WIDTH];
+	int stackSize = 0;
+
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0) {
+
+		const WideNode & node = wideNodes[stack[--stackSize]];
+
+		float entryDistances[WIDTH];
+		int mask = intersectChildren(node.bounds, slabRay, range, entryDistances);
+
+		for (int lane = 0; lane < WIDTH; lane++) {
+
+			if ((mask & (1 << lane)) == 0) {
+				continue;
+			}
+
+			if (node.count[lane] == 0) {
+				stack[stackSize++] = node.first[lane];
+				continue;
+			}
+
+			for (int j = node.first[lane]; j < node.first[lane] + node.count[lane]; j++) {
+				if (surfaces[surfaceOrder[j]]->isOccluding(ray, maxDistance)) {
+					return surfaceOrder[j];
+				}
+			}
+		}
+	}
+
+	return -1;
+
+} // end traverseOccluded
+
+
+template class WideBoundingVolumeHierarchy<4>;
+template class WideBoundingVolumeHierarchy<8>;
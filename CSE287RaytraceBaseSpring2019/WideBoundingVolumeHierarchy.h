@@ -0,0 +1,133 @@
+#pragma once
+
+#include "BoundingVolumeHierarchy.h"
+
+/**
+* Bounding volume hierarchy whose nodes have up to WIDTH children, so that
+* one SIMD slab test checks a ray against the boxes of every child of a
+* node. WIDTH is 4 or 8. The tree is built as a binary hierarchy by any of
+* its builders and then collapsed: each wide node takes the place of a
+* binary node and repeatedly replaces the child with the largest surface
+* area by its two children until it has WIDTH children or only leaves.
+*
+* Child boxes are stored as single precision floats, rounded outward, in
+* structure of arrays order so that the same bound of every child loads
+* into one register. Four children are tested with SSE. Eight are tested
+* with AVX where the compiler targets it and as two groups of four
+* otherwise. The children a ray hits are visited in the order in which it
+* enters them, which is the order along the direction of the ray.
+*
+* A refit updates the binary tree and collapses it again.
+*/
+template <int WIDTH>
+class WideBoundingVolumeHierarchy : public BoundingVolumeHierarchy
+{
+public:
+
+	/**
+	* Constructor.
+	* @param buildMethod - algorithm that builds the binary tree
+	*/
+	WideBoundingVolumeHierarchy(BuildMethod buildMethod = BuildMethod::SWEEP_SAH);
+
+	virtual AcceleratorType getType() const;
+
+	virtual const char * getName() const;
+
+	virtual double getCost() const;
+
+	virtual size_t getMemoryBytes() const;
+
+protected:
+
+	/**
+	* Ray in the form the slab tests use.
+	*/
+	struct SlabRay
+	{
+		float origin[3];
+		float inverseDirection[3];
+
+		// Rows of the bounds holding the plane of each axis that the ray
+		// crosses first and the one it crosses last
+		int nearPlane[3];
+		int farPlane[3];
+	};
+
+	/**
+	* Node of the collapsed tree. Lanes without a child have an empty box.
+	*/
+	struct WideNode
+	{
+		// Minimum x, y, and z and maximum x, y, and z of the box of each child
+		float bounds[6][WIDTH];
+
+		// Leaves: index in surfaceOrder of the first surface of the leaf.
+		// Interior nodes: index in wideNodes of the child.
+		int first[WIDTH];
+
+		// Number of surfaces in a leaf. Zero for interior nodes and -1 for
+		// lanes without a child.
+		int count[WIDTH];
+	};
+
+	virtual void buildStructure(std::vector<Primitive> & primitives, ThreadPool * threadPool);
+
+	virtual void refitStructure(const std::vector<AABB> & bounds, ThreadPool * threadPool);
+
+	virtual std::shared_ptr<Accelerator> clone() const { return std::make_shared<WideBoundingVolumeHierarchy>(*this); }
+
+	virtual void traverse(const Ray & ray, HitRecord & closestHit, int & closestSurface) const;
+
+	virtual int traverseOccluded(const Ray & ray, double maxDistance) const;
+
+	/**
+	* Traces the rays of a packet one at a time through the wide nodes,
+	* which already test the boxes of several children side by side. The
+	* binary nodes that the base class walks are freed by sub-classes.
+	*/
+	virtual void traversePacket(const RayPacket & packet, HitRecord hits[], int closestSurfaces[]) const
+	{
+		Accelerator::traversePacket(packet, hits, closestSurfaces);
+	}
+
+	/**
+	* Converts a ray to the form the slab tests use.
+	*/
+	static void prepareRay(const Ray & ray, SlabRay & slabRay);
+
+	/**
+	* Checks a ray against the boxes of every child of a wide node.
+	* @param bounds - minimum x, y, and z and maximum x, y, and z of each box
+	* @param entryDistances - set to the distance at which the ray enters each box
+	* @returns mask with bit i set if the ray hits box i before maxDistance
+	*/
+	static int intersectChildren(const float(&bounds)[6][WIDTH], const SlabRay & ray, float maxDistance,
+		float * entryDistances);
+
+	/**
+	* Rounds a double to the nearest float toward negative infinity.
+	*/
+	static float roundDown(double value);
+
+	/**
+	* Rounds a double to the nearest float toward positive infinity.
+	*/
+	static float roundUp(double value);
+
+	/**
+	* Replaces the wide nodes with nodes collapsed from the binary tree.
+	*/
+	void collapse();
+
+	/**
+	* Appends the wide node that takes the place of a binary node, followed
+	* by its subtrees.
+	* @returns index of the wide node
+	*/
+	int collapseNode(int nodeIndex);
+
+	// Nodes of the collapsed tree. The root is the first node.
+	std::vector<WideNode> wideNodes;
+
+}; // end WideBoundingVolumeHierarchy class